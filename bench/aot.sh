@@ -0,0 +1,34 @@
+#!/bin/bash
+# usage: bench/aot.sh [eve-binary]
+# builds every bench/*.eve script with --emit-c (against the runtime library
+# next to the binary) and reports the best wall-clock time (seconds) out of
+# $RUNS runs of the interpreter and of the compiled program.
+RUNS=${RUNS:-3}
+CC=${CC:-cc}
+dir=$(dirname "$0")
+eve=${1:-"$dir"/../build/eve}
+runtime=$(dirname "$eve")/libeve-runtime.a
+out=$(mktemp -d)
+trap 'rm -rf "$out"' EXIT
+TIMEFORMAT=%R
+
+best_time() {
+  local best="" elapsed
+  for _ in $(seq "$RUNS"); do
+    elapsed=$( { time "$@" > /dev/null 2>&1; } 2>&1 ) || return 1
+    if [ -z "$best" ] || awk "BEGIN{exit !($elapsed < $best)}"; then
+      best=$elapsed
+    fi
+  done
+  echo "$best"
+}
+
+printf "%-16s  %-20s  %-20s\n" "bench" "run()" "--emit-c"
+for bench in "$dir"/*.eve; do
+  name=$(basename "$bench" .eve)
+  "$eve" --emit-c "$bench" > "$out/$name.c" \
+    && $CC -O2 -I "$dir"/../src "$out/$name.c" "$runtime" -lm -o "$out/$name"
+  printf "%-16s  %-20s  %-20s\n" "$name" \
+    "$(best_time "$eve" "$bench" || echo failed)" \
+    "$(best_time "$out/$name" || echo failed)"
+done
@@ -0,0 +1,33 @@
+#!/bin/bash
+# usage: bench/run.sh [eve-binary...]
+# an argument may carry interpreter flags, e.g. "build/eve -O0".
+# runs every bench/*.eve script with each binary and reports the best
+# wall-clock time (seconds) out of $RUNS runs.
+RUNS=${RUNS:-3}
+dir=$(dirname "$0")
+if [ $# -eq 0 ]; then
+  set -- "$dir"/../build/eve
+fi
+TIMEFORMAT=%R
+
+best_time() {
+  local best="" elapsed
+  for _ in $(seq "$RUNS"); do
+    elapsed=$( { time "$@" > /dev/null 2>&1; } 2>&1 ) || return 1
+    if [ -z "$best" ] || awk "BEGIN{exit !($elapsed < $best)}"; then
+      best=$elapsed
+    fi
+  done
+  echo "$best"
+}
+
+printf "%-16s" "bench"
+for eve in "$@"; do printf "  %-20s" "$eve"; done
+echo
+for bench in "$dir"/*.eve; do
+  printf "%-16s" "$(basename "$bench" .eve)"
+  for eve in "$@"; do
+    printf "  %-20s" "$(best_time $eve "$bench" || echo failed)"
+  done
+  echo
+done
@@ -0,0 +1,429 @@
+#include "aot.h"
+
+#include <inttypes.h>
+
+#include "compiler.h"
+#include "serde.h"
+
+static bool has_wide(Code* code) {
+  for (int i = 0; i < code->length; i += inst_length(code, i)) {
+    if (code->bytes[i] == $WIDE) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static const char* arithmetic_op(byte_t op) {
+  switch (op) {
+    case $ADD:
+      return "+";
+    case $SUBTRACT:
+      return "-";
+    case $MULTIPLY:
+      return "*";
+    case $DIVIDE:
+      return "/";
+    case $LESS:
+    case $LESS_JMP:
+      return "<";
+    case $GREATER:
+    case $GREATER_JMP:
+      return ">";
+    case $LESS_OR_EQ:
+    case $LESS_OR_EQ_JMP:
+      return "<=";
+    default:
+      return ">=";
+  }
+}
+
+static const char* opcode_name(byte_t op) {
+  // as written in the emitted C, for jit_binary() and jit_unary()
+  switch (op) {
+    case $ADD:
+      return "$ADD";
+    case $SUBTRACT:
+      return "$SUBTRACT";
+    case $MULTIPLY:
+      return "$MULTIPLY";
+    case $DIVIDE:
+      return "$DIVIDE";
+    case $LESS:
+    case $LESS_JMP:
+      return "$LESS";
+    case $GREATER:
+    case $GREATER_JMP:
+      return "$GREATER";
+    case $LESS_OR_EQ:
+    case $LESS_OR_EQ_JMP:
+      return "$LESS_OR_EQ";
+    case $GREATER_OR_EQ:
+    case $GREATER_OR_EQ_JMP:
+      return "$GREATER_OR_EQ";
+    case $MOD:
+      return "$MOD";
+    case $POW:
+      return "$POW";
+    case $BW_LSHIFT:
+      return "$BW_LSHIFT";
+    case $BW_RSHIFT:
+      return "$BW_RSHIFT";
+    case $BW_AND:
+      return "$BW_AND";
+    case $BW_OR:
+      return "$BW_OR";
+    case $BW_XOR:
+      return "$BW_XOR";
+    default:
+      return "$BW_INVERT";
+  }
+}
+
+static void emit_const(Value* consts, int k, FILE* out) {
+  // numbers, booleans and None are written as their bits
+  Value val = consts[k];
+  if (IS_OBJ(val)) {
+    fprintf(out, "AOT_LOAD_CONST(%d);\n", k);
+  } else if (IS_NUMBER(val)) {
+    fprintf(
+        out,
+        "AOT_LOAD_VALUE(0x%016" PRIx64 "u);  // %.17g\n",
+        val,
+        AS_NUMBER(val));
+  } else {
+    fprintf(out, "AOT_LOAD_VALUE(0x%016" PRIx64 "u);\n", val);
+  }
+}
+
+static void emit_inst(Code* code, int i, FILE* out) {
+  byte_t* ip = code->bytes + i;
+  int next = i + inst_length(code, i), target = jump_target(code, i);
+  byte_t op = generic_opcode(*ip);
+  fprintf(out, "i%d:\n  ", i);
+  switch (op) {
+    case $LOAD_CONST:
+      emit_const(code->vpool.values, ip[1], out);
+      break;
+    case $GET_LOCAL:
+      fprintf(out, "AOT_GET_LOCAL(%d);\n", ip[1]);
+      break;
+    case $SET_LOCAL:
+      fprintf(out, "AOT_SET_LOCAL(%d);\n", ip[1]);
+      break;
+    case $SET_LOCAL_POP:
+      fprintf(out, "AOT_SET_LOCAL_POP(%d);\n", ip[1]);
+      break;
+    case $GET_UPVALUE:
+      fprintf(out, "AOT_GET_UPVALUE(%d);\n", ip[1]);
+      break;
+    case $SET_UPVALUE:
+      fprintf(out, "AOT_SET_UPVALUE(%d);\n", ip[1]);
+      break;
+    case $POP:
+      fprintf(out, "AOT_POP();\n");
+      break;
+    case $POP_N:
+      fprintf(out, "AOT_POP_N(%d);\n", ip[1]);
+      break;
+    case $ADD:
+    case $SUBTRACT:
+    case $MULTIPLY:
+    case $DIVIDE:
+      fprintf(
+          out,
+          "AOT_ARITHMETIC(%s, %s, %d);\n",
+          arithmetic_op(op),
+          opcode_name(op),
+          next);
+      break;
+    case $ADD_LOCALS:
+      fprintf(out, "AOT_GET_LOCAL(%d);\n  ", ip[1]);
+      fprintf(out, "AOT_GET_LOCAL(%d);\n  ", ip[2]);
+      fprintf(out, "AOT_ARITHMETIC(+, $ADD, %d);\n", next);
+      break;
+    case $ADD_CONST:
+    case $SUBTRACT_CONST:
+      emit_const(code->vpool.values, ip[1], out);
+      fprintf(
+          out,
+          op == $ADD_CONST ? "  AOT_ARITHMETIC(+, $ADD, %d);\n"
+                           : "  AOT_ARITHMETIC(-, $SUBTRACT, %d);\n",
+          next);
+      break;
+    case $LESS:
+    case $GREATER:
+    case $LESS_OR_EQ:
+    case $GREATER_OR_EQ:
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+      fprintf(
+          out,
+          "AOT_COMPARE(%s, %s, %d);\n",
+          arithmetic_op(op),
+          opcode_name(op),
+          next);
+      if (op >= $LESS_JMP) {
+        fprintf(out, "  AOT_JMP_FALSE_OR_POP(i%d);\n", target);
+      }
+      break;
+    case $EQ:
+    case $NOT_EQ:
+      fprintf(out, "AOT_EQUAL(%s);\n", op == $EQ ? "true" : "false");
+      break;
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+      fprintf(out, "AOT_EQUAL(%s);\n", op == $EQ_JMP ? "true" : "false");
+      fprintf(out, "  AOT_JMP_FALSE_OR_POP(i%d);\n", target);
+      break;
+    case $MOD:
+    case $POW:
+    case $BW_LSHIFT:
+    case $BW_RSHIFT:
+    case $BW_AND:
+    case $BW_OR:
+    case $BW_XOR:
+      fprintf(out, "AOT_BINARY(%s, %d);\n", opcode_name(op), next);
+      break;
+    case $NEGATE:
+      fprintf(out, "AOT_NEGATE(%d);\n", next);
+      break;
+    case $BW_INVERT:
+      fprintf(out, "AOT_UNARY($BW_INVERT, %d);\n", next);
+      break;
+    case $NOT:
+      fprintf(out, "AOT_NOT();\n");
+      break;
+    case $JMP:
+      fprintf(out, "AOT_JMP(i%d);\n", target);
+      break;
+    case $LOOP:
+#ifdef EVE_PROFILE
+      fprintf(out, "AOT_LOOP(i%d, %d);\n", target, i);
+#else
+      fprintf(out, "AOT_JMP(i%d);\n", target);
+#endif
+      break;
+    case $JMP_FALSE:
+      fprintf(out, "AOT_JMP_FALSE(i%d);\n", target);
+      break;
+    case $JMP_FALSE_OR_POP:
+      fprintf(out, "AOT_JMP_FALSE_OR_POP(i%d);\n", target);
+      break;
+    case $DEFINE_GLOBAL:
+      fprintf(out, "AOT_DEFINE_GLOBAL(%d, %d);\n", ip[1], next);
+      break;
+    case $GET_GLOBAL:
+      fprintf(out, "AOT_GET_GLOBAL(%d, %d);\n", ip[1], next);
+      break;
+    case $SET_GLOBAL:
+      fprintf(out, "AOT_SET_GLOBAL(%d, %d);\n", ip[1], next);
+      break;
+    case $GET_FIELD:
+    case $GET_PROPERTY:
+      fprintf(
+          out,
+          "%s(%d, %d, %d);\n",
+          op == $GET_FIELD ? "AOT_GET_FIELD" : "AOT_GET_PROPERTY",
+          ip[1],
+          (ip[2] << 8) | ip[3],
+          next);
+      break;
+    case $SET_PROPERTY:
+      fprintf(out, "AOT_SET_PROPERTY(%d, %d);\n", ip[1], next);
+      break;
+    case $LEN:
+    case $TYPEOF:
+      fprintf(
+          out,
+          "AOT_INTRINSIC(%d, %d, %d, %d);\n",
+          ip[1],
+          ip[2],
+          i,
+          next);
+      break;
+    case $ITER_PREP:
+      fprintf(out, "AOT_ITER_PREP(%d, %d);\n", i, next);
+      break;
+    case $FOR_ITER:
+      fprintf(out, "AOT_FOR_ITER(i%d, %d, %d);\n", target, i, next);
+      break;
+    case $SUBSCRIPT:
+      fprintf(out, "AOT_SUBSCRIPT(%d);\n", next);
+      break;
+    case $SET_SUBSCRIPT:
+      fprintf(out, "AOT_SET_SUBSCRIPT(%d);\n", next);
+      break;
+    case $BUILD_LIST:
+      fprintf(out, "AOT_BUILD_LIST(%d, %d);\n", ip[1], next);
+      break;
+    case $BUILD_MAP:
+      fprintf(out, "AOT_BUILD_MAP(%d, %d);\n", ip[1], next);
+      break;
+    case $BUILD_INSTANCE:
+      fprintf(out, "AOT_BUILD_INSTANCE(%d, %d);\n", ip[1], next);
+      break;
+    case $BUILD_STRUCT:
+      fprintf(out, "AOT_BUILD_STRUCT(%d, %d, %d);\n", ip[1], ip[2], next);
+      break;
+    case $BUILD_CLOSURE:
+      fprintf(out, "AOT_BUILD_CLOSURE(%d, %d, %d);\n", ip[1], i, next);
+      break;
+    case $DISPLAY:
+      fprintf(out, "AOT_DISPLAY(%d, %d);\n", ip[1], next);
+      break;
+    case $ASSERT:
+      fprintf(out, "AOT_ASSERT(%d);\n", next);
+      break;
+    case $THROW:
+      fprintf(out, "AOT_THROW(%d);\n", next);
+      break;
+    case $CLOSE_UPVALUE:
+      fprintf(out, "AOT_CLOSE_UPVALUE(%d);\n", next);
+      break;
+    case $CALL:
+      fprintf(out, "AOT_CALL(%d, %d);\n", ip[1], next);
+      break;
+    case $RET_LOCAL:
+      fprintf(out, "AOT_RET_LOCAL(%d, %d);\n", ip[1], next);
+      break;
+    case $RET:
+      fprintf(out, "AOT_RET(%d);\n", next);
+      break;
+    default:
+      // $TAIL_CALL replaces the frame's function, left to run()
+      fprintf(out, "AOT_LEAVE(%d);\n", i);
+      break;
+  }
+}
+
+static void emit_fn(ObjFn* fn, int index, FILE* out) {
+  Code* code = &fn->code;
+  fprintf(out, "\n// %s\nstatic int f%d(VM* vm) {\n", get_func_name(fn), index);
+  fprintf(out, "  AOT_ENTER();\n  switch (AOT_OFFSET()) {\n");
+  for (int i = 0; i < code->length; i += inst_length(code, i)) {
+    fprintf(out, "    case %d:\n      goto i%d;\n", i, i);
+  }
+  fprintf(out, "    default:\n      return JIT_EXIT;\n  }\n");
+  for (int i = 0; i < code->length; i += inst_length(code, i)) {
+    emit_inst(code, i, out);
+  }
+  fprintf(out, "}\n");
+}
+
+static void emit_fns(ObjFn* fn, int* count, FILE* out) {
+  // the function, then those in its constants, which is also the order
+  // attach() finds them in
+  int index = (*count)++;
+  if (!has_wide(&fn->code)) {
+    emit_fn(fn, index, out);
+  }
+  Value* consts = fn->code.vpool.values;
+  for (int i = 0; i < fn->code.vpool.length; i++) {
+    if (IS_FUNC(consts[i])) {
+      emit_fns(AS_FUNC(consts[i]), count, out);
+    }
+  }
+}
+
+static void emit_table(ObjFn* fn, int* count, FILE* out) {
+  int index = (*count)++;
+  if (has_wide(&fn->code)) {
+    fprintf(out, "\n    NULL,");
+  } else {
+    fprintf(out, "\n    f%d,", index);
+  }
+  Value* consts = fn->code.vpool.values;
+  for (int i = 0; i < fn->code.vpool.length; i++) {
+    if (IS_FUNC(consts[i])) {
+      emit_table(AS_FUNC(consts[i]), count, out);
+    }
+  }
+}
+
+bool emit_c(VM* vm, ObjFn* script, FILE* out) {
+  FILE* eco = tmpfile();
+  if (!eco) {
+    fputs("Could not create a temporary file\n", stderr);
+    return false;
+  }
+  EveSerde serde;
+  init_serde(&serde, SD_SERIALIZE, vm, (error_cb)serde_error_cb);
+  serialize_file(&serde, eco, script);
+  free_serde(&serde);
+  rewind(eco);
+  fprintf(
+      out,
+      "// generated by eve --emit-c, link against libeve-runtime\n"
+      "#include \"aot.h\"\n\nstatic const byte_t eco[] = {");
+  for (int c, n = 0; (c = fgetc(eco)) != EOF; n++) {
+    fprintf(out, n % 12 ? " 0x%02x," : "\n    0x%02x,", c);
+  }
+  fprintf(out, "\n};\n");
+  fclose(eco);
+  int count = 0;
+  emit_fns(script, &count, out);
+  fprintf(out, "\nstatic const AotFn fns[] = {");
+  count = 0;
+  emit_table(script, &count, out);
+  fprintf(
+      out,
+      "\n};\n\nint main(void) {\n"
+      "  return aot_main(eco, sizeof(eco), fns, %d);\n}\n",
+      count);
+  return true;
+}
+
+static void attach(ObjFn* fn, const AotFn* fns, int count, int* index) {
+  if (*index < count) {
+    fn->jit.aot = fns[*index];
+  }
+  (*index)++;
+  Value* consts = fn->code.vpool.values;
+  for (int i = 0; i < fn->code.vpool.length; i++) {
+    if (IS_FUNC(consts[i])) {
+      attach(AS_FUNC(consts[i]), fns, count, index);
+    }
+  }
+}
+
+int aot_main(const byte_t* eco, size_t size, const AotFn* fns, int count) {
+  // run a script built from --emit-c: its functions as deserialized, each
+  // running its C function from `fns`
+  VM vm = new_vm();
+  vm.jit_threshold = JIT_AOT;
+  FILE* file = tmpfile();
+  if (!file || fwrite(eco, 1, size, file) != size) {
+    fputs("Could not load the program\n", stderr);
+    if (file) {
+      fclose(file);
+    }
+    free_vm(&vm);
+    return RESULT_COMPILE_ERROR;
+  }
+  rewind(file);
+  EveSerde serde;
+  init_serde(&serde, SD_DESERIALIZE, &vm, (error_cb)serde_error_cb);
+  ObjFn* script = deserialize_file(&serde, file);
+  free_serde(&serde);
+  fclose(file);
+  int index = 0;
+  if (script) {
+    attach(script, fns, count, &index);
+  }
+  if (index != count) {
+    fputs("The program doesn't match its compiled functions\n", stderr);
+    free_vm(&vm);
+    return RESULT_COMPILE_ERROR;
+  }
+  // like a script compiled here (see execute_eco() in main.c)
+  Compiler compiler;
+  new_compiler(&compiler, NULL, script, &vm, NULL);
+  free_compiler(&compiler);
+  boot_vm(&vm, script);
+  IResult ret = vm_run(&vm);
+  free_vm(&vm);
+  return ret;
+}
@@ -0,0 +1,221 @@
+#ifndef EVE_AOT_H
+#define EVE_AOT_H
+#include "jit.h"
+#include "profile.h"
+
+/*
+ * --emit-c: a compiled script as a C translation unit, linked against the
+ * runtime (libeve-runtime). every function with its nested ones becomes a C
+ * function over the VM, built from the templates below one instruction at a
+ * time; the unit also carries the script serialized (see serde.c) for its
+ * constants, and its main() hands both to aot_main(). a function runs its
+ * frame like the JIT's machine code does (see jit.c): from the frame's ip,
+ * on the same value stack, with the slow paths in vm.c, until it returns or
+ * leaves for run(). functions with $WIDE code are left to run().
+ */
+
+bool emit_c(VM* vm, ObjFn* script, FILE* out);
+int aot_main(const byte_t* eco, size_t size, const AotFn* fns, int count);
+
+// the state of the running frame. `_next` is the offset of the next
+// instruction, where a slow path leaves the frame's ip, and instructions are
+// labelled `i<offset>`
+#define AOT_ENTER() \
+  CallFrame* frame = vm->fp; \
+  Value* slots = frame->stack; \
+  Value* sp = vm->sp; \
+  Code* code = &frame->closure->func->code; \
+  Value* consts = code->vpool.values; \
+  InlineCache* caches = code->caches; \
+  (void)slots, (void)consts, (void)caches
+#define AOT_OFFSET() ((int)(frame->ip - code->bytes))
+#define AOT_SYNC(_next) (vm->sp = sp, frame->ip = code->bytes + (_next))
+#define AOT_SLOW(_next, _call) \
+  do { \
+    AOT_SYNC(_next); \
+    if (!(_call)) { \
+      return JIT_ERROR; \
+    } \
+    sp = vm->sp; \
+  } while (0)
+#define AOT_SLOW_VOID(_next, _call) \
+  do { \
+    AOT_SYNC(_next); \
+    _call; \
+    sp = vm->sp; \
+  } while (0)
+#define AOT_FALSY(_val) \
+  ((_val) == FALSE_VAL || ((_val) != TRUE_VAL && jit_falsy(_val)))
+#define AOT_BOTH_NUMBERS() (IS_NUMBER(sp[-2]) && IS_NUMBER(sp[-1]))
+
+#define AOT_PUSH(_val) (*sp++ = (_val))
+#define AOT_LOAD_VALUE(_bits) AOT_PUSH((Value)(_bits))
+#define AOT_LOAD_CONST(_k) AOT_PUSH(consts[_k])
+#define AOT_GET_LOCAL(_a) AOT_PUSH(slots[_a])
+#define AOT_SET_LOCAL(_a) (slots[_a] = sp[-1])
+#define AOT_SET_LOCAL_POP(_a) (slots[_a] = *--sp)
+#define AOT_GET_UPVALUE(_u) AOT_PUSH(*frame->closure->env[_u]->location)
+#define AOT_SET_UPVALUE(_u) (*frame->closure->env[_u]->location = sp[-1])
+#define AOT_POP() (sp--)
+#define AOT_POP_N(_n) (sp -= (_n))
+
+#define AOT_ARITHMETIC(_op, _opcode, _next) \
+  do { \
+    if (AOT_BOTH_NUMBERS()) { \
+      sp[-2] = NUMBER_VAL(AS_NUMBER(sp[-2]) _op AS_NUMBER(sp[-1])); \
+      sp--; \
+    } else { \
+      AOT_SLOW(_next, jit_binary(vm, _opcode)); \
+    } \
+  } while (0)
+#define AOT_COMPARE(_op, _opcode, _next) \
+  do { \
+    if (AOT_BOTH_NUMBERS()) { \
+      sp[-2] = BOOL_VAL(AS_NUMBER(sp[-2]) _op AS_NUMBER(sp[-1])); \
+      sp--; \
+    } else { \
+      AOT_SLOW(_next, jit_binary(vm, _opcode)); \
+    } \
+  } while (0)
+#define AOT_EQUAL(_equal) \
+  do { \
+    sp[-2] = BOOL_VAL(value_equal(sp[-2], sp[-1]) == (_equal)); \
+    sp--; \
+  } while (0)
+#define AOT_BINARY(_opcode, _next) AOT_SLOW(_next, jit_binary(vm, _opcode))
+#define AOT_NEGATE(_next) \
+  do { \
+    if (IS_NUMBER(sp[-1])) { \
+      sp[-1] = NUMBER_VAL(-AS_NUMBER(sp[-1])); \
+    } else { \
+      AOT_SLOW(_next, jit_unary(vm, $NEGATE)); \
+    } \
+  } while (0)
+#define AOT_UNARY(_opcode, _next) AOT_SLOW(_next, jit_unary(vm, _opcode))
+#define AOT_NOT() (sp[-1] = BOOL_VAL(AOT_FALSY(sp[-1])))
+
+#define AOT_JMP(_label) goto _label
+// a $LOOP at `_at` counting its back edges, from a runtime with EVE_PROFILE
+#define AOT_LOOP(_label, _at) \
+  do { \
+    (*back_edges(frame->closure->func, (_at)))++; \
+    goto _label; \
+  } while (0)
+#define AOT_JMP_FALSE(_label) \
+  do { \
+    if (AOT_FALSY(sp[-1])) { \
+      goto _label; \
+    } \
+  } while (0)
+#define AOT_JMP_FALSE_OR_POP(_label) \
+  do { \
+    if (AOT_FALSY(sp[-1])) { \
+      goto _label; \
+    } \
+    sp--; \
+  } while (0)
+
+// globals by their slot in the module, undefined while NOTHING_VAL
+#define AOT_GLOBAL(_g) (vm->current_module->globals.values[_g])
+#define AOT_DEFINE_GLOBAL(_g, _next) (AOT_GLOBAL(_g) = *--sp)
+#define AOT_GET_GLOBAL(_g, _next) \
+  do { \
+    if (AOT_GLOBAL(_g) != NOTHING_VAL) { \
+      AOT_PUSH(AOT_GLOBAL(_g)); \
+    } else { \
+      AOT_SLOW(_next, jit_get_global(vm, _g)); \
+    } \
+  } while (0)
+#define AOT_SET_GLOBAL(_g, _next) \
+  do { \
+    if (AOT_GLOBAL(_g) != NOTHING_VAL) { \
+      AOT_GLOBAL(_g) = sp[-1]; \
+    } else { \
+      AOT_SLOW(_next, jit_set_global(vm, _g)); \
+    } \
+  } while (0)
+#define AOT_GET_FIELD(_k, _ic, _next) \
+  AOT_SLOW(_next, jit_get_field(vm, consts[_k], &caches[_ic]))
+#define AOT_GET_PROPERTY(_k, _ic, _next) \
+  AOT_SLOW(_next, jit_get_property(vm, consts[_k], &caches[_ic]))
+#define AOT_SET_PROPERTY(_k, _next) \
+  AOT_SLOW(_next, jit_set_property(vm, consts[_k]))
+// a $LEN or $TYPEOF at `_at`, whose call run() makes if `core` is shadowed
+#define AOT_INTRINSIC(_g, _index, _at, _next) \
+  do { \
+    if (AOT_GLOBAL(_g) != OBJ_VAL(vm->builtins)) { \
+      AOT_LEAVE(_at); \
+    } \
+    AOT_SLOW(_next, jit_intrinsic(vm, _index)); \
+  } while (0)
+// a `for` loop's instructions at `_at`, which leave iterables other than
+// lists, strings, hashmaps and iterators to run()
+#define AOT_ITER_PREP(_at, _next) \
+  do { \
+    AOT_SYNC(_next); \
+    if (!jit_iter_prep(vm)) { \
+      AOT_LEAVE(_at); \
+    } \
+    sp = vm->sp; \
+  } while (0)
+#define AOT_FOR_ITER(_label, _at, _next) \
+  do { \
+    AOT_SYNC(_next); \
+    int _status = jit_for_iter(vm); \
+    if (_status == -1) { \
+      AOT_LEAVE(_at); \
+    } \
+    sp = vm->sp; \
+    if (!_status) { \
+      goto _label; \
+    } \
+  } while (0)
+#define AOT_SUBSCRIPT(_next) AOT_SLOW(_next, jit_subscript(vm))
+#define AOT_SET_SUBSCRIPT(_next) AOT_SLOW(_next, jit_set_subscript(vm))
+#define AOT_BUILD_LIST(_n, _next) AOT_SLOW_VOID(_next, jit_build_list(vm, _n))
+#define AOT_BUILD_MAP(_n, _next) AOT_SLOW_VOID(_next, jit_build_map(vm, _n))
+#define AOT_BUILD_INSTANCE(_n, _next) \
+  AOT_SLOW(_next, jit_build_instance(vm, _n))
+#define AOT_BUILD_STRUCT(_k, _n, _next) \
+  AOT_SLOW(_next, jit_build_struct(vm, AS_STRING(consts[_k]), _n))
+// the closure's upvalue operands follow its constant at `_at`
+#define AOT_BUILD_CLOSURE(_k, _at, _next) \
+  AOT_SLOW_VOID( \
+      _next, \
+      jit_build_closure(vm, AS_FUNC(consts[_k]), code->bytes + (_at) + 2))
+#define AOT_DISPLAY(_n, _next) AOT_SLOW_VOID(_next, jit_display(vm, _n))
+#define AOT_ASSERT(_next) AOT_SLOW(_next, jit_assert(vm))
+#define AOT_THROW(_next) AOT_SLOW(_next, jit_throw(vm))
+#define AOT_CLOSE_UPVALUE(_next) AOT_SLOW_VOID(_next, jit_close_upvalue(vm))
+
+// a call returns here when the callee ran compiled; the frame's stack may
+// have moved meanwhile
+#define AOT_CALL(_argc, _next) \
+  do { \
+    AOT_SYNC(_next); \
+    JitStatus _status = jit_call(vm, (_argc)); \
+    if (_status != JIT_RETURN) { \
+      return _status == JIT_ERROR ? JIT_ERROR : JIT_EXIT; \
+    } \
+    frame = vm->fp; \
+    slots = frame->stack; \
+    sp = vm->sp; \
+  } while (0)
+#define AOT_RET(_next) \
+  do { \
+    AOT_SYNC(_next); \
+    return jit_return(vm) ? JIT_RETURN : JIT_DONE; \
+  } while (0)
+#define AOT_RET_LOCAL(_a, _next) \
+  do { \
+    AOT_PUSH(slots[_a]); \
+    AOT_RET(_next); \
+  } while (0)
+// leave the frame to run() at the instruction at `_at`
+#define AOT_LEAVE(_at) \
+  do { \
+    vm->sp = sp; \
+    frame->ip = code->bytes + (_at); \
+    return JIT_EXIT; \
+  } while (0)
+#endif  //EVE_AOT_H
@@ -1,7 +1,6 @@
 #include "ast.h"
 
-AstNode __node = (AstNode) {
-    .num = (NumberNode) {.type = AST_ERROR, .line = -1, .value = 0}};
+AstNode __node = {.num = {.type = AST_ERROR, .line = -1, .value = 0}};
 AstNode* error_node = &__node;
 
 void init_store(NodeStore* store) {
@@ -53,7 +53,6 @@ typedef enum {
   AST_IF_STMT,
   AST_WHILE_STMT,
   AST_FOR_STMT,
-  AST_LOOP,
   AST_CONTROL_STMT,
   AST_RETURN_STMT,
   AST_VAR_DECL,
@@ -179,7 +178,7 @@ typedef struct {
 typedef struct {
   AstTy type;
   int line;
-  AstNode* condition;
+  AstNode* condition;  // NULL if it's always true (see fold.c)
   AstNode* block;
 } WhileStmtNode;
 
@@ -187,9 +186,9 @@ typedef struct {
   AstTy type;
   int line;
   AstNode* elem;
-  AstNode* iterable;
+  AstNode* iterable;  // or the start of a range
+  AstNode* stop;  // of the range, NULL if it isn't one
   AstNode* block;
-  AstNode* desugar;
 } ForStmtNode;
 
 typedef struct {
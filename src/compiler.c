@@ -2,6 +2,8 @@
 #pragma ide diagnostic ignored "misc-no-recursion"
 #include "compiler.h"
 
+#include "core.h"
+#include "fold.h"
 #include "gen.h"
 #include "vm.h"
 
@@ -54,8 +56,15 @@ void new_compiler(
       .scope = 0,
       .free_vars = 0,
       .locals_count = 0,
+      .locals_capacity = 0,
       .controls_count = 0,
       .upvalues_count = 0,
+      .upvalues_capacity = 0,
+      .far_count = 0,
+      .far_capacity = 0,
+      .locals = NULL,
+      .upvalues = NULL,
+      .far_jumps = NULL,
       .errors = 0,
       .current_loop = {.scope = 0},
       .enclosing = NULL};
@@ -75,6 +84,29 @@ void new_compiler(
   reserve_local(compiler);
 }
 
+void free_compiler(Compiler* compiler) {
+  FREE_BUFFER(
+      compiler->vm,
+      compiler->locals,
+      LocalVar,
+      compiler->locals_capacity);
+  FREE_BUFFER(
+      compiler->vm,
+      compiler->upvalues,
+      Upvalue,
+      compiler->upvalues_capacity);
+  FREE_BUFFER(
+      compiler->vm,
+      compiler->far_jumps,
+      FarJump,
+      compiler->far_capacity);
+  compiler->locals = NULL;
+  compiler->upvalues = NULL;
+  compiler->far_jumps = NULL;
+  compiler->locals_capacity = compiler->upvalues_capacity = 0;
+  compiler->far_capacity = compiler->far_count = 0;
+}
+
 void compile_error(Compiler* compiler, char* fmt, ...) {
   if (compiler->errors >= 1) {
     fputc('\n', stderr);
@@ -98,21 +130,65 @@ static int store_variable(Compiler* compiler, VarNode* var) {
       var->name,
       var->len,
       false);
-  int slot = write_value(&compiler->func->code.vpool, val, compiler->vm);
-  if (slot >= CONST_MAX) {
+  int slot = add_constant(compiler, val);
+  if (slot > UINT16_MAX) {
     compile_error(compiler, "Too many constants");
   }
   return slot;
 }
 
 static void load_variable(Compiler* compiler, VarNode* var, byte_t op) {
-  byte_t slot = store_variable(compiler, var);
-  emit_byte(compiler, op, var->line);
-  emit_byte(compiler, slot, var->line);
+  int slot = store_variable(compiler, var);
+  emit_op(compiler, op, slot, var->line);
+  if (op == $GET_FIELD || op == $GET_PROPERTY) {
+    emit_cache(compiler, slot > UINT8_MAX, var->line);
+  }
+}
+
+static int global_slot(Compiler* compiler, VarNode* var) {
+  // globals are resolved here, to their slot in the module (see
+  // module_slot()), defined or not: whether they are is known at run time
+  ObjString* name = create_string(
+      compiler->vm,
+      &compiler->vm->strings,
+      var->name,
+      var->len,
+      false);
+  int slot = module_slot(compiler->vm, compiler->module, name);
+  if (slot > UINT16_MAX) {
+    compile_error(compiler, "Too many globals");
+  }
+  return slot;
+}
+
+static void load_global(Compiler* compiler, VarNode* var, byte_t op) {
+  emit_op(compiler, op, global_slot(compiler, var), var->line);
+}
+
+static LocalVar* new_local(Compiler* compiler) {
+  if (compiler->locals_count == compiler->locals_capacity) {
+    int capacity = GROW_CAPACITY(compiler->locals_capacity);
+    compiler->locals = GROW_BUFFER(
+        compiler->vm,
+        compiler->locals,
+        LocalVar,
+        compiler->locals_capacity,
+        capacity);
+    compiler->locals_capacity = capacity;
+  }
+  if (compiler->locals_count == LOCALS_MAX) {
+    compile_error(
+        compiler,
+        "Too many local variables. Max allowed is: %d",
+        LOCALS_MAX);
+    // keep compiling into the last slot, the code is discarded anyway
+    compiler->locals_count--;
+  }
+  return &compiler->locals[compiler->locals_count++];
 }
 
 inline static void reserve_local(Compiler* compiler) {
-  LocalVar* local_var = &compiler->locals[compiler->locals_count++];
+  LocalVar* local_var = new_local(compiler);
   local_var->name_len = 0;
   local_var->name = "";
   local_var->initialized = false;
@@ -120,7 +196,7 @@ inline static void reserve_local(Compiler* compiler) {
 }
 
 inline static int add_lvar(Compiler* compiler, VarNode* node) {
-  LocalVar* var = &compiler->locals[compiler->locals_count++];
+  LocalVar* var = new_local(compiler);
   var->scope = compiler->scope;
   var->name = node->name;
   var->name_len = node->len;
@@ -131,11 +207,11 @@ inline static int add_lvar(Compiler* compiler, VarNode* node) {
 
 inline static int
 add_upvalue(Compiler* compiler, int index, bool is_local) {
-  if (compiler->upvalues_count >= CONST_MAX) {
+  if (compiler->upvalues_count >= UPVALUES_MAX) {
     compile_error(
         compiler,
         "Too many closure captures. Max allowed is: %d",
-        CONST_MAX);
+        UPVALUES_MAX);
     return -1;
   }
   Upvalue* upvalue;
@@ -146,6 +222,16 @@ add_upvalue(Compiler* compiler, int index, bool is_local) {
       return i;
     }
   }
+  if (compiler->upvalues_count == compiler->upvalues_capacity) {
+    int capacity = GROW_CAPACITY(compiler->upvalues_capacity);
+    compiler->upvalues = GROW_BUFFER(
+        compiler->vm,
+        compiler->upvalues,
+        Upvalue,
+        compiler->upvalues_capacity,
+        capacity);
+    compiler->upvalues_capacity = capacity;
+  }
   compiler->upvalues[compiler->upvalues_count] =
       (Upvalue) {.index = index, .is_local = is_local};
   return compiler->upvalues_count++;
@@ -383,13 +469,11 @@ void c_var(Compiler* compiler, AstNode* node) {
           lvar->name_len,
           lvar->name);
     }
-    emit_byte(compiler, $GET_LOCAL, var->line);
-    emit_byte(compiler, (byte_t)index, var->line);
+    emit_op(compiler, $GET_LOCAL, index, var->line);
   } else if ((index = find_upvalue(compiler, var)) != -1) {
-    emit_byte(compiler, $GET_UPVALUE, var->line);
-    emit_byte(compiler, (byte_t)index, var->line);
+    emit_op(compiler, $GET_UPVALUE, index, var->line);
   } else {
-    load_variable(compiler, var, $GET_GLOBAL);
+    load_global(compiler, var, $GET_GLOBAL);
   }
 }
 
@@ -397,14 +481,12 @@ void c_var_assign(Compiler* compiler, BinaryNode* assign) {
   c_(compiler, assign->r_node);
   int slot = find_lvar(compiler, &assign->l_node->var);
   if (slot != -1) {
-    emit_byte(compiler, $SET_LOCAL, assign->line);
-    emit_byte(compiler, (byte_t)slot, assign->line);
+    emit_op(compiler, $SET_LOCAL, slot, assign->line);
   } else if ((slot = find_upvalue(compiler, &assign->l_node->var)) != -1) {
-    emit_byte(compiler, $SET_UPVALUE, assign->line);
-    emit_byte(compiler, (byte_t)slot, assign->line);
+    emit_op(compiler, $SET_UPVALUE, slot, assign->line);
   } else {
     // globals
-    load_variable(compiler, &assign->l_node->var, $SET_GLOBAL);
+    load_global(compiler, &assign->l_node->var, $SET_GLOBAL);
   }
 }
 
@@ -416,14 +498,11 @@ void c_subscript_assign(Compiler* compiler, BinaryNode* assign) {
 }
 
 void c_dot_assign(Compiler* compiler, BinaryNode* assign) {
+  // expr.var = value, compiled like c_dcol_dot() but ending in $SET_PROPERTY
+  BinaryNode* dot = &assign->l_node->binary;
   c_(compiler, assign->r_node);
-  // change the ast node type from DOT_EXPR to BINARY, so that it invokes
-  // c_binary() and in turn invokes c_dcol_dot()
-  assign->l_node->num.type = AST_BINARY;
-  c_(compiler, assign->l_node);
-  // now rewrite $GET_PROPERTY emitted by c_dcol_dot() to $SET_PROPERTY
-  compiler->func->code.bytes[compiler->func->code.length - 2] =
-      $SET_PROPERTY;
+  c_(compiler, dot->l_node);
+  load_variable(compiler, &dot->r_node->var, $SET_PROPERTY);
 }
 
 void c_assign(Compiler* compiler, AstNode* node) {
@@ -447,7 +526,7 @@ void c_var_decl(Compiler* compiler, AstNode* node) {
     compiler->locals[index].initialized = true;
   } else {
     c_(compiler, decl->r_node);
-    load_variable(compiler, &decl->l_node->var, $DEFINE_GLOBAL);
+    load_global(compiler, &decl->l_node->var, $DEFINE_GLOBAL);
   }
 }
 
@@ -487,17 +566,13 @@ void c_control(
     int break_exit) {
   Code* code = &compiler->func->code;
   int slot = node->patch_slot;
-  int offset;
   if (node->is_break) {
-    offset = (break_exit - slot - 3);
     code->bytes[slot] = $JMP;
-    code->bytes[slot + 1] = (offset >> 8) & 0xff;
-    code->bytes[slot + 2] = offset & 0xff;
+    set_jump(compiler, slot, break_exit);
   } else {
-    offset = (slot - continue_exit + 3);
-    code->bytes[slot] = $LOOP;
-    code->bytes[slot + 1] = (offset >> 8) & 0xff;
-    code->bytes[slot + 2] = offset & 0xff;
+    // a counting loop continues forward, at its increment
+    code->bytes[slot] = continue_exit > slot ? $JMP : $LOOP;
+    set_jump(compiler, slot, continue_exit);
   }
 }
 
@@ -536,6 +611,14 @@ void c_while_stmt(Compiler* compiler, AstNode* node) {
   LoopVar curr = compiler->current_loop;
   compiler->current_loop = (LoopVar) {.scope = compiler->scope};
   int continue_exit = compiler->func->code.length;
+  if (!wh_node->condition) {
+    // while true, see fold_constants(): only break leaves the loop
+    c_(compiler, wh_node->block);
+    emit_loop(compiler, continue_exit, last_line(compiler));
+    process_loop_control(compiler, continue_exit, compiler->func->code.length);
+    compiler->current_loop = curr;
+    return;
+  }
   c_(compiler, wh_node->condition);
   int end_slot = emit_jump(compiler, $JMP_FALSE_OR_POP, wh_node->line);
   c_(compiler, wh_node->block);
@@ -548,18 +631,58 @@ void c_while_stmt(Compiler* compiler, AstNode* node) {
   compiler->current_loop = curr;
 }
 
-void c_loop(Compiler* compiler, AstNode* node) {
-  WhileStmtNode* wh_node = CAST(WhileStmtNode*, node);
+static void c_range_loop(Compiler* compiler, ForStmtNode* for_node) {
+  /*
+   * for let elem in start..stop {}
+   * |
+   * `
+   *         <start>                -> counter
+   *         <stop>                 -> stop
+   * head:   $LESS_JMP exit           (counter < stop)
+   *         <block>                  (elem = counter)
+   * next:   counter += 1             (where `continue` goes)
+   *         $LOOP head
+   * exit:
+   *
+   * the counter lives in a local slot, so no range or iterator is ever
+   * made; the comparison throws if either bound isn't a number.
+   */
+  Code* code = &compiler->func->code;
+  int line = for_node->line;
+  compiler->scope++;
+  VarNode hidden = {.type = AST_VAR, .line = line, .len = 1, .name = "$"};
+  c_(compiler, for_node->iterable);
+  int counter = init_lvar(compiler, &hidden);
+  c_(compiler, for_node->stop);
+  int stop = init_lvar(compiler, &hidden);
   LoopVar curr = compiler->current_loop;
   compiler->current_loop = (LoopVar) {.scope = compiler->scope};
-  int continue_exit = compiler->func->code.length;
-  c_(compiler, wh_node->block);
-  emit_loop(compiler, continue_exit, last_line(compiler));
-  // pop loop condition off the stack
-  emit_byte(compiler, $POP, last_line(compiler));
-  int break_exit = compiler->func->code.length;
-  process_loop_control(compiler, continue_exit, break_exit);
+  int head = code->length;
+  emit_op(compiler, $GET_LOCAL, counter, line);
+  emit_op(compiler, $GET_LOCAL, stop, line);
+  emit_byte(compiler, $LESS, line);
+  int exit_slot = emit_jump(compiler, $JMP_FALSE_OR_POP, line);
+  compiler->scope++;
+  emit_op(compiler, $GET_LOCAL, counter, line);
+  init_lvar(compiler, &for_node->elem->var);
+  c_block(compiler, for_node->block);
+  compiler->scope--;
+  int end_line = last_line(compiler);
+  pop_locals(compiler, end_line);
+  int continue_exit = code->length;
+  emit_op(compiler, $GET_LOCAL, counter, end_line);
+  emit_value(compiler, $LOAD_CONST, NUMBER_VAL(1), end_line);
+  emit_byte(compiler, $ADD, end_line);
+  emit_op(compiler, $SET_LOCAL, counter, end_line);
+  emit_byte(compiler, $POP, end_line);
+  emit_loop(compiler, head, end_line);
+  patch_jump(compiler, exit_slot);
+  // pop the comparison off the stack
+  emit_byte(compiler, $POP, end_line);
+  process_loop_control(compiler, continue_exit, code->length);
   compiler->current_loop = curr;
+  compiler->scope--;
+  pop_locals(compiler, end_line);
 }
 
 void c_for_stmt(Compiler* compiler, AstNode* node) {
@@ -567,95 +690,79 @@ void c_for_stmt(Compiler* compiler, AstNode* node) {
    * for let elem in iterable {}
    * |
    * `
-   * {
-        let e_ = None;
-        let is_error = false;
-        let itr = core::iter(obj);
-        while true { -> loop {
-            let i = try core::next(itr) ? e_ else is_error = true;
-            if is_error {
-               if e_ == "StopIteration" {
-                   break;
-               } else {
-                   throw e_;
-               }
-            }
-            ## rest of code here...
-        }
-    }
+   *         <iterable>
+   *         $ITER_PREP             -> cursor, iterator
+   * head:   $FOR_ITER exit         -> elem
+   *         <block>
+   *         $LOOP head
+   * handler:                       -> error
+   *         if error != core::StopIteration { throw error; }
+   * exit:
+   *
+   * lists, strings, hashmaps and iterators are walked by $FOR_ITER itself.
+   * anything else goes through core::next(), which ends the loop by throwing
+   * core::StopIteration, so $FOR_ITER is covered by an exception table
+   * entry whose handler rethrows everything else.
    */
-#define BUFF_SIZE 0xf
-  char is_err[BUFF_SIZE], itr[BUFF_SIZE], err[BUFF_SIZE];
-  int is_err_len =
-      snprintf(is_err, BUFF_SIZE, "$is_err_%d", get_free_var(compiler));
-  int itr_len =
-      snprintf(itr, BUFF_SIZE, "$iter_%d", get_free_var(compiler));
-  int err_len = snprintf(err, BUFF_SIZE, "$err_%d", get_free_var(compiler));
-#undef BUFF_SIZE
-
   ForStmtNode* for_node = &node->for_stmt;
+  if (for_node->stop) {
+    c_range_loop(compiler, for_node);
+    return;
+  }
+  Code* code = &compiler->func->code;
   int line = for_node->line;
-  AstNode* desugar = for_node->desugar;
-  ASSERT(
-      desugar->num.type == AST_BLOCK_STMT,
-      "expected block stmt type as desugar");
-
   compiler->scope++;
-  BlockStmtNode* block = &desugar->block_stmt;
-  // 1. let e_ = None;
-  BinaryNode* stmt = &((AstNode*)block->stmts.items[0])->binary;
-  stmt->l_node->var.name = err;
-  stmt->l_node->var.len = err_len;
-  stmt->l_node->var.line = line;
-  AstNode* err_var = stmt->l_node;
-
-  // 2. let is_error = false;
-  stmt = &((AstNode*)block->stmts.items[1])->binary;
-  stmt->l_node->var.name = is_err;
-  stmt->l_node->var.len = is_err_len;
-  stmt->l_node->var.line = line;
-  AstNode* is_err_var = stmt->l_node;
-
-  // 2 let itr = core::iter(iterable);
-  stmt = &((AstNode*)block->stmts.items[2])->binary;
-  stmt->r_node->call.args[0] = for_node->iterable;
-  stmt->l_node->var.name = itr;
-  stmt->l_node->var.len = itr_len;
-  stmt->l_node->var.line = line;
-  AstNode* itr_var = stmt->l_node;
-
-  // 3
-  WhileStmtNode* wh = &((AstNode*)block->stmts.items[3])->while_stmt;
-  wh->type = AST_LOOP;
-  // let i = try core::next(itr) ? e_ else is_error = true;
-  stmt = &((AstNode*)(wh->block->block_stmt.stmts.items[0]))->binary;
-  stmt->l_node->var = for_node->elem->var;
-  stmt->r_node->try_h.try_expr->call.args[0] = itr_var;
-  stmt->r_node->try_h.try_var = err_var;
-  stmt->r_node->try_h.else_expr->binary.l_node = is_err_var;
-
-  // if is_error {
-  IfElseStmtNode* if_stmt =
-      &((AstNode*)(wh->block->block_stmt.stmts.items[1]))->ife_stmt;
-  if_stmt->condition = is_err_var;
-  if_stmt->line = line;
-  // inner if
-  if_stmt =
-      &((AstNode*)(if_stmt->if_block->block_stmt.stmts.items[0]))->ife_stmt;
-  // if e_ == "StopIteration" {
-  if_stmt->condition->binary.l_node = err_var;
-  // else { throw e_; }
-  ExprStmtNode* throw =
-      &((AstNode*)(if_stmt->else_block->block_stmt.stmts.items[0]))
-           ->expr_stmt;
-  throw->expr = err_var;
-
-  // save the rest of the block...
-  Vec* to = &wh->block->block_stmt.stmts;
-  Vec* from = &for_node->block->block_stmt.stmts;
-  vec_extend(to, from);
-  c_(compiler, desugar);
+  c_(compiler, for_node->iterable);
+  emit_byte(compiler, $ITER_PREP, line);
+  // the cursor and the iterator are locals no name refers to
+  VarNode hidden = {.type = AST_VAR, .line = line, .len = 1, .name = "$"};
+  init_lvar(compiler, &hidden);
+  init_lvar(compiler, &hidden);
+  LoopVar curr = compiler->current_loop;
+  compiler->current_loop = (LoopVar) {.scope = compiler->scope};
+  int continue_exit = code->length;
+  int exit_slot = emit_jump(compiler, $FOR_ITER, line);
+  Handler handler = {
+      .start = continue_exit,
+      .end = code->length,
+      .target = -1,
+      .depth = -1};
+  // the element, then the block's own scope
+  compiler->scope++;
+  init_lvar(compiler, &for_node->elem->var);
+  c_block(compiler, for_node->block);
+  compiler->scope--;
+  int end_line = last_line(compiler);
+  pop_locals(compiler, end_line);
+  emit_loop(compiler, continue_exit, end_line);
+  // the handler is entered with the error pushed, in the slot past the
+  // loop's locals
+  handler.target = code->length;
+  write_handler(code, handler, compiler->vm);
+  int error = compiler->locals_count;
+  AstNode core = {
+      .var = {.type = AST_VAR, .line = line, .len = 4, .name = "core"}};
+  VarNode stop = {
+      .type = AST_VAR,
+      .line = line,
+      .len = 13,
+      .name = "StopIteration"};
+  emit_op(compiler, $GET_LOCAL, error, line);
+  c_var(compiler, &core);
+  load_variable(compiler, &stop, $GET_FIELD);
+  emit_byte(compiler, $EQ, line);
+  int rethrow = emit_jump(compiler, $JMP_FALSE_OR_POP, line);
+  emit_byte(compiler, $POP, line);
+  int done = emit_jump(compiler, $JMP, line);
+  patch_jump(compiler, rethrow);
+  emit_byte(compiler, $POP, line);
+  emit_byte(compiler, $THROW, line);
+  patch_jump(compiler, done);
+  patch_jump(compiler, exit_slot);
+  process_loop_control(compiler, continue_exit, code->length);
+  compiler->current_loop = curr;
   compiler->scope--;
+  pop_locals(compiler, end_line);
 }
 
 void c_return(Compiler* compiler, AstNode* node) {
@@ -664,8 +771,57 @@ void c_return(Compiler* compiler, AstNode* node) {
   emit_byte(compiler, $RET, expr->line);
 }
 
+static bool c_intrinsic(Compiler* compiler, CallNode* call_node) {
+  /*
+   * core::<module>::<name>(x) (or core::<name>(x)) of a builtin that has an
+   * instruction, see core.h. `core` has to be a global here: the instruction
+   * checks that the global is still the builtin module when it runs, and
+   * makes the call otherwise. returns false for any other call.
+   */
+  AstNode* callee = call_node->left;
+  if (!compiler->vm->optimize || call_node->args_count != 1
+      || callee->num.type != AST_BINARY || callee->binary.op != OP_DCOL
+      || callee->binary.r_node->num.type != AST_VAR) {
+    return false;
+  }
+  VarNode* name = &callee->binary.r_node->var;
+  VarNode* module = NULL;
+  AstNode* core = callee->binary.l_node;
+  if (core->num.type == AST_BINARY && core->binary.op == OP_DCOL
+      && core->binary.r_node->num.type == AST_VAR) {
+    module = &core->binary.r_node->var;
+    core = core->binary.l_node;
+  }
+  if (core->num.type != AST_VAR || core->var.len != 4
+      || memcmp(core->var.name, "core", 4) != 0
+      || find_lvar(compiler, &core->var) != -1
+      || find_upvalue(compiler, &core->var) != -1) {
+    return false;
+  }
+  int index = find_intrinsic(
+      module ? module->name : NULL,
+      module ? module->len : 0,
+      name->name,
+      name->len);
+  if (index == -1) {
+    return false;
+  }
+  int slot = global_slot(compiler, &core->var);
+  if (slot > UINT8_MAX) {
+    return false;  // no $WIDE form
+  }
+  c_(compiler, call_node->args[0]);
+  emit_byte(compiler, intrinsics[index].op, call_node->line);
+  emit_byte(compiler, slot, call_node->line);
+  emit_byte(compiler, index, call_node->line);
+  return true;
+}
+
 void c_call(Compiler* compiler, AstNode* node) {
   CallNode* call_node = &node->call;
+  if (c_intrinsic(compiler, call_node)) {
+    return;
+  }
   c_(compiler, call_node->left);
   for (int i = 0; i < call_node->args_count; i++) {
     c_(compiler, call_node->args[i]);
@@ -691,7 +847,6 @@ void c_struct(Compiler* compiler, AstNode* node) {
    */
   StructMeta* meta;
   VarNode var;
-  byte_t slot;
   for (int i = 0; i < struct_n->field_count; i++) {
     meta = &struct_n->fields[i];
     // compile var
@@ -708,8 +863,15 @@ void c_struct(Compiler* compiler, AstNode* node) {
       emit_value(compiler, $LOAD_CONST, NOTHING_VAL, last_line(compiler));
     }
   }
-  load_variable(compiler, &struct_n->name->var, $BUILD_STRUCT);
-  emit_byte(compiler, (byte_t)struct_n->field_count, last_line(compiler));
+  int line = last_line(compiler);
+  int name = store_variable(compiler, &struct_n->name->var);
+  bool wide = name > UINT8_MAX || struct_n->field_count > UINT8_MAX;
+  if (wide) {
+    emit_byte(compiler, $WIDE, line);
+  }
+  emit_byte(compiler, $BUILD_STRUCT, line);
+  emit_operand(compiler, name, wide, line);
+  emit_operand(compiler, struct_n->field_count, wide, line);
 }
 
 void c_struct_call(Compiler* compiler, AstNode* node) {
@@ -727,26 +889,30 @@ void c_struct_call(Compiler* compiler, AstNode* node) {
 void c_try(Compiler* compiler, AstNode* node) {
   // try expr (? var)? (else expr)?
   TryNode* try_node = CAST(TryNode*, node);
-  // push try handler (we're using emit_jump since it allows creation of a byte-code
-  // and slot reservation for its 2-byte operand)
-  int try_slot = emit_jump(compiler, $SET_TRY, try_node->line);
+  Code* code = &compiler->func->code;
+  // the expression's code is covered by an entry in the exception table,
+  // which costs nothing unless it errs (see runtime_error())
+  int start = code->length;
   c_(compiler, try_node->try_expr);
-  // pop try handler if operation never erred
-  emit_byte(compiler, $TEAR_TRY, last_line(compiler));
+  int end = code->length;
   // skip handler-expr if operation never erred
   int else_end = emit_jump(compiler, $JMP, last_line(compiler));
-  patch_jump(compiler, try_slot);
+  // its depth is only known once the code is final, see stack_size()
+  Handler handler = {
+      .start = start,
+      .end = end,
+      .target = code->length,
+      .depth = -1};
+  write_handler(code, handler, compiler->vm);
   if (try_node->try_var) {
     VarNode* var = &try_node->try_var->var;
     int slot = find_lvar(compiler, var);
     if (slot != -1) {
-      emit_byte(compiler, $SET_LOCAL, var->line);
-      emit_byte(compiler, (byte_t)slot, last_line(compiler));
+      emit_op(compiler, $SET_LOCAL, slot, var->line);
     } else if ((slot = find_upvalue(compiler, var)) != -1) {
-      emit_byte(compiler, $SET_UPVALUE, var->line);
-      emit_byte(compiler, (byte_t)slot, last_line(compiler));
+      emit_op(compiler, $SET_UPVALUE, slot, var->line);
     } else {
-      load_variable(compiler, var, $SET_GLOBAL);
+      load_global(compiler, var, $SET_GLOBAL);
     }
   }
   if (try_node->else_expr) {
@@ -774,23 +940,23 @@ void c_function(Compiler* compiler, AstNode* node) {
   if (emit_name) {
     // global function
     if (func->name) {
-      name_slot = store_variable(compiler, &func->name->var);
-      fn_obj->name =
-          AS_STRING(compiler->func->code.vpool.values[name_slot]);
+      name_slot = global_slot(compiler, &func->name->var);
     }
   } else {
     // local function
     // set as initialized for functions with recursive calls
     if (func->name) {
       init_lvar(compiler, &func->name->var);
-      fn_obj->name = create_string(
-          compiler->vm,
-          &compiler->vm->strings,
-          func->name->var.name,
-          func->name->var.len,
-          false);
     }
   }
+  if (func->name) {
+    fn_obj->name = create_string(
+        compiler->vm,
+        &compiler->vm->strings,
+        func->name->var.name,
+        func->name->var.len,
+        false);
+  }
   Compiler func_compiler;
   new_compiler(&func_compiler, node, fn_obj, compiler->vm, NULL);
   fn_obj->module = func_compiler.module = compiler->module;  // set module
@@ -804,20 +970,50 @@ void c_function(Compiler* compiler, AstNode* node) {
   // compile function body (use c_block() since no need to pop locals,
   // return does this automatically)
   c_block(&func_compiler, func->body);
+  if (!func_compiler.errors) {
+    widen_jumps(&func_compiler);
+  }
+  if (!func_compiler.errors && compiler->vm->optimize) {
+    peephole(&func_compiler);
+    fuse_code(&func_compiler);
+  }
+  init_caches(&fn_obj->code, compiler->vm);
   fn_obj->arity = func->params_count;
   fn_obj->env_len = func_compiler.upvalues_count;
-  emit_value(compiler, $BUILD_CLOSURE, OBJ_VAL(fn_obj), func->line);
-  // compile upvalues
+  if (!func_compiler.errors) {
+    fn_obj->max_stack =
+        stack_size(compiler->vm, &fn_obj->code, fn_obj->arity);
+  }
+  int fn_slot = write_value(
+      &compiler->func->code.vpool,
+      OBJ_VAL(fn_obj),
+      compiler->vm);
+  if (fn_slot > UINT16_MAX) {
+    compile_error(compiler, "Too many constants");
+    free_compiler(&func_compiler);
+    return;
+  }
+  // the closure and its upvalues share one operand width
   Upvalue* upvalue;
+  bool wide = fn_slot > UINT8_MAX;
+  for (int i = 0; i < func_compiler.upvalues_count; i++) {
+    wide |= func_compiler.upvalues[i].index > UINT8_MAX;
+  }
+  if (wide) {
+    emit_byte(compiler, $WIDE, func->line);
+  }
+  emit_byte(compiler, $BUILD_CLOSURE, func->line);
+  emit_operand(compiler, fn_slot, wide, func->line);
+  // compile upvalues
   for (int i = 0; i < func_compiler.upvalues_count; i++) {
     // emit upvalue-index, upvalue-is_local
     upvalue = &func_compiler.upvalues[i];
-    emit_byte(compiler, (byte_t)upvalue->index, last_line(compiler));
-    emit_byte(compiler, (byte_t)upvalue->is_local, last_line(compiler));
+    emit_operand(compiler, upvalue->index, wide, last_line(compiler));
+    emit_operand(compiler, upvalue->is_local, wide, last_line(compiler));
   }
+  free_compiler(&func_compiler);
   if (emit_name && name_slot != -1) {
-    emit_byte(compiler, $DEFINE_GLOBAL, func->line);
-    emit_byte(compiler, name_slot, func->line);
+    emit_op(compiler, $DEFINE_GLOBAL, name_slot, func->line);
   }
 #ifdef EVE_DEBUG
   if (!func_compiler.errors) {
@@ -920,9 +1116,6 @@ void c_(Compiler* compiler, AstNode* node) {
     case AST_FOR_STMT:
       c_for_stmt(compiler, node);
       break;
-    case AST_LOOP:
-      c_loop(compiler, node);
-      break;
     case AST_PROGRAM:
       c_program(compiler, node);
       break;
@@ -932,13 +1125,27 @@ void c_(Compiler* compiler, AstNode* node) {
 }
 
 void compile(Compiler* compiler) {
+  if (compiler->vm->optimize) {
+    compiler->root = fold_constants(compiler->root);
+  }
   c_(compiler, compiler->root);
   if (compiler->errors) {
     free_code(&compiler->func->code, compiler->vm);
   }
   emit_byte(compiler, $RET, last_line(compiler));
+  if (!compiler->errors) {
+    widen_jumps(compiler);
+  }
+  if (!compiler->errors && compiler->vm->optimize) {
+    peephole(compiler);
+    fuse_code(compiler);
+  }
+  init_caches(&compiler->func->code, compiler->vm);
+  compiler->func->max_stack =
+      stack_size(compiler->vm, &compiler->func->code, compiler->func->arity);
 #ifdef EVE_DEBUG
   dis_code(&compiler->func->code, get_func_name(compiler->func));
 #endif
+  free_compiler(compiler);
 }
 #pragma clang diagnostic pop
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include "value.h"
 
 #define MAX_CONTROLS UINT16_MAX
+// locals and upvalues are addressed by 2-byte operands at most (see $WIDE)
+#define LOCALS_MAX (UINT16_MAX + 1)
+#define UPVALUES_MAX (UINT16_MAX + 1)
 
 typedef struct {
   bool initialized;
@@ -24,15 +27,25 @@ typedef struct {
   int index;
 } Upvalue;
 
+typedef struct {
+  int offset;  // of a jump too far for its 2-byte operand
+  int target;
+} FarJump;
+
 typedef struct Compiler {
   int errors;
   int scope;
   int locals_count;
+  int locals_capacity;
   int controls_count;
   int upvalues_count;
+  int upvalues_capacity;
+  int far_count;
+  int far_capacity;
   int free_vars;
-  LocalVar locals[CONST_MAX];
-  Upvalue upvalues[CONST_MAX];
+  LocalVar* locals;
+  Upvalue* upvalues;
+  FarJump* far_jumps;  // see widen_jumps()
   LoopVar controls[MAX_CONTROLS];
   LoopVar current_loop;
   VM* vm;
@@ -49,5 +62,6 @@ void new_compiler(
     VM* vm,
     char* module_name);
 void compile(Compiler* compiler);
+void free_compiler(Compiler* compiler);
 
 #endif  //EVE_COMPILER_H
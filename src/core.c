@@ -1,6 +1,7 @@
 #include "core.h"
 
 #include <limits.h>
+#include <stddef.h>
 #include <sys/stat.h>
 #include <time.h>
 
@@ -8,6 +9,7 @@
 #include "inc.h"
 #include "map.h"
 #include "parser.h"
+#include "profile.h"
 #include "serde.h"
 #include "vm.h"
 
@@ -41,13 +43,12 @@ Value fn_type(VM* vm, int argc, const Value* args);
 Value fn_clock(VM* vm, int argc, const Value* args);
 Value fn_time(VM* vm, int argc, const Value* args);
 Value fn_offload(VM* vm, int argc, const Value* args);
+Value fn_range(VM* vm, int argc, const Value* args);
 Value fn_iter(VM* vm, int argc, const Value* args);
 Value fn_next(VM* vm, int argc, const Value* args);
 
 /*** string ***/
 Value fn_str_len(VM* vm, int argc, const Value* args);
-Value get_str_iterator_instance(VM* vm, Value str_val);
-Value get_str_iterator_instance_next(VM* vm, Value si_instance);
 Value fn_str_to_string(VM* vm, int argc, const Value* args);
 Value fn_str_append(VM* vm, int argc, const Value* args);
 Value fn_str_upper(VM* vm, int argc, const Value* args);
@@ -69,8 +70,6 @@ Value fn_str_count(VM* vm, int argc, const Value* args);
 
 /*** list ***/
 Value fn_list_len(VM* vm, int argc, const Value* args);
-Value get_list_iterator_instance(VM* vm, Value list);
-Value get_list_iterator_instance_next(VM* vm, Value li_instance);
 Value fn_list_append(VM* vm, int argc, const Value* args);
 Value fn_list_pop(VM* vm, int argc, const Value* args);
 Value fn_list_clear(VM* vm, int argc, const Value* args);
@@ -113,10 +112,14 @@ Value fn_instance_del_prop(VM* vm, int argc, const Value* args);
 Value fn_module_path(VM* vm, int argc, const Value* args);
 Value fn_module_globals(VM* vm, int argc, const Value* args);
 
+/*** profile ***/
+Value fn_profile_reset(VM* vm, int argc, const Value* args);
+Value fn_profile_snapshot(VM* vm, int argc, const Value* args);
+
 struct ModuleData mod_data[] = {
     {.module_name = "core",
      .name_len = 4,
-     .field_len = 10,
+     .field_len = 11,
      .data =
          {
              // negative arity indicates varargs
@@ -130,6 +133,7 @@ struct ModuleData mod_data[] = {
              {.name = "offload", .arity = 0, .func = fn_offload},
              {.name = "iter", .arity = 1, .func = fn_iter},
              {.name = "next", .arity = 1, .func = fn_next},
+             {.name = "range", .arity = -1, .func = fn_range},
          }},
     {.module_name = "string",
      .name_len = 6,
@@ -147,18 +151,67 @@ struct ModuleData mod_data[] = {
          }},
     {.module_name = "hashmap",
      .name_len = 7,
-     .field_len = 2,
+     .field_len = 5,
      .data =
          {
              {.name = "put", .arity = 3, .func = fn_map_put},
              {.name = "len", .arity = 1, .func = fn_map_len},
+             {.name = "keys", .arity = 1, .func = fn_map_keys},
+             {.name = "values", .arity = 1, .func = fn_map_values},
+             {.name = "items", .arity = 1, .func = fn_map_items},
+         }},
+    {.module_name = "profile",
+     .name_len = 7,
+     .field_len = 2,
+     .data =
+         {
+             {.name = "reset", .arity = 0, .func = fn_profile_reset},
+             {.name = "snapshot", .arity = 0, .func = fn_profile_snapshot},
          }},
 };
 
+const Intrinsic intrinsics[] = {
+    {.module = NULL, .name = "type", .op = $TYPEOF, .fn = fn_type},
+    {.module = "string",
+     .name = "len",
+     .op = $LEN,
+     .type = OBJ_STR,
+     .fn = fn_str_len},
+    {.module = "list",
+     .name = "len",
+     .op = $LEN,
+     .type = OBJ_LIST,
+     .fn = fn_list_len},
+    {.module = "hashmap",
+     .name = "len",
+     .op = $LEN,
+     .type = OBJ_HMAP,
+     .fn = fn_map_len},
+};
+
 /*********************
 *  > helpers
 ********************/
 
+int find_intrinsic(char* module, int module_len, char* name, int name_len) {
+  // the index of the intrinsic for core::<module>::<name>, -1 if none.
+  // `module` is NULL for the core module
+  for (int i = 0; i < sizeof(intrinsics) / sizeof(Intrinsic); i++) {
+    const Intrinsic* intrinsic = &intrinsics[i];
+    if (!module != !intrinsic->module
+        || (module
+            && ((int)strlen(intrinsic->module) != module_len
+                || memcmp(intrinsic->module, module, module_len) != 0))) {
+      continue;
+    }
+    if ((int)strlen(intrinsic->name) == name_len
+        && memcmp(intrinsic->name, name, name_len) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
 ObjString* resolve_path(VM* vm, ObjString* fname) {
   // import("program.eve"); // relative
   // import("../../program.eve"); // absolute
@@ -214,7 +267,7 @@ void add_cfn(VM* vm, ObjStruct* module, char* name, int arity, CFn func) {
       vm,
       create_stringv(vm, &vm->strings, name, (int)strlen(name), false));
   vm_push_stack(vm, OBJ_VAL(create_cfn(vm, func, arity, name)));
-  map_put(&module->fields, vm, AS_STRING(*(vm->sp - 2)), *(vm->sp - 1));
+  module_put(vm, module, AS_STRING(*(vm->sp - 2)), *(vm->sp - 1));
   vm_pop_stack(vm);
   vm_pop_stack(vm);
 }
@@ -242,20 +295,22 @@ Value compile_module(VM* vm, char* src, char* mod_name, bool store_builtins) {
         // cache the module
         map_put(&vm->modules, vm, func->module->name, module);
       }
-      // save the current frame
+      // save the current frame, keeping its stack pointer as an offset since
+      // running the module may grow (and move) the stack
       CallFrame curr_frame = vm_pop_frame(vm);
+      ptrdiff_t base = curr_frame.stack - vm->stack;
       vm_push_stack(vm, OBJ_VAL(closure));
       CallFrame frame = {
           .closure = closure,
           .stack = vm->sp - 1,
-          .ip = func->code.bytes,
-          .try_ctx = {.sp = NULL, .handler_ip = NULL}};
+          .ip = func->code.bytes};
       // push a new frame to execute the module
       vm_push_frame(vm, frame);
-      IResult res = run(vm);
+      IResult res = vm_run(vm);
       // remove the newly executed frame from the stack
       vm_pop_stack(vm);
       // restore the current frame
+      curr_frame.stack = vm->stack + base;
       vm_push_frame(vm, curr_frame);
       if (res != RESULT_SUCCESS) {
         return NOTHING_VAL;
@@ -275,7 +330,6 @@ void init_builtins(VM* vm, ObjStruct* current_mod) {
       false);
   vm->builtins = create_module(vm, core);
   inject_builtins(vm, current_mod);
-  map_init(&vm->builtins->fields);
   for (int i = 0; i < mod_data[0].field_len; i++) {
     struct FnData data = mod_data[0].data[i];
     add_cfn(vm, vm->builtins, data.name, data.arity, data.func);
@@ -290,43 +344,24 @@ void init_builtins(VM* vm, ObjStruct* current_mod) {
         m_data.name_len,
         false);
     ObjStruct* module = create_module(vm, modname);
-    map_init(&module->fields);
     for (int j = 0; j < m_data.field_len; j++) {
       struct FnData fn_data = m_data.data[j];
       add_cfn(vm, module, fn_data.name, fn_data.arity, fn_data.func);
     }
     // store the module in the core module
-    map_put(&vm->builtins->fields, vm, modname, OBJ_VAL(module));
+    module_put(vm, vm->builtins, modname, OBJ_VAL(module));
   }
-  // setup builtin structs
-  //. list_iterator
-  ObjString* curr = create_string(vm, &vm->strings, "$_curr", 6, false);
-  ObjString* obj = create_string(vm, &vm->strings, "$_obj", 5, false);
-  ObjString* li_name =
-      create_string(vm, &vm->strings, "list_iterator", 13, false);
-  ObjStruct* list_iterator = create_struct(vm, li_name);
-  map_put(&list_iterator->fields, vm, curr, NOTHING_VAL);
-  map_put(&list_iterator->fields, vm, obj, NOTHING_VAL);
-  map_put(&vm->builtins->fields, vm, li_name, OBJ_VAL(list_iterator));
-  //. string_iterator
-  ObjString* si_name =
-      create_string(vm, &vm->strings, "string_iterator", 15, false);
-  ObjStruct* string_iterator = create_struct(vm, si_name);
-  map_put(&string_iterator->fields, vm, curr, NOTHING_VAL);
-  map_put(&string_iterator->fields, vm, obj, NOTHING_VAL);
-  map_put(&vm->builtins->fields, vm, si_name, OBJ_VAL(string_iterator));
   // setup other builtins members
   Value module = compile_module(vm, BUILTINS_SRC_INC, "core", false);
   if (module != NOTHING_VAL) {
-    ObjStruct* mod = AS_STRUCT(module);
-    map_copy(vm, &vm->builtins->fields, &mod->fields);
+    module_copy(vm, vm->builtins, AS_MODULE(module));
   }
 }
 
 void inject_builtins(VM* vm, ObjStruct* module) {
   vm_push_stack(vm, OBJ_VAL(module));
   // store builtins into module's globals as "core"
-  map_put(&module->fields, vm, vm->builtins->name, OBJ_VAL(vm->builtins));
+  module_put(vm, module, vm->builtins->name, OBJ_VAL(vm->builtins));
   vm_pop_stack(vm);
 }
 
@@ -430,8 +465,7 @@ Value fn_import(VM* vm, int argc, const Value* args) {
         CallFrame frame = {
             .closure = closure,
             .stack = vm->sp - 1 - argc,
-            .ip = func->code.bytes,
-            .try_ctx = {.handler_ip = NULL, .sp = NULL}};
+            .ip = func->code.bytes};
         vm_push_frame(vm, frame);
         vm->is_compiling = false;
         return module;
@@ -471,8 +505,7 @@ Value fn_import(VM* vm, int argc, const Value* args) {
       CallFrame frame = {
           .closure = closure,
           .stack = vm->sp - 1 - argc,
-          .ip = func->code.bytes,
-          .try_ctx = {.sp = NULL, .handler_ip = NULL}};
+          .ip = func->code.bytes};
       vm_push_frame(vm, frame);
 #ifdef EVE_OPTIMIZE_IMPORTS
       if (filename) {
@@ -523,34 +556,65 @@ Value fn_time(VM* vm, int argc, const Value* args) {
 
 Value fn_offload(VM* vm, int argc, const Value* args) {
   (void)argc, (void)args;
-  map_copy(vm, &vm->current_module->fields, &vm->builtins->fields);
+  module_copy(vm, vm->current_module, vm->builtins);
   return NONE_VAL;
 }
 
+// range(stop), range(start, stop) or range(start, stop, step): the numbers
+// from start (0) by step (1) up to, but not including, stop
+Value fn_range(VM* vm, int argc, const Value* args) {
+  if (argc < 1 || argc > 3) {
+    runtime_error(
+        vm,
+        NOTHING_VAL,
+        "'range' function takes 1 to 3 argument(s) but got %d",
+        argc);
+    return NOTHING_VAL;
+  }
+  for (int i = 0; i < argc; i++) {
+    ASSERT_TYPE(
+        vm,
+        IS_NUMBER,
+        args[i],
+        "Expected arguments of type 'number', but got '%s'",
+        get_value_type(args[i]));
+  }
+  double start = argc > 1 ? AS_NUMBER(args[0]) : 0;
+  double stop = AS_NUMBER(args[argc > 1]);
+  double step = argc > 2 ? AS_NUMBER(args[2]) : 1;
+  if (step == 0) {
+    runtime_error(vm, NOTHING_VAL, "range() step must not be zero");
+    return NOTHING_VAL;
+  }
+  return OBJ_VAL(create_range(vm, start, stop, step));
+}
+
+static Value stop_iteration(VM* vm) {
+  ObjString* err = create_string(vm, &vm->strings, "StopIteration", 13, false);
+  runtime_error(vm, module_get(vm->builtins, err), "StopIteration");
+  return NOTHING_VAL;
+}
+
 Value fn_iter(VM* vm, int argc, const Value* args) {
   (void)argc;
   Value iterable = *args;
   if (IS_LIST(iterable)) {
-    // get list iterable
-    return get_list_iterator_instance(vm, iterable);
+    return OBJ_VAL(create_iterator(vm, ITER_LIST, AS_OBJ(iterable)));
   } else if (IS_STRING(iterable)) {
-    // get string iterable
-    return get_str_iterator_instance(vm, iterable);
+    return OBJ_VAL(create_iterator(vm, ITER_STRING, AS_OBJ(iterable)));
   } else if (IS_HMAP(iterable)) {
-    ObjHashMap* map = AS_HMAP(iterable);
-    ObjList* list = create_list(vm, map->length);
-    vm_push_stack(vm, OBJ_VAL(list));
-    hashmap_get_keys(map, list);
-    Value li_instance = get_list_iterator_instance(vm, OBJ_VAL(list));
-    vm_pop_stack(vm);
-    return li_instance;
+    return OBJ_VAL(create_iterator(vm, ITER_KEYS, AS_OBJ(iterable)));
+  } else if (IS_RANGE(iterable)) {
+    return OBJ_VAL(create_iterator(vm, ITER_RANGE, AS_OBJ(iterable)));
+  } else if (IS_ITERATOR(iterable)) {
+    return iterable;
   } else if (IS_INSTANCE(iterable)) {
     ObjString* str = create_string(vm, &vm->strings, "iter", 4, false);
     Value iter = map_get(&AS_INSTANCE(iterable)->fields, str);
     if (IS_CLOSURE(iter) || IS_CFUNC(iter)) {
       vm_pop_stack(vm);
       vm_call_value(vm, iter, 0);
-      vm_push_stack(vm, *args);
+      vm_push_stack(vm, iterable);
       return NONE_VAL;
     } else if (iter == NOTHING_VAL) {
       runtime_error(
@@ -574,29 +638,25 @@ Value fn_iter(VM* vm, int argc, const Value* args) {
 Value fn_next(VM* vm, int argc, const Value* args) {
   (void)argc;
   Value iterator = *args;
-  if (IS_INSTANCE(iterator)) {
-    ObjInstance* instance = AS_INSTANCE(iterator);
-    ObjString* name =
-        create_string(vm, &vm->strings, "list_iterator", 13, false);
-    if (instance->strukt->name == name) {
-      Value strukt = map_get(&vm->builtins->fields, name);
-      if (AS_STRUCT(strukt) == instance->strukt) {
-        return get_list_iterator_instance_next(vm, iterator);
-      }
+  if (IS_ITERATOR(iterator)) {
+    ObjIterator* iter = AS_ITERATOR(iterator);
+    Value elem;
+    if (iterator_moved(iter)) {
+      runtime_error(vm, NOTHING_VAL, "hashmap changed size during iteration");
+      return NOTHING_VAL;
     }
-    name = create_string(vm, &vm->strings, "string_iterator", 15, false);
-    if (instance->strukt->name == name) {
-      Value strukt = map_get(&vm->builtins->fields, name);
-      if (AS_STRUCT(strukt) == instance->strukt) {
-        return get_str_iterator_instance_next(vm, iterator);
-      }
+    if (!iterate(vm, iter->kind, iter->iterable, &iter->cursor, &elem)) {
+      return stop_iteration(vm);
     }
+    return elem;
+  } else if (IS_INSTANCE(iterator)) {
+    ObjInstance* instance = AS_INSTANCE(iterator);
     ObjString* str = create_string(vm, &vm->strings, "next", 4, false);
     Value next = map_get(&instance->fields, str);
     if (IS_CLOSURE(next) || IS_CFUNC(next)) {
       vm_pop_stack(vm);
       vm_call_value(vm, next, 0);
-      vm_push_stack(vm, *args);
+      vm_push_stack(vm, iterator);
       return NONE_VAL;
     } else if (next == NOTHING_VAL) {
       runtime_error(
@@ -611,7 +671,7 @@ Value fn_next(VM* vm, int argc, const Value* args) {
   } else if (IS_CLOSURE(iterator) || IS_CFUNC(iterator)) {
     vm_pop_stack(vm);  // balance up stack effect for call_value
     vm_call_value(vm, iterator, 0);
-    vm_push_stack(vm, *args);  // balance up stack effect for call_value
+    vm_push_stack(vm, iterator);  // balance up stack effect for call_value
     return NONE_VAL;
   }
   runtime_error(
@@ -625,66 +685,6 @@ Value fn_next(VM* vm, int argc, const Value* args) {
 /***********************
 *  > core > string
 ***********************/
-Value get_str_iterator_instance(VM* vm, Value str_val) {
-  // core::iter("str") -> string_iterator instance
-  ObjString* curr = create_string(vm, &vm->strings, "$_curr", 6, false);
-  vm_push_stack(vm, OBJ_VAL(curr));
-  ObjString* str = create_string(vm, &vm->strings, "$_obj", 5, false);
-  vm_push_stack(vm, OBJ_VAL(str));
-  ObjString* name =
-      create_string(vm, &vm->strings, "string_iterator", 15, false);
-  vm_push_stack(vm, OBJ_VAL(name));
-  ObjStruct* string_iterator = AS_STRUCT(map_get(&vm->builtins->fields, name));
-  ObjInstance* iterator_inst = create_instance(vm, string_iterator);
-  vm_push_stack(vm, OBJ_VAL(iterator_inst));
-  map_put(&iterator_inst->fields, vm, curr, NONE_VAL);
-  map_put(&iterator_inst->fields, vm, str, str_val);
-  vm->sp -= 4;
-  return OBJ_VAL(iterator_inst);
-}
-
-Value get_str_iterator_instance_next(VM* vm, Value si_instance) {
-  // this function like get_list_iterator_next() makes a number of
-  // assumptions: we do not push any created value on the stack to appease
-  // the GC because the values being created are strings, and the create
-  // operations are simply cache-fetches since the strings would already
-  // have been created during init_builtins() setup, when booting the VM
-  // (remember - all strings are interned in eve.)
-  ObjInstance* instance = AS_INSTANCE(si_instance);
-  ObjString* curr = create_string(vm, &vm->strings, "$_curr", 6, false);
-  ObjString* str = create_string(vm, &vm->strings, "$_obj", 5, false);
-  Value str_val = map_get(&instance->fields, str);
-  Value curr_idx = map_get(&instance->fields, curr);
-  if (str_val == NOTHING_VAL || curr_idx == NOTHING_VAL) {
-    runtime_error(
-        vm,
-        NOTHING_VAL,
-        "Could not obtain string_iterator internal field");
-    return NOTHING_VAL;
-  }
-  int index;
-  ObjString* str_obj = AS_STRING(str_val);
-  if (curr_idx == NONE_VAL) {
-    index = 0;
-  } else {
-    index = AS_NUMBER(curr_idx) + 1;
-  }
-  if (index >= str_obj->length) {
-    ObjString* err =
-        create_string(vm, &vm->strings, "StopIteration", 13, false);
-    Value itr_err = map_get(&vm->builtins->fields, err);
-    runtime_error(vm, itr_err, "StopIteration");
-    return NOTHING_VAL;
-  } else {
-    Value elem =
-        create_stringv(vm, &vm->strings, str_obj->str + index, 1, false);
-    vm_push_stack(vm, elem);
-    map_put(&instance->fields, vm, curr, NUMBER_VAL(index));
-    vm_pop_stack(vm);
-    return elem;
-  }
-}
-
 Value fn_str_len(VM* vm, int argc, const Value* args) {
   ASSERT_TYPE(
       vm,
@@ -699,56 +699,6 @@ Value fn_str_len(VM* vm, int argc, const Value* args) {
 /**********************
 *  > core > list
 **********************/
-Value get_list_iterator_instance(VM* vm, Value list_val) {
-  // core::iter([]) -> list_iterator instance
-  ObjString* curr = create_string(vm, &vm->strings, "$_curr", 6, false);
-  vm_push_stack(vm, OBJ_VAL(curr));
-  ObjString* list = create_string(vm, &vm->strings, "$_obj", 5, false);
-  vm_push_stack(vm, OBJ_VAL(list));
-  ObjString* name = create_string(vm, &vm->strings, "list_iterator", 13, false);
-  vm_push_stack(vm, OBJ_VAL(name));
-  ObjStruct* list_iterator = AS_STRUCT(map_get(&vm->builtins->fields, name));
-  ObjInstance* iterator_inst = create_instance(vm, list_iterator);
-  vm_push_stack(vm, OBJ_VAL(iterator_inst));
-  map_put(&iterator_inst->fields, vm, curr, NONE_VAL);
-  map_put(&iterator_inst->fields, vm, list, list_val);
-  vm->sp -= 4;
-  return OBJ_VAL(iterator_inst);
-}
-
-Value get_list_iterator_instance_next(VM* vm, Value li_instance) {
-  ObjInstance* instance = AS_INSTANCE(li_instance);
-  ObjString* curr = create_string(vm, &vm->strings, "$_curr", 6, false);
-  ObjString* list = create_string(vm, &vm->strings, "$_obj", 5, false);
-  Value list_val = map_get(&instance->fields, list);
-  Value curr_idx = map_get(&instance->fields, curr);
-  if (list_val == NOTHING_VAL || curr_idx == NOTHING_VAL) {
-    runtime_error(
-        vm,
-        NOTHING_VAL,
-        "Could not obtain list_iterator internal field");
-    return NOTHING_VAL;
-  }
-  int index;
-  ObjList* list_obj = AS_LIST(list_val);
-  if (curr_idx == NONE_VAL) {
-    index = 0;
-  } else {
-    index = AS_NUMBER(curr_idx) + 1;
-  }
-  if (index >= list_obj->elems.length) {
-    ObjString* err =
-        create_string(vm, &vm->strings, "StopIteration", 13, false);
-    Value itr_err = map_get(&vm->builtins->fields, err);
-    runtime_error(vm, itr_err, "StopIteration");
-    return NOTHING_VAL;
-  } else {
-    Value elem = list_obj->elems.buffer[index];
-    map_put(&instance->fields, vm, curr, NUMBER_VAL(index));
-    return elem;
-  }
-}
-
 Value fn_list_len(VM* vm, int argc, const Value* args) {
   ASSERT_TYPE(
       vm,
@@ -789,6 +739,33 @@ Value fn_map_len(VM* vm, int argc, const Value* args) {
   return NUMBER_VAL(AS_HMAP(*args)->length);
 }
 
+static Value map_iterator(VM* vm, IterKind kind, Value map) {
+  // walks the map's entries as it goes, without copying them out first
+  ASSERT_TYPE(
+      vm,
+      IS_HMAP,
+      map,
+      "Expected argument of type 'hashmap', but got '%s'",
+      get_value_type(map));
+  return OBJ_VAL(create_iterator(vm, kind, AS_OBJ(map)));
+}
+
+Value fn_map_keys(VM* vm, int argc, const Value* args) {
+  (void)argc;
+  return map_iterator(vm, ITER_KEYS, *args);
+}
+
+Value fn_map_values(VM* vm, int argc, const Value* args) {
+  (void)argc;
+  return map_iterator(vm, ITER_VALUES, *args);
+}
+
+// [key, value] lists
+Value fn_map_items(VM* vm, int argc, const Value* args) {
+  (void)argc;
+  return map_iterator(vm, ITER_ITEMS, *args);
+}
+
 /**********************
 *  > core > struct
 ***********************/
@@ -802,4 +779,30 @@ Value fn_map_len(VM* vm, int argc, const Value* args) {
 /*********************
 *  > core > module
 *********************/
-//Value fn_module_path(VM* vm, int argc, const Value* args) {}
\ No newline at end of file
+//Value fn_module_path(VM* vm, int argc, const Value* args) {}
+/*********************
+*  > core > profile
+*********************/
+
+// zero the execution counters, see profile.h
+Value fn_profile_reset(VM* vm, int argc, const Value* args) {
+  (void)argc, (void)args;
+  reset_profile(vm);
+  return NONE_VAL;
+}
+
+// the execution counters as
+// #{"calls": #{"fn (module:line)": n}, "loops": #{"fn (module:line)": n}},
+// an error in builds without them
+Value fn_profile_snapshot(VM* vm, int argc, const Value* args) {
+  (void)argc, (void)args;
+#ifdef EVE_PROFILE
+  return OBJ_VAL(profile_snapshot(vm));
+#else
+  runtime_error(
+      vm,
+      NOTHING_VAL,
+      "eve was built without EVE_PROFILE, there are no counts");
+  return NOTHING_VAL;
+#endif
+}
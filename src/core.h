@@ -3,6 +3,24 @@
 
 #include "value.h"
 
+// calls of builtins in mod_data that the compiler makes into instructions
+// (see c_intrinsic()): core::<module>::<name>(x), or core::<name>(x) for the
+// core module itself
+typedef struct {
+  char* module;
+  char* name;
+  byte_t op;
+  ObjTy type;  // of the value $LEN counts
+  CFn fn;  // the builtin, for what the instruction doesn't handle itself
+} Intrinsic;
+
+extern const Intrinsic intrinsics[];
+
+// core::iter() and core::next(), which `for` loops over anything but lists,
+// strings, hashmaps and iterators go through (see prep_iter() in vm.c)
+Value fn_iter(VM* vm, int argc, const Value* args);
+Value fn_next(VM* vm, int argc, const Value* args);
+int find_intrinsic(char* module, int module_len, char* name, int name_len);
 void init_builtins(VM* vm, ObjStruct* current_mod);
 void inject_builtins(VM* vm, ObjStruct* module);
 
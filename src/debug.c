@@ -1,46 +1,93 @@
 #include "debug.h"
 
+#include "core.h"
+#include "regen.h"
+
+// bytes per operand of the instruction being disassembled, 2 under $WIDE
+static int width = 1;
+
+static int read_operand(Code* code, int offset) {
+  if (width == 2) {
+    return (code->bytes[offset] << 8) | code->bytes[offset + 1];
+  }
+  return code->bytes[offset];
+}
+
 int plain_instruction(char* inst, int offset) {
   printf("%s\n", inst);
   return ++offset;
 }
 
 int byte_instruction(char* inst, Code* code, int offset) {
-  printf("%-16s\t%3d\n", inst, code->bytes[offset + 1]);
-  return offset + 2;
+  printf("%-16s\t%3d\n", inst, read_operand(code, offset + 1));
+  return offset + 1 + width;
+}
+
+int bytes_instruction(char* inst, Code* code, int offset) {
+  printf(
+      "%-16s\t%3d %3d\n",
+      inst,
+      read_operand(code, offset + 1),
+      read_operand(code, offset + 1 + width));
+  return offset + 1 + width * 2;
 }
 
 int constant_instruction(char* inst, Code* code, int offset) {
   // inst, operand, (value).
-  int operand = code->bytes[++offset];
+  int operand = read_operand(code, offset + 1);
   printf("%-16s\t%3d    ", inst, operand);
   printf("(");
   Value val = code->vpool.values[operand];
   print_value(val);
   printf(")\n");
-  return ++offset;
+  return offset + 1 + width;
 }
 
-int jump_instruction(char* inst, Code* code, int offset, int sign) {
-  // jmp offset -> op-arg (2 bytes)
-  int jmp_offset = code->bytes[offset + 1] << 8;
-  jmp_offset |= code->bytes[offset + 2];
+int cache_instruction(char* inst, Code* code, int offset) {
+  // inst, operand, (value), inline cache index
+  int operand = read_operand(code, offset + 1);
+  offset += 1 + width * 3;
+  int cache = (code->bytes[offset - 2] << 8) | code->bytes[offset - 1];
+  printf("%-16s\t%3d    ", inst, operand);
+  printf("(");
+  print_value(code->vpool.values[operand]);
+  printf(")\t ic %d\n", cache);
+  return offset;
+}
+
+int intrinsic_instruction(char* inst, Code* code, int offset) {
+  // inst, `core`'s global slot, the builtin
+  const Intrinsic* intrinsic = &intrinsics[code->bytes[offset + 2]];
   printf(
-      "%-16s\t%3d -> %d\n",
+      "%-16s\t%3d    %s%s%s\n",
       inst,
-      offset,
-      (jmp_offset * sign) + offset + 3);
+      code->bytes[offset + 1],
+      intrinsic->module ? intrinsic->module : "",
+      intrinsic->module ? "::" : "",
+      intrinsic->name);
   return offset + 3;
 }
 
+int jump_instruction(char* inst, Code* code, int offset, int sign) {
+  // jmp offset -> op-arg (2 bytes, 4 under $WIDE)
+  int end = offset + 1 + width * 2;
+  int jmp_offset = 0;
+  for (int i = offset + 1; i < end; i++) {
+    jmp_offset = (jmp_offset << 8) | code->bytes[i];
+  }
+  printf("%-16s\t%3d -> %d\n", inst, offset, (jmp_offset * sign) + end);
+  return end;
+}
+
 int closure_instruction(char* inst, Code* code, int offset) {
-  int slot = code->bytes[offset + 1];
+  int slot = read_operand(code, offset + 1);
   ObjFn* fn = AS_FUNC(code->vpool.values[slot]);
   offset = constant_instruction(inst, code, offset);
   for (int i = 0; i < fn->env_len; i++) {
     // index, is_local
-    int uv_index = code->bytes[offset++];
-    bool uv_is_local = code->bytes[offset++];
+    int uv_index = read_operand(code, offset);
+    bool uv_is_local = read_operand(code, offset + width);
+    offset += width * 2;
     printf(
         "   |\t%04d\t%-16s\t\t   upvalue  %d  %d\n",
         offset,
@@ -53,131 +100,215 @@ int closure_instruction(char* inst, Code* code, int offset) {
 
 int struct_instruction(char* inst, Code* code, int offset) {
   // inst name-slot-index field-count
-  int operand = code->bytes[++offset];
+  int operand = read_operand(code, offset + 1);
   printf("%-16s\t%3d    ", inst, operand);
   printf("(");
   Value val = code->vpool.values[operand];
   print_value(val);
-  printf(")\t %d\n", code->bytes[++offset]);
-  return ++offset;
+  printf(")\t %d\n", read_operand(code, offset + 1 + width));
+  return offset + 1 + width * 2;
 }
 
-int dis_instruction(Code* code, int index) {
-  if (index > 0 && code->lines[index] == code->lines[index - 1]) {
-    printf("   |\t%04d\t", index);
-  } else {
-    printf("%4d\t%04d\t", code->lines[index], index);
-  }
+static char* const op_names[UINT8_MAX + 1] = {
+    [$ADD] = "$ADD",
+    [$SUBTRACT] = "$SUBTRACT",
+    [$MULTIPLY] = "$MULTIPLY",
+    [$DIVIDE] = "$DIVIDE",
+    [$NEGATE] = "$NEGATE",
+    [$MOD] = "$MOD",
+    [$POW] = "$POW",
+    [$NOT] = "$NOT",
+    [$EQ] = "$EQ",
+    [$NOT_EQ] = "$NOT_EQ",
+    [$LESS] = "$LESS",
+    [$GREATER] = "$GREATER",
+    [$LESS_OR_EQ] = "$LESS_OR_EQ",
+    [$GREATER_OR_EQ] = "$GREATER_OR_EQ",
+    [$JMP] = "$JMP",
+    [$JMP_FALSE] = "$JMP_FALSE",
+    [$JMP_FALSE_OR_POP] = "$JMP_FALSE_OR_POP",
+    [$BW_LSHIFT] = "$BW_LSHIFT",
+    [$BW_RSHIFT] = "$BW_RSHIFT",
+    [$BW_INVERT] = "$BW_INVERT",
+    [$BW_AND] = "$BW_AND",
+    [$BW_XOR] = "$BW_XOR",
+    [$BW_OR] = "$BW_OR",
+    [$LOAD_CONST] = "$LOAD_CONST",
+    [$BUILD_LIST] = "$BUILD_LIST",
+    [$BUILD_MAP] = "$BUILD_MAP",
+    [$BUILD_CLOSURE] = "$BUILD_CLOSURE",
+    [$BUILD_STRUCT] = "$BUILD_STRUCT",
+    [$BUILD_INSTANCE] = "$BUILD_INSTANCE",
+    [$POP] = "$POP",
+    [$POP_N] = "$POP_N",
+    [$DISPLAY] = "$DISPLAY",
+    [$SUBSCRIPT] = "$SUBSCRIPT",
+    [$GET_FIELD] = "$GET_FIELD",
+    [$GET_PROPERTY] = "$GET_PROPERTY",
+    [$SET_PROPERTY] = "$SET_PROPERTY",
+    [$SET_SUBSCRIPT] = "$SET_SUBSCRIPT",
+    [$DEFINE_GLOBAL] = "$DEFINE_GLOBAL",
+    [$GET_GLOBAL] = "$GET_GLOBAL",
+    [$GET_LOCAL] = "$GET_LOCAL",
+    [$SET_GLOBAL] = "$SET_GLOBAL",
+    [$SET_LOCAL] = "$SET_LOCAL",
+    [$GET_UPVALUE] = "$GET_UPVALUE",
+    [$SET_UPVALUE] = "$SET_UPVALUE",
+    [$CLOSE_UPVALUE] = "$CLOSE_UPVALUE",
+    [$ASSERT] = "$ASSERT",
+    [$THROW] = "$THROW",
+    [$LOOP] = "$LOOP",
+    [$CALL] = "$CALL",
+    [$TAIL_CALL] = "$TAIL_CALL",
+    [$RET] = "$RET",
+    [$ITER_PREP] = "$ITER_PREP",
+    [$FOR_ITER] = "$FOR_ITER",
+    [$LEN] = "$LEN",
+    [$TYPEOF] = "$TYPEOF",
+    [$WIDE] = "$WIDE",
+    [$ADD_LOCALS] = "$ADD_LOCALS",
+    [$ADD_CONST] = "$ADD_CONST",
+    [$SUBTRACT_CONST] = "$SUBTRACT_CONST",
+    [$LESS_JMP] = "$LESS_JMP",
+    [$GREATER_JMP] = "$GREATER_JMP",
+    [$LESS_OR_EQ_JMP] = "$LESS_OR_EQ_JMP",
+    [$GREATER_OR_EQ_JMP] = "$GREATER_OR_EQ_JMP",
+    [$EQ_JMP] = "$EQ_JMP",
+    [$NOT_EQ_JMP] = "$NOT_EQ_JMP",
+    [$SET_LOCAL_POP] = "$SET_LOCAL_POP",
+    [$RET_LOCAL] = "$RET_LOCAL",
+    [$ADD_NUM] = "$ADD_NUM",
+    [$SUBTRACT_NUM] = "$SUBTRACT_NUM",
+    [$MULTIPLY_NUM] = "$MULTIPLY_NUM",
+    [$DIVIDE_NUM] = "$DIVIDE_NUM",
+    [$LESS_NUM] = "$LESS_NUM",
+    [$GREATER_NUM] = "$GREATER_NUM",
+    [$LESS_OR_EQ_NUM] = "$LESS_OR_EQ_NUM",
+    [$GREATER_OR_EQ_NUM] = "$GREATER_OR_EQ_NUM",
+};
+
+char* op_name(int op) {
+  // names of the stack instructions, as the disassembler shows them
+  return op_names[op] ? op_names[op] : "UNKNOWN_OPCODE";
+}
+
+static int dis_op(Code* code, int index) {
   byte_t byte = code->bytes[index];
+  char* name = op_name(byte);
   switch (byte) {
     case $ADD:
-      return plain_instruction("$ADD", index);
     case $MULTIPLY:
-      return plain_instruction("$MULTIPLY", index);
     case $DIVIDE:
-      return plain_instruction("$DIVIDE", index);
     case $SUBTRACT:
-      return plain_instruction("$SUBTRACT", index);
     case $NEGATE:
-      return plain_instruction("$NEGATE", index);
     case $MOD:
-      return plain_instruction("$MOD", index);
     case $POW:
-      return plain_instruction("$POW", index);
     case $NOT:
-      return plain_instruction("$NOT", index);
     case $BW_INVERT:
-      return plain_instruction("$BW_INVERT", index);
     case $LESS:
-      return plain_instruction("$LESS", index);
     case $LESS_OR_EQ:
-      return plain_instruction("$LESS_OR_EQ", index);
     case $GREATER:
-      return plain_instruction("$GREATER", index);
     case $GREATER_OR_EQ:
-      return plain_instruction("$GREATER_OR_EQ", index);
     case $EQ:
-      return plain_instruction("$EQ", index);
     case $NOT_EQ:
-      return plain_instruction("$NOT_EQ", index);
     case $BW_LSHIFT:
-      return plain_instruction("$BW_LSHIFT", index);
     case $BW_RSHIFT:
-      return plain_instruction("$BW_RSHIFT", index);
     case $BW_AND:
-      return plain_instruction("$BW_AND", index);
     case $BW_OR:
-      return plain_instruction("$BW_OR", index);
     case $BW_XOR:
-      return plain_instruction("$BW_XOR", index);
     case $RET:
-      return plain_instruction("$RET", index);
     case $POP:
-      return plain_instruction("$POP", index);
     case $CLOSE_UPVALUE:
-      return plain_instruction("$CLOSE_UPVALUE", index);
     case $SUBSCRIPT:
-      return plain_instruction("$SUBSCRIPT", index);
     case $SET_SUBSCRIPT:
-      return plain_instruction("$SET_SUBSCRIPT", index);
-    case $TEAR_TRY:
-      return plain_instruction("$TEAR_TRY", index);
     case $THROW:
-      return plain_instruction("$THROW", index);
     case $ASSERT:
-      return plain_instruction("$ASSERT", index);
+    case $ADD_NUM:
+    case $SUBTRACT_NUM:
+    case $MULTIPLY_NUM:
+    case $DIVIDE_NUM:
+    case $LESS_NUM:
+    case $GREATER_NUM:
+    case $LESS_OR_EQ_NUM:
+    case $GREATER_OR_EQ_NUM:
+      return plain_instruction(name, index);
     case $JMP:
-      return jump_instruction("$JMP", code, index, 1);
     case $JMP_FALSE:
-      return jump_instruction("$JMP_FALSE", code, index, 1);
     case $JMP_FALSE_OR_POP:
-      return jump_instruction("$JMP_FALSE_OR_POP", code, index, 1);
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+    case $FOR_ITER:
+      return jump_instruction(name, code, index, 1);
     case $LOOP:
-      return jump_instruction("$LOOP", code, index, -1);
-    case $SET_TRY:
-      return jump_instruction("$SET_TRY", code, index, 1);
+      return jump_instruction(name, code, index, -1);
     case $BUILD_LIST:
-      return byte_instruction("$BUILD_LIST", code, index);
     case $BUILD_MAP:
-      return byte_instruction("$BUILD_MAP", code, index);
     case $CALL:
-      return byte_instruction("$CALL", code, index);
     case $TAIL_CALL:
-      return byte_instruction("$TAIL_CALL", code, index);
     case $DISPLAY:
-      return byte_instruction("$DISPLAY", code, index);
     case $POP_N:
-      return byte_instruction("$POP_N", code, index);
     case $SET_LOCAL:
-      return byte_instruction("$SET_LOCAL", code, index);
     case $SET_UPVALUE:
-      return byte_instruction("$SET_UPVALUE", code, index);
     case $GET_LOCAL:
-      return byte_instruction("$GET_LOCAL", code, index);
     case $GET_UPVALUE:
-      return byte_instruction("$GET_UPVALUE", code, index);
     case $BUILD_INSTANCE:
-      return byte_instruction("$BUILD_INSTANCE", code, index);
-    case $SET_PROPERTY:
-      return byte_instruction("$SET_PROPERTY", code, index);
-    case $LOAD_CONST:
-      return constant_instruction("$LOAD_CONST", code, index);
-    case $DEFINE_GLOBAL:
-      return constant_instruction("$DEFINE_GLOBAL", code, index);
+    case $SET_LOCAL_POP:
+    case $RET_LOCAL:
+    case $DEFINE_GLOBAL:  // the global's slot in the module
     case $GET_GLOBAL:
-      return constant_instruction("$GET_GLOBAL", code, index);
     case $SET_GLOBAL:
-      return constant_instruction("$SET_GLOBAL", code, index);
+      return byte_instruction(name, code, index);
+    case $SET_PROPERTY:
+    case $LOAD_CONST:
+    case $ADD_CONST:
+    case $SUBTRACT_CONST:
+      return constant_instruction(name, code, index);
     case $GET_PROPERTY:
-      return constant_instruction("$GET_PROPERTY", code, index);
     case $GET_FIELD:
-      return constant_instruction("$GET_FIELD", code, index);
+      return cache_instruction(name, code, index);
+    case $LEN:
+    case $TYPEOF:
+      return intrinsic_instruction(name, code, index);
     case $BUILD_STRUCT:
-      return struct_instruction("$BUILD_STRUCT", code, index);
+      return struct_instruction(name, code, index);
     case $BUILD_CLOSURE:
-      return closure_instruction("$BUILD_CLOSURE", code, index);
+      return closure_instruction(name, code, index);
+    case $ADD_LOCALS:
+      return bytes_instruction(name, code, index);
     default:
-      return plain_instruction("UNKNOWN_OPCODE", index);
+      return plain_instruction(name, index);
+  }
+}
+
+int dis_instruction(Code* code, int index) {
+  if (index > 0 && code->lines[index] == code->lines[index - 1]) {
+    printf("   |\t%04d\t", index);
+  } else {
+    printf("%4d\t%04d\t", code->lines[index], index);
+  }
+  if (code->bytes[index] == $WIDE) {
+    printf("$WIDE ");
+    width = 2;
+    index = dis_op(code, index + 1);
+    width = 1;
+    return index;
+  }
+  return dis_op(code, index);
+}
+
+static void dis_handlers(Handler* handlers, int count) {
+  // the exception table: range, handler, stack depth
+  for (int i = 0; i < count; i++) {
+    printf(
+        "\t\ttry %04d-%04d -> %04d @%d\n",
+        handlers[i].start,
+        handlers[i].end,
+        handlers[i].target,
+        handlers[i].depth);
   }
 }
 
@@ -186,4 +317,182 @@ void dis_code(Code* code, char* name) {
   for (int i = 0; i < code->length;) {
     i = dis_instruction(code, i);
   }
-}
\ No newline at end of file
+  dis_handlers(code->handlers, code->handler_count);
+  printf("\t\t%d constants\n", code->vpool.length);
+}
+
+void dis_functions(Code* code) {
+  // disassemble the functions defined in `code`, innermost first
+  Value val;
+  for (int i = 0; i < code->vpool.length; i++) {
+    val = code->vpool.values[i];
+    if (IS_FUNC(val)) {
+      dis_functions(&AS_FUNC(val)->code);
+      dis_code(&AS_FUNC(val)->code, get_func_name(AS_FUNC(val)));
+      printf("\n");
+    }
+  }
+}
+
+typedef struct {
+  char* name;
+  // one character per operand: r register, k constant, u upvalue, n count,
+  // d depth, g global slot, i 2-byte cache index, o 2-byte stack code offset,
+  // s/l 2-byte forward/backward jump,
+  // c the closure's (index, is_local) pairs
+  char* operands;
+} RegInstruction;
+
+static const RegInstruction reg_instructions[] = {
+    [$R_MOVE] = {"$R_MOVE", "rr"},
+    [$R_LOADK] = {"$R_LOADK", "rk"},
+    [$R_GET_UPVALUE] = {"$R_GET_UPVALUE", "ru"},
+    [$R_SET_UPVALUE] = {"$R_SET_UPVALUE", "ur"},
+    [$R_GET_GLOBAL] = {"$R_GET_GLOBAL", "rg"},
+    [$R_SET_GLOBAL] = {"$R_SET_GLOBAL", "dg"},
+    [$R_DEFINE_GLOBAL] = {"$R_DEFINE_GLOBAL", "dg"},
+    [$R_ADD] = {"$R_ADD", "rrr"},
+    [$R_SUBTRACT] = {"$R_SUBTRACT", "rrr"},
+    [$R_MULTIPLY] = {"$R_MULTIPLY", "rrr"},
+    [$R_DIVIDE] = {"$R_DIVIDE", "rrr"},
+    [$R_MOD] = {"$R_MOD", "rrr"},
+    [$R_POW] = {"$R_POW", "rrr"},
+    [$R_BW_LSHIFT] = {"$R_BW_LSHIFT", "rrr"},
+    [$R_BW_RSHIFT] = {"$R_BW_RSHIFT", "rrr"},
+    [$R_BW_AND] = {"$R_BW_AND", "rrr"},
+    [$R_BW_XOR] = {"$R_BW_XOR", "rrr"},
+    [$R_BW_OR] = {"$R_BW_OR", "rrr"},
+    [$R_ADDK] = {"$R_ADDK", "rrk"},
+    [$R_SUBTRACTK] = {"$R_SUBTRACTK", "rrk"},
+    [$R_NEGATE] = {"$R_NEGATE", "rr"},
+    [$R_NOT] = {"$R_NOT", "rr"},
+    [$R_BW_INVERT] = {"$R_BW_INVERT", "rr"},
+    [$R_EQ] = {"$R_EQ", "rrr"},
+    [$R_NOT_EQ] = {"$R_NOT_EQ", "rrr"},
+    [$R_LESS] = {"$R_LESS", "rrr"},
+    [$R_GREATER] = {"$R_GREATER", "rrr"},
+    [$R_LESS_OR_EQ] = {"$R_LESS_OR_EQ", "rrr"},
+    [$R_GREATER_OR_EQ] = {"$R_GREATER_OR_EQ", "rrr"},
+    [$R_JMP] = {"$R_JMP", "s"},
+    [$R_LOOP] = {"$R_LOOP", "ol"},
+    [$R_JMP_FALSE] = {"$R_JMP_FALSE", "rs"},
+    [$R_EQ_JMP] = {"$R_EQ_JMP", "rrrs"},
+    [$R_NOT_EQ_JMP] = {"$R_NOT_EQ_JMP", "rrrs"},
+    [$R_LESS_JMP] = {"$R_LESS_JMP", "rrrs"},
+    [$R_GREATER_JMP] = {"$R_GREATER_JMP", "rrrs"},
+    [$R_LESS_OR_EQ_JMP] = {"$R_LESS_OR_EQ_JMP", "rrrs"},
+    [$R_GREATER_OR_EQ_JMP] = {"$R_GREATER_OR_EQ_JMP", "rrrs"},
+    [$R_EQ_JMPK] = {"$R_EQ_JMPK", "rrks"},
+    [$R_NOT_EQ_JMPK] = {"$R_NOT_EQ_JMPK", "rrks"},
+    [$R_LESS_JMPK] = {"$R_LESS_JMPK", "rrks"},
+    [$R_GREATER_JMPK] = {"$R_GREATER_JMPK", "rrks"},
+    [$R_LESS_OR_EQ_JMPK] = {"$R_LESS_OR_EQ_JMPK", "rrks"},
+    [$R_GREATER_OR_EQ_JMPK] = {"$R_GREATER_OR_EQ_JMPK", "rrks"},
+    [$R_CALL] = {"$R_CALL", "dn"},
+    [$R_TAIL_CALL] = {"$R_TAIL_CALL", "dn"},
+    [$R_RET] = {"$R_RET", "r"},
+    [$R_ITER_PREP] = {"$R_ITER_PREP", "d"},
+    [$R_FOR_ITER] = {"$R_FOR_ITER", "ds"},
+    [$R_SUBSCRIPT] = {"$R_SUBSCRIPT", "d"},
+    [$R_SET_SUBSCRIPT] = {"$R_SET_SUBSCRIPT", "d"},
+    [$R_GET_FIELD] = {"$R_GET_FIELD", "dki"},
+    [$R_GET_PROPERTY] = {"$R_GET_PROPERTY", "dki"},
+    [$R_SET_PROPERTY] = {"$R_SET_PROPERTY", "dk"},
+    [$R_LEN] = {"$R_LEN", "dgn"},
+    [$R_TYPEOF] = {"$R_TYPEOF", "dgn"},
+    [$R_BUILD_LIST] = {"$R_BUILD_LIST", "dn"},
+    [$R_BUILD_MAP] = {"$R_BUILD_MAP", "dn"},
+    [$R_BUILD_CLOSURE] = {"$R_BUILD_CLOSURE", "dkc"},
+    [$R_BUILD_STRUCT] = {"$R_BUILD_STRUCT", "dkn"},
+    [$R_BUILD_INSTANCE] = {"$R_BUILD_INSTANCE", "dn"},
+    [$R_DISPLAY] = {"$R_DISPLAY", "dn"},
+    [$R_ASSERT] = {"$R_ASSERT", "d"},
+    [$R_THROW] = {"$R_THROW", "d"},
+    [$R_CLOSE_UPVALUE] = {"$R_CLOSE_UPVALUE", "r"},
+};
+
+int dis_reg_instruction(RegCode* reg, Code* code, int index) {
+  if (index > 0 && reg->lines[index] == reg->lines[index - 1]) {
+    printf("   |\t%04d\t", index);
+  } else {
+    printf("%4d\t%04d\t", reg->lines[index], index);
+  }
+  const RegInstruction* inst = &reg_instructions[reg->bytes[index]];
+  printf("%-20s", inst->name);
+  int offset = index + 1, operand;
+  for (char* c = inst->operands; *c; c++) {
+    switch (*c) {
+      case 'r':
+        printf(" r%d", reg->bytes[offset++]);
+        break;
+      case 'k':
+        printf(" k%d(", reg->bytes[offset]);
+        print_value(code->vpool.values[reg->bytes[offset++]]);
+        printf(")");
+        break;
+      case 'd':
+        printf(" @%d", reg->bytes[offset++]);
+        break;
+      case 'g':
+        printf(" g%d", reg->bytes[offset++]);
+        break;
+      case 'u':
+      case 'n':
+        printf(" %d", reg->bytes[offset++]);
+        break;
+      case 'i':
+      case 'o':
+      case 's':
+      case 'l':
+        operand = (reg->bytes[offset] << 8) | reg->bytes[offset + 1];
+        offset += 2;
+        if (*c == 'i') {
+          printf(" ic %d", operand);
+        } else if (*c == 'o') {
+          printf(" at %d", operand);
+        } else {
+          printf(" -> %d", *c == 's' ? offset + operand : offset - operand);
+        }
+        break;
+      case 'c': {
+        ObjFn* fn = AS_FUNC(code->vpool.values[reg->bytes[offset - 1]]);
+        for (int i = 0; i < fn->env_len; i++, offset += 2) {
+          printf(" (%d %d)", reg->bytes[offset], reg->bytes[offset + 1]);
+        }
+        break;
+      }
+      default:
+        UNREACHABLE("unknown operand kind");
+    }
+  }
+  printf("\n");
+  return offset;
+}
+
+void dis_reg_code(ObjFn* fn) {
+  printf(">>Register disassembly of %s<<\n", get_func_name(fn));
+  for (int i = 0; i < fn->reg.length;) {
+    i = dis_reg_instruction(&fn->reg, &fn->code, i);
+  }
+  dis_handlers(fn->reg.handlers, fn->reg.handler_count);
+}
+
+void dis_reg_functions(VM* vm, ObjFn* fn) {
+  // translate and disassemble `fn` and the functions it defines, innermost
+  // first
+  Value val;
+  for (int i = 0; i < fn->code.vpool.length; i++) {
+    val = fn->code.vpool.values[i];
+    if (IS_FUNC(val)) {
+      dis_reg_functions(vm, AS_FUNC(val));
+      printf("\n");
+    }
+  }
+  if (fn->reg.bytes || regen(vm, fn)) {
+    dis_reg_code(fn);
+  } else {
+    printf(
+        "%s: too large for the register engine, runs in run()\n",
+        get_func_name(fn));
+  }
+}
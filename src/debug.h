@@ -2,9 +2,14 @@
 #define EVE_DEBUG_H
 #include "value.h"
 
+char* op_name(int op);
 int plain_instruction(char* inst, int offset);
 int constant_instruction(char* inst, Code* code, int offset);
 int dis_instruction(Code* code, int index);
 void dis_code(Code* code, char* name);
+void dis_functions(Code* code);
+int dis_reg_instruction(RegCode* reg, Code* code, int index);
+void dis_reg_code(ObjFn* fn);
+void dis_reg_functions(VM* vm, ObjFn* fn);
 
 #endif  //EVE_DEBUG_H
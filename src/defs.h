@@ -10,6 +10,7 @@
 #ifdef EVE_DEBUG
   #define EVE_DEBUG_GC
   #define EVE_DEBUG_EXECUTION
+  #define EVE_DEBUG_CACHES
 #endif
 #ifdef EVE_DEBUG_GC
   #define EVE_DEBUG_STRESS_GC
@@ -26,10 +27,24 @@
 #define EVE_VERSION_PATCH 0
 #define EVE_VERSION \
   EXPAND_AND_QUOTE(EVE_VERSION_MAJOR.EVE_VERSION_MINOR.EVE_VERSION_PATCH)
+// serialized bytecode (.eco) format, bump on opcode or layout changes
+#define EVE_BYTECODE_VERSION 8
 
 // optimizations
 #define EVE_OPTIMIZE_IMPORTS
 
+// dispatch
+#if defined(EVE_COMPUTED_GOTO) && !defined(__GNUC__)
+  // labels-as-values is a GNU extension, fall back to switch dispatch
+  #undef EVE_COMPUTED_GOTO
+#endif
+
+// jit
+#if defined(EVE_JIT) && !(defined(__x86_64__) && defined(__linux__))
+  // the jit emits x86-64 code into mmap'd memory, --jit is a no-op elsewhere
+  #undef EVE_JIT
+#endif
+
 typedef struct VM VM;
 
 #endif  //EVE_DEFS_H
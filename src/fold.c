@@ -0,0 +1,337 @@
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "misc-no-recursion"
+#include "fold.h"
+
+#include <math.h>
+
+/*
+ * constant folding over a parsed program, ahead of compile().
+ * operators whose operands are all literals are evaluated here the way
+ * run() would evaluate them, and the node is rewritten in place into the
+ * literal it produces; an operation run() would throw on is left alone, so
+ * that it still throws, at run time. branches on a literal condition are
+ * decided too: `if` keeps only the block it would take, `while false`
+ * disappears, and `while true` loses its condition check. there is no
+ * algebra on non-literal operands beyond that, as `x + 0` or `x * 1` only
+ * hold for numbers, and run() rejects anything else.
+ */
+
+static AstNode* fold(AstNode* node);
+
+static bool is_literal(AstNode* node) {
+  return node->num.type == AST_NUM || node->num.type == AST_STR
+      || node->num.type == AST_UNIT;
+}
+
+static bool is_number(AstNode* node) {
+  return node->num.type == AST_NUM;
+}
+
+static bool truthy(AstNode* node) {
+  // the literal's truth as value_falsy() sees it
+  switch (node->num.type) {
+    case AST_NUM:
+      return !!node->num.value;
+    case AST_STR:
+      return node->str.length > 0;
+    default:
+      return node->unit.is_true_bool;
+  }
+}
+
+static bool literals_equal(AstNode* a, AstNode* b) {
+  // value_equal() of the literals: strings are interned, so equal contents
+  // make the same string
+  if (a->num.type != b->num.type) {
+    return false;
+  }
+  switch (a->num.type) {
+    case AST_NUM:
+      return a->num.value == b->num.value;
+    case AST_STR:
+      return a->str.length == b->str.length
+          && memcmp(a->str.start, b->str.start, a->str.length) == 0;
+    default:
+      return a->unit.is_none == b->unit.is_none
+          && a->unit.is_true_bool == b->unit.is_true_bool;
+  }
+}
+
+static void drop_literal(AstNode* node) {
+  // a folded away string no longer hands its unescaped copy to the vm
+  if (node->num.type == AST_STR && node->str.is_alloc) {
+    free(node->str.start);
+    node->str.is_alloc = false;
+    node->str.length = 0;
+  }
+}
+
+static AstNode* set_number(AstNode* node, double value, int line) {
+  node->num = (NumberNode) {.type = AST_NUM, .line = line, .value = value};
+  return node;
+}
+
+static AstNode* set_bool(AstNode* node, bool value, int line) {
+  node->unit = (UnitNode) {
+      .type = AST_UNIT,
+      .line = line,
+      .is_bool = true,
+      .is_none = false,
+      .is_true_bool = value,
+      .is_false_bool = !value};
+  return node;
+}
+
+static AstNode* fold_unary(AstNode* node) {
+  UnaryNode* unary = &node->unary;
+  AstNode* operand = unary->node = fold(unary->node);
+  if (!is_literal(operand)) {
+    return node;
+  }
+  switch (unary->op) {
+    case OP_PLUS:
+      // has no instruction
+      return operand;
+    case OP_NOT: {
+      bool res = !truthy(operand);
+      drop_literal(operand);
+      return set_bool(node, res, unary->line);
+    }
+    case OP_MINUS:
+      return is_number(operand)
+          ? set_number(node, -operand->num.value, unary->line)
+          : node;
+    case OP_BW_COMPL:
+      return is_number(operand)
+          ? set_number(
+              node,
+              (double)(~(int64_t)operand->num.value),
+              unary->line)
+          : node;
+    default:
+      return node;
+  }
+}
+
+static AstNode* fold_logical(AstNode* node) {
+  // x && y is x if x is falsy, else y; x || y is x if x is truthy, else y
+  BinaryNode* bin = &node->binary;
+  AstNode* left = bin->l_node = fold(bin->l_node);
+  bin->r_node = fold(bin->r_node);
+  if (!is_literal(left)) {
+    return node;
+  }
+  if (truthy(left) == (bin->op == OP_OR)) {
+    return left;
+  }
+  drop_literal(left);
+  return bin->r_node;
+}
+
+static AstNode* fold_numbers(AstNode* node, double x, double y) {
+  BinaryNode* bin = &node->binary;
+  int64_t i = (int64_t)x, j = (int64_t)y;
+  int line = bin->line;
+  switch (bin->op) {
+    case OP_PLUS:
+      return set_number(node, x + y, line);
+    case OP_MINUS:
+      return set_number(node, x - y, line);
+    case OP_MUL:
+      return set_number(node, x * y, line);
+    case OP_DIV:
+      return set_number(node, x / y, line);
+    case OP_MOD:
+      return set_number(node, fmod(x, y), line);
+    case OP_POW:
+      return set_number(node, pow(x, y), line);
+    case OP_LSHIFT:
+      return set_number(node, (double)(i << j), line);
+    case OP_RSHIFT:
+      return set_number(node, (double)(i >> j), line);
+    case OP_BW_AND:
+      return set_number(node, (double)(i & j), line);
+    case OP_BW_OR:
+      return set_number(node, (double)(i | j), line);
+    case OP_BW_XOR:
+      return set_number(node, (double)(i ^ j), line);
+    case OP_LESS:
+      return set_bool(node, x < y, line);
+    case OP_GRT:
+      return set_bool(node, x > y, line);
+    case OP_LESS_EQ:
+      return set_bool(node, x <= y, line);
+    case OP_GRT_EQ:
+      return set_bool(node, x >= y, line);
+    default:
+      return node;
+  }
+}
+
+static AstNode* fold_binary(AstNode* node) {
+  BinaryNode* bin = &node->binary;
+  if (bin->op == OP_AND || bin->op == OP_OR) {
+    return fold_logical(node);
+  } else if (bin->op == OP_DCOL || bin->op == OP_DOT) {
+    // the right side is a name
+    bin->l_node = fold(bin->l_node);
+    return node;
+  }
+  AstNode* left = bin->l_node = fold(bin->l_node);
+  AstNode* right = bin->r_node = fold(bin->r_node);
+  if (!is_literal(left) || !is_literal(right)) {
+    return node;
+  }
+  if (bin->op == OP_LOG_EQ || bin->op == OP_NOT_EQ) {
+    bool equal = literals_equal(left, right);
+    drop_literal(left);
+    drop_literal(right);
+    return set_bool(node, equal == (bin->op == OP_LOG_EQ), bin->line);
+  }
+  if (is_number(left) && is_number(right)) {
+    return fold_numbers(node, left->num.value, right->num.value);
+  }
+  return node;
+}
+
+static void fold_all(AstNode** nodes, int count) {
+  for (int i = 0; i < count; i++) {
+    nodes[i] = fold(nodes[i]);
+  }
+}
+
+static void fold_stmts(Vec* stmts) {
+  fold_all((AstNode**)stmts->items, stmts->len);
+}
+
+static AstNode* fold_if(AstNode* node) {
+  IfElseStmtNode* ife = &node->ife_stmt;
+  AstNode* cond = ife->condition = fold(ife->condition);
+  if (is_literal(cond)) {
+    AstNode* taken = truthy(cond) ? ife->if_block : ife->else_block;
+    drop_literal(cond);
+    return fold(taken);
+  }
+  if (cond->num.type == AST_UNARY && cond->unary.op == OP_NOT) {
+    // if !x {a} else {b} => if x {b} else {a}
+    AstNode* block = ife->if_block;
+    ife->condition = cond->unary.node;
+    ife->if_block = ife->else_block;
+    ife->else_block = block;
+  }
+  ife->if_block = fold(ife->if_block);
+  ife->else_block = fold(ife->else_block);
+  return node;
+}
+
+static AstNode* fold_while(AstNode* node) {
+  WhileStmtNode* wh = &node->while_stmt;
+  AstNode* cond = wh->condition = fold(wh->condition);
+  if (is_literal(cond)) {
+    bool loops = truthy(cond);
+    drop_literal(cond);
+    if (!loops) {
+      // an empty block in its place
+      int line = wh->line;
+      node->block_stmt =
+          (BlockStmtNode) {.type = AST_BLOCK_STMT, .line = line};
+      vec_init(&node->block_stmt.stmts);
+      return node;
+    }
+    wh->condition = NULL;
+  }
+  wh->block = fold(wh->block);
+  return node;
+}
+
+static AstNode* fold(AstNode* node) {
+  switch (node->num.type) {
+    case AST_UNARY:
+      return fold_unary(node);
+    case AST_BINARY:
+    case AST_DOT_EXPR:
+      return fold_binary(node);
+    case AST_ASSIGN:
+    case AST_VAR_DECL:
+      node->binary.l_node = fold(node->binary.l_node);
+      node->binary.r_node = fold(node->binary.r_node);
+      return node;
+    case AST_LIST:
+      fold_all(node->list.elems, node->list.len);
+      return node;
+    case AST_MAP:
+      for (int i = 0; i < node->map.length; i++) {
+        fold_all(node->map.items[i], 2);
+      }
+      return node;
+    case AST_SUBSCRIPT:
+      node->subscript.expr = fold(node->subscript.expr);
+      node->subscript.subscript = fold(node->subscript.subscript);
+      return node;
+    case AST_TRY:
+      node->try_h.try_expr = fold(node->try_h.try_expr);
+      if (node->try_h.else_expr) {
+        node->try_h.else_expr = fold(node->try_h.else_expr);
+      }
+      return node;
+    case AST_THROW:
+    case AST_EXPR_STMT:
+    case AST_RETURN_STMT:
+      node->expr_stmt.expr = fold(node->expr_stmt.expr);
+      return node;
+    case AST_SHOW_STMT:
+      fold_all(node->show_stmt.items, node->show_stmt.length);
+      return node;
+    case AST_ASSERT_STMT:
+      node->assert_stmt.test = fold(node->assert_stmt.test);
+      node->assert_stmt.msg = fold(node->assert_stmt.msg);
+      return node;
+    case AST_BLOCK_STMT:
+      fold_stmts(&node->block_stmt.stmts);
+      return node;
+    case AST_IF_STMT:
+      return fold_if(node);
+    case AST_WHILE_STMT:
+      return fold_while(node);
+    case AST_FOR_STMT:
+      node->for_stmt.iterable = fold(node->for_stmt.iterable);
+      if (node->for_stmt.stop) {
+        node->for_stmt.stop = fold(node->for_stmt.stop);
+      }
+      node->for_stmt.block = fold(node->for_stmt.block);
+      return node;
+    case AST_FUNC:
+      node->func.body = fold(node->func.body);
+      return node;
+    case AST_CALL:
+      node->call.left = fold(node->call.left);
+      fold_all(node->call.args, node->call.args_count);
+      return node;
+    case AST_STRUCT:
+      for (int i = 0; i < node->strukt.field_count; i++) {
+        StructMeta* meta = &node->strukt.fields[i];
+        if (meta->expr) {
+          meta->expr = fold(meta->expr);
+        }
+      }
+      return node;
+    case AST_STRUCT_CALL:
+      for (int i = 0; i < node->struct_call.fields.length; i++) {
+        AstNode** item = node->struct_call.fields.items[i];
+        item[1] = fold(item[1]);
+      }
+      return node;
+    case AST_PROGRAM:
+      fold_stmts(&node->program.decls);
+      return node;
+    default:
+      // literals, names and break/continue
+      return node;
+  }
+}
+
+AstNode* fold_constants(AstNode* node) {
+  return fold(node);
+}
+
+#pragma clang diagnostic pop
@@ -0,0 +1,6 @@
+#ifndef EVE_FOLD_H
+#define EVE_FOLD_H
+#include "ast.h"
+
+AstNode* fold_constants(AstNode* node);
+#endif  //EVE_FOLD_H
@@ -1,6 +1,7 @@
 #include "gc.h"
 
 #include "compiler.h"
+#include "jit.h"
 #include "map.h"
 #include "vm.h"
 
@@ -45,13 +46,20 @@ void free_object(VM* vm, Obj* obj) {
     case OBJ_FN: {
       ObjFn* func = (ObjFn*)obj;
       free_code(&func->code, vm);
+      free_reg_code(&func->reg, vm);
+      free(func->back_edges);
+#ifdef EVE_JIT
+      free_jit_code(&func->jit, vm);
+      free_traces(func, vm);
+#endif
       FREE(vm, func, ObjFn);
       break;
     }
     case OBJ_CLOSURE: {
       ObjClosure* closure = (ObjClosure*)obj;
-      FREE_BUFFER(vm, closure->env, ObjUpvalue*, closure->env_len);
-      FREE(vm, closure, ObjClosure);
+      size_t size =
+          sizeof(ObjClosure) + (sizeof(ObjUpvalue*) * closure->env_len);
+      FREE_FLEX(vm, closure, size);
       break;
     }
     case OBJ_UPVALUE: {
@@ -62,6 +70,7 @@ void free_object(VM* vm, Obj* obj) {
     case OBJ_STRUCT: {
       ObjStruct* st = (ObjStruct*)obj;
       FREE_BUFFER(vm, st->fields.entries, MapEntry, st->fields.capacity);
+      free_value_pool(&st->globals, vm);
       FREE(vm, obj, ObjStruct);
       break;
     }
@@ -74,6 +83,12 @@ void free_object(VM* vm, Obj* obj) {
     case OBJ_CFN:
       FREE(vm, obj, ObjCFn);
       break;
+    case OBJ_ITERATOR:
+      FREE(vm, obj, ObjIterator);
+      break;
+    case OBJ_RANGE:
+      FREE(vm, obj, ObjRange);
+      break;
   }
 }
 
@@ -152,14 +167,16 @@ void mark_roots(VM* vm) {
     mark_value(vm, *v);
   }
   // mark upvalue roots
-  for (ObjUpvalue* upvalue = vm->upvalues; upvalue != NULL;
-       upvalue = upvalue->next) {
-    mark_object(vm, &upvalue->obj);
+  for (int i = 0; i < vm->upvalue_count; i++) {
+    mark_object(vm, &vm->upvalues[i]->obj);
   }
   // mark call-frame roots
   for (int i = 0; i < vm->frame_count; i++) {
     mark_object(vm, &vm->frames[i].closure->obj);
   }
+  if (vm->recording_fn) {
+    mark_object(vm, &vm->recording_fn->obj);
+  }
   // mark modules roots
   mark_map(vm, &vm->modules);
   // mark current module
@@ -218,6 +235,9 @@ void blacken_object(VM* vm, Obj* obj) {
     case OBJ_STRUCT: {
       ObjStruct* strukt = (ObjStruct*)obj;
       mark_map(vm, &strukt->fields);
+      for (int i = 0; i < strukt->globals.length; i++) {
+        mark_value(vm, strukt->globals.values[i]);
+      }
       mark_object(vm, &strukt->name->obj);
       return;
     }
@@ -227,6 +247,10 @@ void blacken_object(VM* vm, Obj* obj) {
       mark_object(vm, &instance->strukt->obj);
       return;
     }
+    case OBJ_ITERATOR:
+      mark_object(vm, ((ObjIterator*)obj)->iterable);
+      return;
+    case OBJ_RANGE:
     case OBJ_CFN:
     case OBJ_STR:
       return;
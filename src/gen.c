@@ -1,20 +1,63 @@
 #include "gen.h"
 
+#include "vm.h"
+
 extern void compile_error(Compiler* compiler, char* fmt, ...);
 
 void emit_byte(Compiler* co, byte_t opcode, int line) {
   write_code(&co->func->code, opcode, line, co->vm);
 }
 
+void emit_operand(Compiler* co, int operand, bool wide, int line) {
+  if (wide) {
+    emit_byte(co, (operand >> 8) & 0xff, line);
+  }
+  emit_byte(co, operand & 0xff, line);
+}
+
+void emit_op(Compiler* co, byte_t opcode, int operand, int line) {
+  // an instruction with one operand, prefixed by $WIDE only if the operand
+  // doesn't fit a byte
+  bool wide = operand > UINT8_MAX;
+  if (wide) {
+    emit_byte(co, $WIDE, line);
+  }
+  emit_byte(co, opcode, line);
+  emit_operand(co, operand, wide, line);
+}
+
+int add_constant(Compiler* co, Value val) {
+  // the function's constant slot for `val`, shared by all its uses; -O0
+  // gives each use a slot of its own
+  ValuePool* vp = &co->func->code.vpool;
+  return co->vm->optimize ? intern_value(vp, val, co->vm)
+                          : write_value(vp, val, co->vm);
+}
+
 void emit_value(Compiler* co, byte_t opcode, Value val, int line) {
-  int index = write_value(&co->func->code.vpool, val, co->vm);
+  int index = add_constant(co, val);
   ASSERT_MAX(
       co,
       index,
-      CONST_MAX,
+      UINT16_MAX,
       "Too many constants. Maximum constant size exceeded");
-  emit_byte(co, opcode, line);
-  emit_byte(co, CAST(byte_t, index), line);
+  emit_op(co, opcode, index, line);
+}
+
+void emit_cache(Compiler* co, bool wide, int line) {
+  // reserve an inline cache for the instruction just emitted
+  int index = co->func->code.ic_count++;
+  ASSERT_MAX(
+      co,
+      index,
+      UINT16_MAX,
+      "Too many lookups. Maximum inline cache count exceeded");
+  if (wide) {
+    emit_byte(co, 0, line);
+    emit_byte(co, 0, line);
+  }
+  emit_byte(co, (index >> 8) & 0xff, line);
+  emit_byte(co, index & 0xff, line);
 }
 
 int emit_jump(Compiler* co, byte_t opcode, int line) {
@@ -26,32 +69,42 @@ int emit_jump(Compiler* co, byte_t opcode, int line) {
   return index;
 }
 
+void set_jump(Compiler* co, int offset, int target) {
+  // point the jump at `offset` to `target`. one that is too far for its
+  // 2-byte offset is recorded and widened by widen_jumps() once the code is
+  // complete, as widening moves the code after it.
+  Code* code = &co->func->code;
+  int end = offset + 3;  // the opcode and its 2 bytes offset operand
+  int jmp_offset =
+      code->bytes[offset] == $LOOP ? end - target : target - end;
+  if (jmp_offset > UINT16_MAX) {
+    if (co->far_count == co->far_capacity) {
+      int capacity = GROW_CAPACITY(co->far_capacity);
+      co->far_jumps = GROW_BUFFER(
+          co->vm,
+          co->far_jumps,
+          FarJump,
+          co->far_capacity,
+          capacity);
+      co->far_capacity = capacity;
+    }
+    co->far_jumps[co->far_count++] =
+        (FarJump) {.offset = offset, .target = target};
+    jmp_offset = 0;
+  }
+  code->bytes[end - 2] = (jmp_offset >> 8) & 0xff;
+  code->bytes[end - 1] = jmp_offset & 0xff;
+}
+
 void emit_loop(Compiler* co, int offset, int line) {
-  int jmp_offset = co->func->code.length - offset
-      + 3;  // +3 to include the opcode and its 2 bytes offset operand
-  ASSERT_MAX(
-      co,
-      jmp_offset,
-      UINT16_MAX,
-      "Code body too large to loop over: %d",
-      jmp_offset);
-  emit_byte(co, $LOOP, line);
-  emit_byte(co, (jmp_offset >> 8) & 0xff, line);
-  emit_byte(co, jmp_offset & 0xff, line);
+  int start = co->func->code.length;
+  emit_jump(co, $LOOP, line);
+  set_jump(co, start, offset);
 }
 
 void patch_jump(Compiler* co, int index) {
-  // calc how much we need to jump
-  int jmp_offset = co->func->code.length - index
-      - 2;  // -2 to exclude the 2-byte operand
-  ASSERT_MAX(
-      co,
-      jmp_offset,
-      UINT16_MAX,
-      "Code body too large to jump over: %d",
-      jmp_offset);
-  co->func->code.bytes[index++] = (jmp_offset >> 8) & 0xff;
-  co->func->code.bytes[index] = jmp_offset & 0xff;
+  // jump to the current end of the code, `index` is the jump's operand
+  set_jump(co, index - 1, co->func->code.length);
 }
 
 inline int last_line(Compiler* co) {
@@ -59,4 +112,783 @@ inline int last_line(Compiler* co) {
     return co->func->code.lines[co->func->code.length - 1];
   }
   return -1;
-}
\ No newline at end of file
+}
+
+int inst_operand(Code* code, int offset, int n) {
+  // the n-th operand of the instruction at `offset`: a byte, or two bytes
+  // under $WIDE
+  if (code->bytes[offset] == $WIDE) {
+    byte_t* operand = code->bytes + offset + 2 + n * 2;
+    return (operand[0] << 8) | operand[1];
+  }
+  return code->bytes[offset + 1 + n];
+}
+
+int inst_length(Code* code, int offset) {
+  switch (code->bytes[offset]) {
+    case $WIDE: {
+      if (code->bytes[offset + 1] == $BUILD_CLOSURE) {
+        Value fn = code->vpool.values[inst_operand(code, offset, 0)];
+        return 4 + AS_FUNC(fn)->env_len * 4;
+      }
+      // the prefix, then the instruction with its operand bytes doubled
+      return 2 + (inst_length(code, offset + 1) - 1) * 2;
+    }
+    case $GET_FIELD:
+    case $GET_PROPERTY:
+      return 4;  // name, 2-byte cache index
+    case $LEN:
+    case $TYPEOF:
+      return 3;  // `core`'s global slot, intrinsic
+    case $JMP:
+    case $JMP_FALSE:
+    case $JMP_FALSE_OR_POP:
+    case $LOOP:
+    case $FOR_ITER:
+    case $BUILD_STRUCT:
+    case $ADD_LOCALS:
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+      return 3;
+    case $BUILD_LIST:
+    case $BUILD_MAP:
+    case $BUILD_INSTANCE:
+    case $POP_N:
+    case $DISPLAY:
+    case $CALL:
+    case $TAIL_CALL:
+    case $LOAD_CONST:
+    case $DEFINE_GLOBAL:
+    case $GET_GLOBAL:
+    case $SET_GLOBAL:
+    case $GET_LOCAL:
+    case $SET_LOCAL:
+    case $GET_UPVALUE:
+    case $SET_UPVALUE:
+    case $SET_PROPERTY:
+    case $ADD_CONST:
+    case $SUBTRACT_CONST:
+    case $SET_LOCAL_POP:
+    case $RET_LOCAL:
+      return 2;
+    case $BUILD_CLOSURE: {
+      // fn-slot, then (index, is_local) per upvalue
+      ObjFn* fn = AS_FUNC(code->vpool.values[code->bytes[offset + 1]]);
+      return 2 + fn->env_len * 2;
+    }
+    default:
+      return 1;
+  }
+}
+
+byte_t generic_opcode(byte_t op) {
+  // undo run()'s quickening
+  switch (op) {
+    case $ADD_NUM:
+      return $ADD;
+    case $SUBTRACT_NUM:
+      return $SUBTRACT;
+    case $MULTIPLY_NUM:
+      return $MULTIPLY;
+    case $DIVIDE_NUM:
+      return $DIVIDE;
+    case $LESS_NUM:
+      return $LESS;
+    case $GREATER_NUM:
+      return $GREATER;
+    case $LESS_OR_EQ_NUM:
+      return $LESS_OR_EQ;
+    case $GREATER_OR_EQ_NUM:
+      return $GREATER_OR_EQ;
+    default:
+      return op;
+  }
+}
+
+static int jump_sign(byte_t op) {
+  // direction of a jump instruction, 0 for other instructions
+  switch (op) {
+    case $LOOP:
+      return -1;
+    case $JMP:
+    case $JMP_FALSE:
+    case $JMP_FALSE_OR_POP:
+    case $FOR_ITER:
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+int jump_target(Code* code, int offset) {
+  // all jumps carry a 2-byte offset (4 under $WIDE) as their last operand,
+  // relative to the end of the instruction
+  bool wide = code->bytes[offset] == $WIDE;
+  int sign = jump_sign(code->bytes[offset + wide]);
+  if (!sign) {
+    return -1;
+  }
+  int end = offset + inst_length(code, offset);
+  int jmp_offset = 0;
+  for (int i = end - (wide ? 4 : 2); i < end; i++) {
+    jmp_offset = (jmp_offset << 8) | code->bytes[i];
+  }
+  return end + jmp_offset * sign;
+}
+
+void patch_target(Code* code, int offset, int target) {
+  // re-point the jump at `offset` to `target`, which must be in its reach
+  bool wide = code->bytes[offset] == $WIDE;
+  int end = offset + inst_length(code, offset);
+  int jmp_offset = (target - end) * jump_sign(code->bytes[offset + wide]);
+  for (int i = end - 1; i >= end - (wide ? 4 : 2); i--) {
+    code->bytes[i] = jmp_offset & 0xff;
+    jmp_offset >>= 8;
+  }
+}
+
+void widen_jumps(Compiler* co) {
+  /*
+   * rebuild the code with a $WIDE prefix on every jump whose offset doesn't
+   * fit 2 bytes. widening moves the code after it, which may push other
+   * jumps out of reach too, so the layout is redone until no more jumps
+   * need widening.
+   */
+  if (!co->far_count) {
+    return;
+  }
+  Code* code = &co->func->code;
+  int len = code->length;
+  int* targets = ALLOC(co->vm, int, len);
+  int* offsets = ALLOC(co->vm, int, len + 1);
+  bool* wide = ALLOC(co->vm, bool, len);
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    targets[i] = jump_target(code, i);
+    wide[i] = false;
+  }
+  for (int i = 0; i < co->far_count; i++) {
+    targets[co->far_jumps[i].offset] = co->far_jumps[i].target;
+    wide[co->far_jumps[i].offset] = true;
+  }
+  int n;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    n = 0;
+    for (int i = 0; i < len; i += inst_length(code, i)) {
+      offsets[i] = n;
+      n += inst_length(code, i) + (wide[i] ? 3 : 0);  // $WIDE, 2 more bytes
+    }
+    offsets[len] = n;
+    for (int i = 0; i < len; i += inst_length(code, i)) {
+      if (targets[i] == -1 || wide[i]) {
+        continue;
+      }
+      int jmp_offset = (offsets[targets[i]] - (offsets[i] + 3))
+          * jump_sign(code->bytes[i]);
+      if (jmp_offset > UINT16_MAX) {
+        wide[i] = changed = true;
+      }
+    }
+  }
+  byte_t* bytes = ALLOC(co->vm, byte_t, n);
+  int* lines = ALLOC(co->vm, int, n);
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    int at = offsets[i], size = inst_length(code, i);
+    if (wide[i]) {
+      bytes[at] = $WIDE;
+      bytes[at + 1] = code->bytes[i];
+      size = 6;
+    } else {
+      memcpy(bytes + at, code->bytes + i, size);
+    }
+    for (int j = 0; j < size; j++) {
+      lines[at + j] = code->lines[i];
+    }
+  }
+  for (int i = 0; i < code->handler_count; i++) {
+    Handler* handler = &code->handlers[i];
+    handler->start = offsets[handler->start];
+    handler->end = offsets[handler->end];
+    handler->target = offsets[handler->target];
+  }
+  // re-point all jumps, in the new code
+  Code widened = *code;
+  widened.bytes = bytes;
+  widened.length = n;
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    if (targets[i] != -1) {
+      patch_target(&widened, offsets[i], offsets[targets[i]]);
+    }
+  }
+  FREE_BUFFER(co->vm, code->bytes, byte_t, code->capacity);
+  FREE_BUFFER(co->vm, code->lines, int, code->capacity);
+  code->bytes = bytes;
+  code->lines = lines;
+  code->length = code->capacity = n;
+  FREE_BUFFER(co->vm, targets, int, len);
+  FREE_BUFFER(co->vm, offsets, int, len + 1);
+  FREE_BUFFER(co->vm, wide, bool, len);
+  FREE_BUFFER(co->vm, co->far_jumps, FarJump, co->far_capacity);
+  co->far_jumps = NULL;
+  co->far_count = co->far_capacity = 0;
+}
+
+static int stack_effect(Code* code, int offset, int* jump, bool* live) {
+  // net stack effect of the instruction at `offset` on fall-through; a jump
+  // also stores its effect when taken in `jump`, and code after a jump that
+  // is always taken isn't `live`
+  byte_t* ip = code->bytes + offset;
+  switch (generic_opcode(ip[*ip == $WIDE])) {
+    case $LOAD_CONST:
+    case $GET_LOCAL:
+    case $GET_UPVALUE:
+    case $GET_GLOBAL:
+    case $ADD_LOCALS:
+    case $BUILD_CLOSURE:
+    case $ITER_PREP:
+      return 1;
+    case $POP:
+    case $SET_LOCAL_POP:
+    case $DEFINE_GLOBAL:
+    case $SUBSCRIPT:
+    case $SET_PROPERTY:
+    case $CLOSE_UPVALUE:
+    case $ADD:
+    case $SUBTRACT:
+    case $MULTIPLY:
+    case $DIVIDE:
+    case $MOD:
+    case $POW:
+    case $BW_LSHIFT:
+    case $BW_RSHIFT:
+    case $BW_AND:
+    case $BW_XOR:
+    case $BW_OR:
+    case $EQ:
+    case $NOT_EQ:
+    case $LESS:
+    case $GREATER:
+    case $LESS_OR_EQ:
+    case $GREATER_OR_EQ:
+      return -1;
+    case $SET_SUBSCRIPT:
+    case $ASSERT:
+      return -2;
+    case $POP_N:
+    case $DISPLAY:
+    case $CALL:
+    case $TAIL_CALL:
+      return -inst_operand(code, offset, 0);
+    case $BUILD_LIST:
+      return 1 - inst_operand(code, offset, 0);
+    case $BUILD_MAP:
+      return 1 - inst_operand(code, offset, 0) * 2;
+    case $BUILD_STRUCT:
+      return 1 - inst_operand(code, offset, 1) * 2;
+    case $BUILD_INSTANCE:
+      return -inst_operand(code, offset, 0) * 2;
+    case $JMP:
+      *jump = 0;
+      *live = false;
+      return 0;
+    case $JMP_FALSE:
+      *jump = 0;
+      return 0;
+    case $JMP_FALSE_OR_POP:
+      *jump = 0;
+      return -1;
+    case $FOR_ITER:
+      // pushes the next element, if it doesn't jump
+      *jump = 0;
+      return 1;
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+      *jump = -1;
+      return -2;
+    case $RET_LOCAL:
+      *live = false;
+      return 1;
+    case $LOOP:
+    case $THROW:
+    case $RET:
+      *live = false;
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+int inst_effect(Code* code, int offset) {
+  // stack_effect() on fall-through
+  int jump;
+  bool live = true;
+  return stack_effect(code, offset, &jump, &live);
+}
+
+static void
+handlers_from(Code* code, int offset, int depth, int* depths, int* max) {
+  // the exception table's entries whose range starts at `offset` get its
+  // depth, and their handlers are entered with the error pushed on top
+  for (int i = 0; i < code->handler_count; i++) {
+    Handler* handler = &code->handlers[i];
+    if (handler->start == offset) {
+      handler->depth = depth;
+      depths[handler->target] = depth + 1;
+      *max = depth + 1 > *max ? depth + 1 : *max;
+    }
+  }
+}
+
+int stack_size(VM* vm, Code* code, int arity) {
+  /*
+   * the deepest the stack gets in a call, counting the callee and its
+   * arguments. a single forward pass, like regen(): depths are carried
+   * through fall-through code and recorded at the targets of forward
+   * jumps and of the exception table, which is where dead code following
+   * a jump picks up from. it also sets the exception table's depths.
+   */
+  int len = code->length;
+  int* depths = ALLOC(vm, int, len + 1);
+  for (int i = 0; i <= len; i++) {
+    depths[i] = -1;
+  }
+  int depth = arity + 1, max = depth, jump, target;
+  bool live = true;
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    if (!live) {
+      if (depths[i] == -1) {
+        continue;
+      }
+      live = true;
+      depth = depths[i];
+    }
+    handlers_from(code, i, depth, depths, &max);
+    jump = 0;
+    int effect = stack_effect(code, i, &jump, &live);
+    if ((target = jump_target(code, i)) > i && depths[target] == -1) {
+      depths[target] = depth + jump;
+      max = depth + jump > max ? depth + jump : max;
+    }
+    depth += effect;
+    max = depth > max ? depth : max;
+  }
+  FREE_BUFFER(vm, depths, int, len + 1);
+  return max;
+}
+
+static bool is_false_jump(byte_t op) {
+  return op == $JMP_FALSE || op == $JMP_FALSE_OR_POP;
+}
+
+static bool in_reach(Code* code, int offset, int target) {
+  // a narrow jump's 2-byte offset reaches `target`
+  if (code->bytes[offset] == $WIDE) {
+    return true;
+  }
+  int end = offset + 3;
+  return (target > offset ? target - end : end - target) <= UINT16_MAX;
+}
+
+static int thread_jump(Code* code, int offset) {
+  /*
+   * where the jump at `offset` ends up: through the $JMPs and $LOOPs it
+   * lands on, and for a jump taken on a falsy value, through the jumps on a
+   * falsy value it lands on, which are taken too. only $JMP can go either
+   * way (it becomes a $LOOP backwards); the others keep their direction.
+   */
+  byte_t op = code->bytes[offset + (code->bytes[offset] == $WIDE)];
+  int target = jump_target(code, offset), to = target;
+  for (int n = 0; n < code->length; n++) {
+    byte_t* at = code->bytes + to;
+    byte_t next_op = at[*at == $WIDE];
+    if (next_op != $JMP && next_op != $LOOP
+        && !(is_false_jump(op) && is_false_jump(next_op))) {
+      break;
+    }
+    int next = jump_target(code, to);
+    if (next == to) {
+      break;
+    }
+    to = next;
+    bool forward = to > offset;
+    if ((op == $JMP || forward == (op != $LOOP))
+        && in_reach(code, offset, to)) {
+      target = to;
+    }
+  }
+  return target;
+}
+
+static bool is_pure_push(byte_t* ip) {
+  // pushes a value and does nothing else
+  switch (ip[*ip == $WIDE]) {
+    case $LOAD_CONST:
+    case $GET_LOCAL:
+    case $GET_UPVALUE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool ends_block(byte_t* ip) {
+  switch (ip[*ip == $WIDE]) {
+    case $JMP:
+    case $LOOP:
+    case $RET:
+    case $THROW:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static void mark_live(Code* code, const int* targets, bool* live, int* work) {
+  // everything reachable from the instructions already in `work`
+  int count = 0;
+  for (int i = 0; i < code->length; i++) {
+    if (live[i]) {
+      work[count++] = i;
+    }
+  }
+  while (count) {
+    int i = work[--count];
+    int next = i + inst_length(code, i);
+    int succs[2] = {ends_block(code->bytes + i) ? -1 : next, targets[i]};
+    for (int j = 0; j < 2; j++) {
+      if (succs[j] >= 0 && succs[j] < code->length && !live[succs[j]]) {
+        live[succs[j]] = true;
+        work[count++] = succs[j];
+      }
+    }
+  }
+}
+
+void peephole(Compiler* co) {
+  /*
+   * cleans up after the compiler's one pass, on the final code:
+   * - jumps landing on jumps are threaded to where those go (see
+   *   thread_jump()), and a $JMP landing on a $RET becomes that $RET.
+   * - code nothing reaches is dropped: after a return, a throw, a break or
+   *   a jump that was threaded past it. an exception table entry covering
+   *   live code keeps its handler live; entries left covering nothing go.
+   * - a $JMP to the next instruction left is dropped.
+   * - a $POP of a value pushed just before by $LOAD_CONST, $GET_LOCAL or
+   *   $GET_UPVALUE drops both, one of a $NOT's result drops the $NOT, and
+   *   runs of $POP merge into a $POP_N. a $POP that is jumped to stays.
+   * the code is rebuilt as in fuse_code(), where each kept instruction keeps
+   * its bytes (operands of $BUILD_CLOSURE included) and its lines, and
+   * jumps are re-pointed once the layout is known. offsets only shrink, so
+   * jumps that reached their targets still do.
+   */
+  Code* code = &co->func->code;
+  int len = code->length;
+  int* targets = ALLOC(co->vm, int, len);
+  int* offsets = ALLOC(co->vm, int, len + 1);
+  int* work = ALLOC(co->vm, int, len);
+  int* starts = ALLOC(co->vm, int, len);  // of the instructions kept, in order
+  int* jumps = ALLOC(co->vm, int, len);  // new offset -> old jump target
+  bool* live = ALLOC(co->vm, bool, len + 1);
+  bool* labels = ALLOC(co->vm, bool, len + 1);
+  bool* kept_labels = ALLOC(co->vm, bool, len);  // by index into `starts`
+  bool* returns = ALLOC(co->vm, bool, len);  // $JMPs that become $RET
+  byte_t* bytes = ALLOC(co->vm, byte_t, len);
+  int* lines = ALLOC(co->vm, int, len);
+  memset(live, 0, sizeof(bool) * (len + 1));
+  memset(labels, 0, sizeof(bool) * (len + 1));
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    byte_t* ip = code->bytes + i;
+    targets[i] = jump_target(code, i);
+    if (targets[i] != -1) {
+      targets[i] = thread_jump(code, i);
+    }
+    // a $JMP to a $RET returns right away
+    returns[i] = ip[*ip == $WIDE] == $JMP && code->bytes[targets[i]] == $RET;
+    if (returns[i]) {
+      targets[i] = -1;
+    }
+  }
+  live[0] = len > 0;
+  bool changed = true;
+  while (changed) {
+    mark_live(code, targets, live, work);
+    changed = false;
+    for (int i = 0; i < code->handler_count; i++) {
+      Handler* handler = &code->handlers[i];
+      if (live[handler->target]) {
+        continue;
+      }
+      for (int j = handler->start; j < handler->end; j++) {
+        if (live[j]) {
+          live[handler->target] = changed = true;
+          break;
+        }
+      }
+    }
+  }
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    if (live[i] && targets[i] != -1) {
+      labels[targets[i]] = true;
+    }
+  }
+  for (int i = 0; i < code->handler_count; i++) {
+    labels[code->handlers[i].start] = true;
+    labels[code->handlers[i].end] = true;
+    labels[code->handlers[i].target] = true;
+  }
+  int n = 0, kept = 0;
+  for (int i = 0; i < len;) {
+    int size = inst_length(code, i), next = i + size;
+    byte_t* ip = code->bytes + i;
+    byte_t op = ip[*ip == $WIDE];
+    offsets[i] = n;
+    if (!live[i]) {
+      i = next;
+      continue;
+    }
+    if (op == $JMP && !returns[i]) {
+      int to = next;
+      while (to < len && !live[to]) {
+        to += inst_length(code, to);
+      }
+      if (to == targets[i]) {
+        i = next;
+        continue;
+      }
+    }
+    if (op == $POP && !labels[i]) {
+      bool label = false, dropped = false;
+      while (kept && !label) {
+        int prev = starts[kept - 1];
+        byte_t prev_op = bytes[prev];
+        if (prev_op == $NOT) {
+          // the $POP takes the $NOT's place, and its label
+          label = kept_labels[--kept];
+          n = prev;
+        } else if (is_pure_push(bytes + prev)) {
+          kept--;
+          n = prev;
+          dropped = true;
+          break;
+        } else if (prev_op == $POP) {
+          bytes[prev] = $POP_N;
+          bytes[n] = 2;
+          lines[n++] = code->lines[i];
+          dropped = true;
+          break;
+        } else if (prev_op == $POP_N && bytes[prev + 1] < UINT8_MAX) {
+          bytes[prev + 1]++;
+          dropped = true;
+          break;
+        } else {
+          break;
+        }
+      }
+      if (dropped) {
+        offsets[i] = n;
+        i = next;
+        continue;
+      }
+      kept_labels[kept] = label;
+    } else {
+      kept_labels[kept] = labels[i];
+    }
+    // $JMP and $LOOP go the way their target lies
+    if ((op == $JMP || op == $LOOP) && targets[i] != -1) {
+      ip[*ip == $WIDE] = targets[i] > i ? $JMP : $LOOP;
+    }
+    starts[kept++] = n;
+    jumps[n] = targets[i];
+    if (returns[i]) {
+      bytes[n] = $RET;
+      size = 1;
+    } else {
+      memcpy(bytes + n, ip, size);
+    }
+    for (int j = 0; j < size; j++) {
+      lines[n + j] = code->lines[i];
+    }
+    n += size;
+    i = next;
+  }
+  offsets[len] = n;
+  memcpy(code->bytes, bytes, n);
+  memcpy(code->lines, lines, sizeof(int) * n);
+  code->length = n;
+  for (int i = 0; i < kept; i++) {
+    if (jumps[starts[i]] != -1) {
+      patch_target(code, starts[i], offsets[jumps[starts[i]]]);
+    }
+  }
+  // re-point the exception table, without the entries that cover nothing
+  int handlers = 0;
+  for (int i = 0; i < code->handler_count; i++) {
+    Handler handler = code->handlers[i];
+    handler.start = offsets[handler.start];
+    handler.end = offsets[handler.end];
+    handler.target = offsets[handler.target];
+    if (handler.start < handler.end) {
+      code->handlers[handlers++] = handler;
+    }
+  }
+  code->handler_count = handlers;
+  FREE_BUFFER(co->vm, targets, int, len);
+  FREE_BUFFER(co->vm, offsets, int, len + 1);
+  FREE_BUFFER(co->vm, work, int, len);
+  FREE_BUFFER(co->vm, starts, int, len);
+  FREE_BUFFER(co->vm, jumps, int, len);
+  FREE_BUFFER(co->vm, live, bool, len + 1);
+  FREE_BUFFER(co->vm, labels, bool, len + 1);
+  FREE_BUFFER(co->vm, kept_labels, bool, len);
+  FREE_BUFFER(co->vm, returns, bool, len);
+  FREE_BUFFER(co->vm, bytes, byte_t, len);
+  FREE_BUFFER(co->vm, lines, int, len);
+}
+
+#define FUSION_MAX 3
+
+typedef struct {
+  byte_t fused;
+  int count;  // number of instructions replaced
+  int line_from;  // instruction whose line (and errors) the fused one takes
+  byte_t ops[FUSION_MAX];
+} Fusion;
+
+// the operands of a fused instruction are the operands of the instructions
+// it replaces, in order.
+static const Fusion fusions[] = {
+    {$ADD_LOCALS, 3, 2, {$GET_LOCAL, $GET_LOCAL, $ADD}},
+    {$RET_LOCAL, 2, 0, {$GET_LOCAL, $RET}},
+    {$ADD_CONST, 2, 1, {$LOAD_CONST, $ADD}},
+    {$SUBTRACT_CONST, 2, 1, {$LOAD_CONST, $SUBTRACT}},
+    {$LESS_JMP, 2, 0, {$LESS, $JMP_FALSE_OR_POP}},
+    {$GREATER_JMP, 2, 0, {$GREATER, $JMP_FALSE_OR_POP}},
+    {$LESS_OR_EQ_JMP, 2, 0, {$LESS_OR_EQ, $JMP_FALSE_OR_POP}},
+    {$GREATER_OR_EQ_JMP, 2, 0, {$GREATER_OR_EQ, $JMP_FALSE_OR_POP}},
+    {$EQ_JMP, 2, 0, {$EQ, $JMP_FALSE_OR_POP}},
+    {$NOT_EQ_JMP, 2, 0, {$NOT_EQ, $JMP_FALSE_OR_POP}},
+    {$SET_LOCAL_POP, 2, 0, {$SET_LOCAL, $POP}},
+};
+
+static const Fusion*
+match_fusion(Code* code, int offset, const bool* targets, int* at) {
+  const Fusion* fusion;
+  int pos;
+  for (int i = 0; i < sizeof(fusions) / sizeof(Fusion); i++) {
+    fusion = &fusions[i];
+    pos = offset;
+    int j = 0;
+    for (; j < fusion->count; j++) {
+      // a jump into the middle of the sequence prevents fusing it
+      if (pos >= code->length || (j > 0 && targets[pos])
+          || code->bytes[pos] != fusion->ops[j]) {
+        break;
+      }
+      at[j] = pos;
+      pos += inst_length(code, pos);
+    }
+    if (j == fusion->count) {
+      return fusion;
+    }
+  }
+  return NULL;
+}
+
+void fuse_code(Compiler* co) {
+  /*
+   * rewrite common instruction sequences into superinstructions.
+   * the code is rebuilt into a new buffer while recording where each old
+   * instruction ended up, then every jump is re-pointed at its old target's
+   * new offset. fused code is never longer, so offsets still fit.
+   */
+  Code* code = &co->func->code;
+  int len = code->length;
+  bool* targets = ALLOC(co->vm, bool, len + 1);
+  int* offsets = ALLOC(co->vm, int, len + 1);
+  int* jumps = ALLOC(co->vm, int, len);  // new offset -> old jump target
+  byte_t* bytes = ALLOC(co->vm, byte_t, len);
+  int* lines = ALLOC(co->vm, int, len);
+  memset(targets, 0, sizeof(bool) * (len + 1));
+  int target;
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    if ((target = jump_target(code, i)) != -1) {
+      targets[target] = true;
+    }
+  }
+  // nor may it cross the bounds of a try
+  for (int i = 0; i < code->handler_count; i++) {
+    targets[code->handlers[i].start] = true;
+    targets[code->handlers[i].end] = true;
+    targets[code->handlers[i].target] = true;
+  }
+  int at[FUSION_MAX] = {0};
+  int n = 0;
+  for (int i = 0; i < len;) {
+    const Fusion* fusion = match_fusion(code, i, targets, at);
+    int start = n;
+    jumps[start] = -1;
+    if (fusion) {
+      int line = code->lines[at[fusion->line_from]];
+      bytes[n] = fusion->fused;
+      lines[n++] = line;
+      for (int j = 0; j < fusion->count; j++) {
+        offsets[at[j]] = start;
+        if ((target = jump_target(code, at[j])) != -1) {
+          jumps[start] = target;
+        }
+        int size = inst_length(code, at[j]);
+        for (int k = 1; k < size; k++) {
+          bytes[n] = code->bytes[at[j] + k];
+          lines[n++] = line;
+        }
+        i = at[j] + size;
+      }
+    } else {
+      offsets[i] = start;
+      jumps[start] = jump_target(code, i);
+      int size = inst_length(code, i);
+      memcpy(bytes + n, code->bytes + i, size);
+      memcpy(lines + n, code->lines + i, sizeof(int) * size);
+      n += size;
+      i += size;
+    }
+  }
+  offsets[len] = n;
+  memcpy(code->bytes, bytes, n);
+  memcpy(code->lines, lines, sizeof(int) * n);
+  code->length = n;
+  // re-point jumps, and the exception table
+  for (int i = 0; i < n; i += inst_length(code, i)) {
+    if (jumps[i] != -1) {
+      patch_target(code, i, offsets[jumps[i]]);
+    }
+  }
+  for (int i = 0; i < code->handler_count; i++) {
+    Handler* handler = &code->handlers[i];
+    handler->start = offsets[handler->start];
+    handler->end = offsets[handler->end];
+    handler->target = offsets[handler->target];
+  }
+  FREE_BUFFER(co->vm, targets, bool, len + 1);
+  FREE_BUFFER(co->vm, offsets, int, len + 1);
+  FREE_BUFFER(co->vm, jumps, int, len);
+  FREE_BUFFER(co->vm, bytes, byte_t, len);
+  FREE_BUFFER(co->vm, lines, int, len);
+}
+
+#undef FUSION_MAX
@@ -9,9 +9,24 @@
   }
 
 void emit_byte(Compiler* co, byte_t byte, int line);
+void emit_operand(Compiler* co, int operand, bool wide, int line);
+void emit_op(Compiler* co, byte_t opcode, int operand, int line);
+int add_constant(Compiler* co, Value val);
 void emit_value(Compiler* co, byte_t opcode, Value val, int line);
+void emit_cache(Compiler* co, bool wide, int line);
 int emit_jump(Compiler* co, byte_t opcode, int line);
+void set_jump(Compiler* co, int offset, int target);
 void patch_jump(Compiler* co, int index);
 void emit_loop(Compiler* co, int offset, int line);
 int last_line(Compiler* co);
+int inst_operand(Code* code, int offset, int n);
+int inst_length(Code* code, int offset);
+byte_t generic_opcode(byte_t op);
+int jump_target(Code* code, int offset);
+void patch_target(Code* code, int offset, int target);
+void widen_jumps(Compiler* co);
+int inst_effect(Code* code, int offset);
+int stack_size(VM* vm, Code* code, int arity);
+void peephole(Compiler* co);
+void fuse_code(Compiler* co);
 #endif  //EVE_GEN_H
@@ -0,0 +1,1198 @@
+#include "jit.h"
+
+#include "profile.h"
+
+#ifdef EVE_JIT
+  #include <stddef.h>
+  #include <sys/mman.h>
+
+/*
+ * baseline compiler from stack code (see gen.c) to x86-64 machine code, one
+ * template per instruction.
+ * the machine code runs a frame exactly like run() would, on the same value
+ * stack and frame layout: rbx holds the stack pointer, r12 the frame's
+ * slots, r13 the vm, r14 the frame and r15 the QNAN mask for number checks.
+ * numbers, locals, constants, upvalues and jumps are handled inline;
+ * everything else calls the slow paths in vm.c. a call runs a compiled
+ * callee's machine code nested on the C stack (see jit_call()), and its
+ * return comes back to the caller's; anything else that switches frames
+ * leaves the machine code with the frame's ip stored, and run() carries on
+ * from there.
+ */
+
+  #define RAX 0
+  #define RCX 1
+  #define RDX 2
+  #define RBX 3
+  #define RSI 6
+  #define RDI 7
+  #define R12 12
+  #define R13 13
+  #define R14 14
+  #define R15 15
+
+  #define SP RBX
+  #define SLOTS R12
+  #define VMR R13
+  #define FRAME R14
+  #define NAN_MASK R15
+
+  // condition codes
+  #define CC_P 0xa
+  #define CC_E 0x4
+  #define CC_NE 0x5
+  #define CC_AE 0x3
+  #define CC_A 0x7
+  #define CC_B 0x2
+  #define CC_BE 0x6
+
+  // sse2 scalar double opcodes
+  #define ADDSD 0x58
+  #define MULSD 0x59
+  #define SUBSD 0x5c
+  #define DIVSD 0x5e
+
+typedef JitStatus (*JitEntry)(VM* vm, CallFrame* frame, byte_t* target);
+
+typedef struct {
+  int at;  // position of a rel32 in the machine code
+  int target;  // stack code offset it jumps to
+} JitPatch;
+
+typedef struct {
+  int at;  // position of a rel32 in the machine code
+  int offset;  // stack code offset run() resumes at
+  int pop;  // values pushed since that instruction started
+} JitExit;
+
+typedef struct {
+  VM* vm;
+  ObjFn* fn;
+  Code* code;  // the function's
+  bool failed;
+  int length;
+  int capacity;
+  byte_t* bytes;
+  int* entries;
+  int exit;  // stores the frame's stack pointer and returns JIT_EXIT
+  int error;  // returns JIT_ERROR
+  int leave;  // returns the status in eax
+  int patch_count;
+  JitPatch* patches;
+  // traces only
+  int exit_count;
+  JitExit* exits;
+  int sp;  // stack depth along the trace
+  int limit;  // of the stack, the length of `known`
+  bool* known;  // stack slots known to hold numbers
+} Jit;
+
+static void emit(Jit* jit, byte_t byte) {
+  if (jit->length >= jit->capacity) {
+    int capacity = GROW_CAPACITY(jit->capacity);
+    jit->bytes =
+        GROW_BUFFER(jit->vm, jit->bytes, byte_t, jit->capacity, capacity);
+    jit->capacity = capacity;
+  }
+  jit->bytes[jit->length++] = byte;
+}
+
+static void emit32(Jit* jit, uint32_t value) {
+  for (int i = 0; i < 4; i++, value >>= 8) {
+    emit(jit, value & 0xff);
+  }
+}
+
+static void emit64(Jit* jit, uint64_t value) {
+  emit32(jit, value & 0xffffffff);
+  emit32(jit, value >> 32);
+}
+
+static void rex(Jit* jit, int reg, int rm) {
+  // 64-bit operand size, with the high bits of both register fields
+  emit(jit, 0x48 | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+}
+
+static void modrm(Jit* jit, int reg, int rm) {
+  emit(jit, 0xc0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void mem(Jit* jit, int reg, int base, int32_t disp) {
+  // [base + disp32], which needs a SIB byte for r12
+  emit(jit, 0x80 | ((reg & 7) << 3) | (base & 7));
+  if ((base & 7) == 4) {
+    emit(jit, 0x24);
+  }
+  emit32(jit, disp);
+}
+
+static void load(Jit* jit, int reg, int base, int32_t disp) {
+  rex(jit, reg, base);
+  emit(jit, 0x8b);
+  mem(jit, reg, base, disp);
+}
+
+static void store(Jit* jit, int base, int32_t disp, int reg) {
+  rex(jit, reg, base);
+  emit(jit, 0x89);
+  mem(jit, reg, base, disp);
+}
+
+static void alu(Jit* jit, byte_t op, int dst, int src) {
+  // op dst, src: 0x89 mov, 0x21 and, 0x39 cmp
+  rex(jit, src, dst);
+  emit(jit, op);
+  modrm(jit, src, dst);
+}
+
+static void alu_imm(Jit* jit, int ext, int dst, int32_t imm) {
+  // op dst, imm32: ext 0 add, 5 sub
+  rex(jit, 0, dst);
+  emit(jit, 0x81);
+  modrm(jit, ext, dst);
+  emit32(jit, imm);
+}
+
+  #define ADD_IMM(jit, dst, imm) alu_imm(jit, 0, dst, imm)
+  #define SUB_IMM(jit, dst, imm) alu_imm(jit, 5, dst, imm)
+
+static void mov_imm(Jit* jit, int reg, uint64_t imm) {
+  rex(jit, 0, reg);
+  emit(jit, 0xb8 + (reg & 7));
+  emit64(jit, imm);
+}
+
+static void movq_to_xmm(Jit* jit, int xmm, int reg) {
+  emit(jit, 0x66);
+  rex(jit, xmm, reg);
+  emit(jit, 0x0f);
+  emit(jit, 0x6e);
+  modrm(jit, xmm, reg);
+}
+
+static void movq_from_xmm(Jit* jit, int reg, int xmm) {
+  emit(jit, 0x66);
+  rex(jit, xmm, reg);
+  emit(jit, 0x0f);
+  emit(jit, 0x7e);
+  modrm(jit, xmm, reg);
+}
+
+static void sse(Jit* jit, byte_t prefix, byte_t op, int dst, int src) {
+  // xmm0-7 only
+  emit(jit, prefix);
+  emit(jit, 0x0f);
+  emit(jit, op);
+  modrm(jit, dst, src);
+}
+
+static void cmov(Jit* jit, byte_t cc, int dst, int src) {
+  rex(jit, dst, src);
+  emit(jit, 0x0f);
+  emit(jit, 0x40 | cc);
+  modrm(jit, dst, src);
+}
+
+static void cmp_eax(Jit* jit, byte_t imm) {
+  emit(jit, 0x83);
+  emit(jit, 0xf8);
+  emit(jit, imm);
+}
+
+static void test_al(Jit* jit) {
+  emit(jit, 0x84);
+  emit(jit, 0xc0);
+}
+
+static int jcc(Jit* jit, byte_t cc) {
+  // a forward conditional jump, returns its rel32 for land()
+  emit(jit, 0x0f);
+  emit(jit, 0x80 | cc);
+  emit32(jit, 0);
+  return jit->length - 4;
+}
+
+static int jmp(Jit* jit) {
+  emit(jit, 0xe9);
+  emit32(jit, 0);
+  return jit->length - 4;
+}
+
+static void set_rel(Jit* jit, int at, int target) {
+  uint32_t rel = target - (at + 4);
+  for (int i = 0; i < 4; i++, rel >>= 8) {
+    jit->bytes[at + i] = rel & 0xff;
+  }
+}
+
+static void land(Jit* jit, int at) {
+  // point the jump at `at` to the current position
+  set_rel(jit, at, jit->length);
+}
+
+static void jcc_to(Jit* jit, byte_t cc, int target) {
+  set_rel(jit, jcc(jit, cc), target);
+}
+
+static void jmp_to(Jit* jit, int target) {
+  set_rel(jit, jmp(jit), target);
+}
+
+static void jmp_code(Jit* jit, int cc, int target) {
+  // a jump to stack code offset `target`, patched once all are compiled;
+  // cc -1 for an unconditional one
+  int at = cc == -1 ? jmp(jit) : jcc(jit, cc);
+  if (jit->patch_count % 8 == 0) {
+    jit->patches = GROW_BUFFER(
+        jit->vm,
+        jit->patches,
+        JitPatch,
+        jit->patch_count,
+        jit->patch_count + 8);
+  }
+  jit->patches[jit->patch_count++] = (JitPatch) {at, target};
+}
+
+static void call(Jit* jit, void* fn) {
+  mov_imm(jit, RAX, (uintptr_t)fn);
+  emit(jit, 0xff);
+  emit(jit, 0xd0);  // call rax
+}
+
+  #define PUSH_RAX(jit) (store(jit, SP, 0, RAX), ADD_IMM(jit, SP, 8))
+
+static void count_at(Jit* jit, uint64_t* counter) {
+  mov_imm(jit, RAX, (uintptr_t)counter);
+  emit(jit, 0x48);
+  emit(jit, 0x83);
+  emit(jit, 0x00);
+  emit(jit, 0x01);  // add qword [rax], 1
+}
+
+static void push_value(Jit* jit, Value val) {
+  mov_imm(jit, RAX, val);
+  PUSH_RAX(jit);
+}
+
+static void sync(Jit* jit, byte_t* ip) {
+  // what run() does with STORE_STATE() before a slow path
+  store(jit, VMR, offsetof(VM, sp), SP);
+  mov_imm(jit, RAX, (uintptr_t)ip);
+  store(jit, FRAME, offsetof(CallFrame, ip), RAX);
+  alu(jit, 0x89, RDI, VMR);
+}
+
+static void slow_path(Jit* jit, void* fn, bool fallible) {
+  call(jit, fn);
+  load(jit, SP, VMR, offsetof(VM, sp));
+  if (fallible) {
+    test_al(jit);
+    jcc_to(jit, CC_E, jit->error);
+  }
+}
+
+static void call_template(Jit* jit, int argc, byte_t* next) {
+  // the frame and its stack may have moved while the callee ran
+  sync(jit, next);
+  mov_imm(jit, RSI, argc);
+  call(jit, jit_call);
+  load(jit, SP, VMR, offsetof(VM, sp));
+  cmp_eax(jit, JIT_RETURN);
+  int left = jcc(jit, CC_NE);
+  load(jit, FRAME, VMR, offsetof(VM, fp));
+  load(jit, SLOTS, FRAME, offsetof(CallFrame, stack));
+  int done = jmp(jit);
+  land(jit, left);
+  cmp_eax(jit, JIT_ERROR);
+  jcc_to(jit, CC_E, jit->error);
+  jmp_to(jit, jit->exit);
+  land(jit, done);
+}
+
+static void return_template(Jit* jit, byte_t* next) {
+  sync(jit, next);
+  call(jit, jit_return);
+  test_al(jit);
+  emit(jit, 0xb8);  // mov eax, JIT_RETURN
+  emit32(jit, JIT_RETURN);
+  emit(jit, 0xb9);  // mov ecx, JIT_DONE
+  emit32(jit, JIT_DONE);
+  cmov(jit, CC_E, RAX, RCX);
+  jmp_to(jit, jit->leave);
+}
+
+static void leave_at(Jit* jit, byte_t* ip) {
+  // run() continues the frame at `ip`
+  mov_imm(jit, RAX, (uintptr_t)ip);
+  store(jit, FRAME, offsetof(CallFrame, ip), RAX);
+  jmp_to(jit, jit->exit);
+}
+
+static int number_check(Jit* jit, int reg) {
+  // jumps away if `reg` isn't a number, returns the jump for land()
+  alu(jit, 0x89, RDX, reg);
+  alu(jit, 0x21, RDX, NAN_MASK);
+  alu(jit, 0x39, RDX, NAN_MASK);
+  return jcc(jit, CC_E);
+}
+
+static void binary_slow(Jit* jit, byte_t op, byte_t* next) {
+  sync(jit, next);
+  mov_imm(jit, RSI, op);
+  slow_path(jit, jit_binary, true);
+}
+
+static void arithmetic(Jit* jit, byte_t op, byte_t* next) {
+  // the two operands on top of the stack
+  byte_t sse_op = op == $ADD ? ADDSD
+      : op == $SUBTRACT      ? SUBSD
+      : op == $MULTIPLY      ? MULSD
+                             : DIVSD;
+  load(jit, RAX, SP, -16);
+  load(jit, RCX, SP, -8);
+  int slow_a = number_check(jit, RAX);
+  int slow_b = number_check(jit, RCX);
+  movq_to_xmm(jit, 0, RAX);
+  movq_to_xmm(jit, 1, RCX);
+  sse(jit, 0xf2, sse_op, 0, 1);
+  movq_from_xmm(jit, RAX, 0);
+  store(jit, SP, -16, RAX);
+  SUB_IMM(jit, SP, 8);
+  int done = jmp(jit);
+  land(jit, slow_a);
+  land(jit, slow_b);
+  binary_slow(jit, op, next);
+  land(jit, done);
+}
+
+static void comparison(Jit* jit, byte_t op, byte_t* next) {
+  load(jit, RAX, SP, -16);
+  load(jit, RCX, SP, -8);
+  int slow_a = number_check(jit, RAX);
+  int slow_b = number_check(jit, RCX);
+  movq_to_xmm(jit, 0, RAX);
+  movq_to_xmm(jit, 1, RCX);
+  // unordered (NaN) compares set CF, so `above` variants are false for it
+  if (op == $LESS || op == $LESS_OR_EQ) {
+    sse(jit, 0x66, 0x2e, 1, 0);  // ucomisd xmm1, xmm0
+  } else {
+    sse(jit, 0x66, 0x2e, 0, 1);  // ucomisd xmm0, xmm1
+  }
+  mov_imm(jit, RAX, FALSE_VAL);
+  mov_imm(jit, RCX, TRUE_VAL);
+  cmov(jit, op == $LESS || op == $GREATER ? CC_A : CC_AE, RAX, RCX);
+  store(jit, SP, -16, RAX);
+  SUB_IMM(jit, SP, 8);
+  int done = jmp(jit);
+  land(jit, slow_a);
+  land(jit, slow_b);
+  binary_slow(jit, op, next);
+  land(jit, done);
+}
+
+static void equality_test(Jit* jit, bool equal) {
+  // value_equal() of the two values on top of the stack, as a bool in rax:
+  // numerically for numbers, by bits otherwise
+  Value yes = equal ? TRUE_VAL : FALSE_VAL, no = equal ? FALSE_VAL : TRUE_VAL;
+  load(jit, RAX, SP, -16);
+  load(jit, RCX, SP, -8);
+  int bits_a = number_check(jit, RAX);
+  int bits_b = number_check(jit, RCX);
+  movq_to_xmm(jit, 0, RAX);
+  movq_to_xmm(jit, 1, RCX);
+  sse(jit, 0x66, 0x2e, 0, 1);  // ucomisd xmm0, xmm1
+  mov_imm(jit, RAX, no);
+  int unordered = jcc(jit, CC_P);
+  int differ = jcc(jit, CC_NE);
+  int same = jmp(jit);
+  land(jit, bits_a);
+  land(jit, bits_b);
+  alu(jit, 0x39, RAX, RCX);
+  mov_imm(jit, RAX, no);
+  int differ_bits = jcc(jit, CC_NE);
+  land(jit, same);
+  mov_imm(jit, RAX, yes);
+  land(jit, unordered);
+  land(jit, differ);
+  land(jit, differ_bits);
+}
+
+static void equality(Jit* jit, bool equal) {
+  equality_test(jit, equal);
+  store(jit, SP, -16, RAX);
+  SUB_IMM(jit, SP, 8);
+}
+
+static int falsy_check(Jit* jit) {
+  // tests the top of the stack (in rax), jumps away if it's falsy and
+  // returns the jump. booleans are told apart inline.
+  load(jit, RAX, SP, -8);
+  mov_imm(jit, RCX, TRUE_VAL);
+  alu(jit, 0x39, RAX, RCX);
+  int truthy = jcc(jit, CC_E);
+  mov_imm(jit, RCX, FALSE_VAL);
+  alu(jit, 0x39, RAX, RCX);
+  int falsy = jcc(jit, CC_E);
+  alu(jit, 0x89, RDI, RAX);
+  call(jit, jit_falsy);
+  test_al(jit);
+  int falsy_too = jcc(jit, CC_NE);
+  land(jit, truthy);
+  int skip = jmp(jit);
+  land(jit, falsy);
+  land(jit, falsy_too);
+  int away = jmp(jit);
+  land(jit, skip);
+  return away;
+}
+
+static void jump_false(Jit* jit, int target, bool pop) {
+  // $JMP_FALSE, or $JMP_FALSE_OR_POP if `pop`
+  int falsy = falsy_check(jit);
+  if (pop) {
+    SUB_IMM(jit, SP, 8);
+  }
+  int done = jmp(jit);
+  land(jit, falsy);
+  jmp_code(jit, -1, target);
+  land(jit, done);
+}
+
+static byte_t compare_op(byte_t fused) {
+  // the comparison a fused compare-and-jump starts with
+  switch (fused) {
+    case $LESS_JMP:
+      return $LESS;
+    case $GREATER_JMP:
+      return $GREATER;
+    case $LESS_OR_EQ_JMP:
+      return $LESS_OR_EQ;
+    default:
+      return $GREATER_OR_EQ;
+  }
+}
+
+static void upvalue_location(Jit* jit, int index) {
+  // rax = frame->closure->env[index]->location
+  load(jit, RAX, FRAME, offsetof(CallFrame, closure));
+  load(
+      jit,
+      RAX,
+      RAX,
+      (int)(offsetof(ObjClosure, env) + index * sizeof(ObjUpvalue*)));
+  load(jit, RAX, RAX, offsetof(ObjUpvalue, location));
+}
+
+static void translate(Jit* jit, int i) {
+  Code* code = jit->code;
+  byte_t* ip = code->bytes + i;
+  byte_t* next = ip + inst_length(code, i);
+  Value* consts = code->vpool.values;
+  int target = jump_target(code, i);
+  byte_t op = generic_opcode(*ip);
+  switch (op) {
+    case $LOAD_CONST:
+      push_value(jit, consts[ip[1]]);
+      break;
+    case $GET_LOCAL:
+      load(jit, RAX, SLOTS, ip[1] * 8);
+      PUSH_RAX(jit);
+      break;
+    case $SET_LOCAL:
+      load(jit, RAX, SP, -8);
+      store(jit, SLOTS, ip[1] * 8, RAX);
+      break;
+    case $SET_LOCAL_POP:
+      load(jit, RAX, SP, -8);
+      store(jit, SLOTS, ip[1] * 8, RAX);
+      SUB_IMM(jit, SP, 8);
+      break;
+    case $GET_UPVALUE:
+      upvalue_location(jit, ip[1]);
+      load(jit, RAX, RAX, 0);
+      PUSH_RAX(jit);
+      break;
+    case $SET_UPVALUE:
+      upvalue_location(jit, ip[1]);
+      load(jit, RCX, SP, -8);
+      store(jit, RAX, 0, RCX);
+      break;
+    case $POP:
+      SUB_IMM(jit, SP, 8);
+      break;
+    case $POP_N:
+      SUB_IMM(jit, SP, ip[1] * 8);
+      break;
+    case $ADD:
+    case $SUBTRACT:
+    case $MULTIPLY:
+    case $DIVIDE:
+      arithmetic(jit, op, next);
+      break;
+    case $ADD_LOCALS:
+      load(jit, RAX, SLOTS, ip[1] * 8);
+      PUSH_RAX(jit);
+      load(jit, RAX, SLOTS, ip[2] * 8);
+      PUSH_RAX(jit);
+      arithmetic(jit, $ADD, next);
+      break;
+    case $ADD_CONST:
+    case $SUBTRACT_CONST:
+      push_value(jit, consts[ip[1]]);
+      arithmetic(jit, op == $ADD_CONST ? $ADD : $SUBTRACT, next);
+      break;
+    case $LESS:
+    case $GREATER:
+    case $LESS_OR_EQ:
+    case $GREATER_OR_EQ:
+      comparison(jit, op, next);
+      break;
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+      comparison(jit, compare_op(op), next);
+      jump_false(jit, target, true);
+      break;
+    case $EQ:
+    case $NOT_EQ:
+      equality(jit, op == $EQ);
+      break;
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+      equality(jit, op == $EQ_JMP);
+      jump_false(jit, target, true);
+      break;
+    case $MOD:
+    case $POW:
+    case $BW_LSHIFT:
+    case $BW_RSHIFT:
+    case $BW_AND:
+    case $BW_OR:
+    case $BW_XOR:
+      binary_slow(jit, op, next);
+      break;
+    case $NEGATE:
+    case $BW_INVERT:
+      sync(jit, next);
+      mov_imm(jit, RSI, op);
+      slow_path(jit, jit_unary, true);
+      break;
+    case $NOT:
+      load(jit, RDI, SP, -8);
+      call(jit, jit_falsy);
+      test_al(jit);
+      mov_imm(jit, RAX, FALSE_VAL);
+      mov_imm(jit, RCX, TRUE_VAL);
+      cmov(jit, CC_NE, RAX, RCX);
+      store(jit, SP, -8, RAX);
+      break;
+    case $JMP:
+      jmp_code(jit, -1, target);
+      break;
+    case $LOOP:
+#ifdef EVE_PROFILE
+      count_at(jit, back_edges(jit->fn, i));
+#endif
+      jmp_code(jit, -1, target);
+      break;
+    case $JMP_FALSE:
+    case $JMP_FALSE_OR_POP:
+      jump_false(jit, target, op == $JMP_FALSE_OR_POP);
+      break;
+    case $DEFINE_GLOBAL:
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      slow_path(jit, jit_define_global, false);
+      break;
+    case $GET_GLOBAL:
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      slow_path(jit, jit_get_global, true);
+      break;
+    case $SET_GLOBAL:
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      slow_path(jit, jit_set_global, true);
+      break;
+    case $GET_FIELD:
+    case $GET_PROPERTY:
+      sync(jit, next);
+      mov_imm(jit, RSI, consts[ip[1]]);
+      mov_imm(jit, RDX, (uintptr_t)&code->caches[(ip[2] << 8) | ip[3]]);
+      slow_path(
+          jit,
+          op == $GET_FIELD ? (void*)jit_get_field : (void*)jit_get_property,
+          true);
+      break;
+    case $SET_PROPERTY:
+      sync(jit, next);
+      mov_imm(jit, RSI, consts[ip[1]]);
+      slow_path(jit, jit_set_property, true);
+      break;
+    case $LEN:
+    case $TYPEOF: {
+      // with `core` shadowed, run() makes the call
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      call(jit, jit_is_core);
+      test_al(jit);
+      int core = jcc(jit, CC_NE);
+      leave_at(jit, ip);
+      land(jit, core);
+      alu(jit, 0x89, RDI, VMR);
+      mov_imm(jit, RSI, ip[2]);
+      slow_path(jit, jit_intrinsic, true);
+      break;
+    }
+    case $ITER_PREP: {
+      sync(jit, next);
+      call(jit, jit_iter_prep);
+      load(jit, SP, VMR, offsetof(VM, sp));
+      test_al(jit);
+      int native = jcc(jit, CC_NE);
+      leave_at(jit, ip);
+      land(jit, native);
+      break;
+    }
+    case $FOR_ITER: {
+      // 0 when exhausted, -1 for a user-defined iterator
+      sync(jit, next);
+      call(jit, jit_for_iter);
+      load(jit, SP, VMR, offsetof(VM, sp));
+      cmp_eax(jit, 0);
+      jmp_code(jit, CC_E, target);
+      cmp_eax(jit, 1);
+      int native = jcc(jit, CC_E);
+      leave_at(jit, ip);
+      land(jit, native);
+      break;
+    }
+    case $SUBSCRIPT:
+      sync(jit, next);
+      slow_path(jit, jit_subscript, true);
+      break;
+    case $SET_SUBSCRIPT:
+      sync(jit, next);
+      slow_path(jit, jit_set_subscript, true);
+      break;
+    case $BUILD_LIST:
+    case $BUILD_MAP:
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      slow_path(
+          jit,
+          op == $BUILD_LIST ? (void*)jit_build_list : (void*)jit_build_map,
+          false);
+      break;
+    case $BUILD_INSTANCE:
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      slow_path(jit, jit_build_instance, true);
+      break;
+    case $BUILD_STRUCT:
+      sync(jit, next);
+      mov_imm(jit, RSI, (uintptr_t)AS_STRING(consts[ip[1]]));
+      mov_imm(jit, RDX, ip[2]);
+      slow_path(jit, jit_build_struct, true);
+      break;
+    case $BUILD_CLOSURE:
+      sync(jit, next);
+      mov_imm(jit, RSI, (uintptr_t)AS_FUNC(consts[ip[1]]));
+      mov_imm(jit, RDX, (uintptr_t)(ip + 2));
+      slow_path(jit, jit_build_closure, false);
+      break;
+    case $DISPLAY:
+      sync(jit, next);
+      mov_imm(jit, RSI, ip[1]);
+      slow_path(jit, jit_display, false);
+      break;
+    case $ASSERT:
+      sync(jit, next);
+      slow_path(jit, jit_assert, true);
+      break;
+    case $THROW:
+      sync(jit, next);
+      slow_path(jit, jit_throw, true);
+      break;
+    case $CLOSE_UPVALUE:
+      sync(jit, next);
+      slow_path(jit, jit_close_upvalue, false);
+      break;
+    case $CALL:
+      call_template(jit, ip[1], next);
+      break;
+    case $RET_LOCAL:
+      load(jit, RAX, SLOTS, ip[1] * 8);
+      PUSH_RAX(jit);
+      return_template(jit, next);
+      break;
+    case $RET:
+      return_template(jit, next);
+      break;
+    case $TAIL_CALL:
+      // replaces the frame's function, left to run()
+      leave_at(jit, ip);
+      break;
+    default:
+      // $WIDE: operands past a byte aren't compiled
+      jit->failed = true;
+      break;
+  }
+}
+
+static void prologue(Jit* jit) {
+  // JitEntry: save the callee-saved registers (which also aligns the stack
+  // for calls), load the frame's state and jump to `target`
+  static const byte_t pushes[] = {0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56,
+                                  0x41, 0x57};
+  for (int i = 0; i < (int)sizeof(pushes); i++) {
+    emit(jit, pushes[i]);
+  }
+  alu(jit, 0x89, VMR, RDI);
+  alu(jit, 0x89, FRAME, RSI);
+  load(jit, SLOTS, FRAME, offsetof(CallFrame, stack));
+  load(jit, SP, VMR, offsetof(VM, sp));
+  mov_imm(jit, NAN_MASK, QNAN);
+  emit(jit, 0xff);
+  emit(jit, 0xe2);  // jmp rdx
+  static const byte_t pops[] = {0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41,
+                                0x5c, 0x5b, 0xc3};
+  jit->exit = jit->length;
+  store(jit, VMR, offsetof(VM, sp), SP);
+  emit(jit, 0xb8);  // mov eax, JIT_EXIT
+  emit32(jit, JIT_EXIT);
+  int leave = jmp(jit);
+  jit->error = jit->length;
+  emit(jit, 0xb8);  // mov eax, JIT_ERROR
+  emit32(jit, JIT_ERROR);
+  land(jit, leave);
+  jit->leave = jit->length;
+  for (int i = 0; i < (int)sizeof(pops); i++) {
+    emit(jit, pops[i]);
+  }
+}
+
+static Jit new_jit(VM* vm, ObjFn* fn) {
+  Jit jit = {
+      .vm = vm,
+      .fn = fn,
+      .code = &fn->code,
+      .failed = false,
+      .length = 0,
+      .capacity = 0,
+      .bytes = NULL,
+      .entries = NULL,
+      .patch_count = 0,
+      .patches = NULL,
+      .exit_count = 0,
+      .exits = NULL,
+      .sp = 0,
+      .limit = 0,
+      .known = NULL};
+  return jit;
+}
+
+static byte_t* install(Jit* jit) {
+  // copy the machine code into executable memory and free the buffers,
+  // returns NULL if it failed
+  byte_t* bytes = MAP_FAILED;
+  if (!jit->failed) {
+    bytes = mmap(
+        NULL,
+        jit->length,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,
+        -1,
+        0);
+  }
+  if (bytes != MAP_FAILED) {
+    memcpy(bytes, jit->bytes, jit->length);
+    if (mprotect(bytes, jit->length, PROT_READ | PROT_EXEC) != 0) {
+      munmap(bytes, jit->length);
+      bytes = MAP_FAILED;
+    }
+  }
+  VM* vm = jit->vm;
+  FREE_BUFFER(vm, jit->bytes, byte_t, jit->capacity);
+  FREE_BUFFER(vm, jit->patches, JitPatch, (jit->patch_count + 7) / 8 * 8);
+  FREE_BUFFER(vm, jit->exits, JitExit, (jit->exit_count + 7) / 8 * 8);
+  return bytes == MAP_FAILED ? NULL : bytes;
+}
+
+bool jit_compile(VM* vm, ObjFn* fn) {
+  Code* code = &fn->code;
+  int len = code->length;
+  Jit jit = new_jit(vm, fn);
+  jit.entries = ALLOC(vm, int, len);
+  for (int i = 0; i < len; i++) {
+    jit.entries[i] = -1;
+  }
+  prologue(&jit);
+  for (int i = 0; i < len && !jit.failed; i += inst_length(code, i)) {
+    jit.entries[i] = jit.length;
+    translate(&jit, i);
+  }
+  for (int i = 0; i < jit.patch_count && !jit.failed; i++) {
+    int target = jit.entries[jit.patches[i].target];
+    set_rel(&jit, jit.patches[i].at, target);
+    jit.failed = target == -1;
+  }
+  size_t size = jit.length;
+  if (!(fn->jit.bytes = install(&jit))) {
+    FREE_BUFFER(vm, jit.entries, int, len);
+    fn->jit.declined = true;
+    return false;
+  }
+  fn->jit.size = size;
+  fn->jit.length = len;
+  fn->jit.entries = jit.entries;
+  return true;
+}
+
+JitStatus jit_run(VM* vm) {
+  // run the current frame in machine code from its ip, until it leaves
+  CallFrame* frame = vm->fp;
+  JitCode* jit = &frame->closure->func->jit;
+  int entry = jit->entries[frame->ip - frame->closure->func->code.bytes];
+  return ((JitEntry)jit->bytes)(vm, frame, jit->bytes + entry);
+}
+
+void free_jit_code(JitCode* code, VM* vm) {
+  if (code->bytes) {
+    munmap(code->bytes, code->size);
+    FREE_BUFFER(vm, code->entries, int, code->length);
+  }
+  init_jit_code(code);
+}
+
+/*
+ * traces: the path one iteration of a hot loop took from the loop's head to
+ * its $LOOP, recorded by run() as where each conditional jump went (see
+ * hot_loop() in vm.c). it compiles to straight-line code that goes around at
+ * the $LOOP. values along it are tracked as known numbers or not: arithmetic
+ * on known numbers isn't checked, and the checks that remain, like jumps that
+ * don't go the recorded way, are guards that leave for run() at the
+ * instruction they guard, before it has changed anything.
+ */
+
+static void side_exit(Jit* jit, int cc, int offset, int pop) {
+  // a guard's jump to a stub that leaves for run() at `offset` after
+  // dropping `pop` values the instruction pushed
+  int at = jcc(jit, cc);
+  if (jit->exit_count % 8 == 0) {
+    jit->exits = GROW_BUFFER(
+        jit->vm,
+        jit->exits,
+        JitExit,
+        jit->exit_count,
+        jit->exit_count + 8);
+  }
+  jit->exits[jit->exit_count++] = (JitExit) {at, offset, pop};
+}
+
+static void guard_number(Jit* jit, int reg, int offset, int pop) {
+  alu(jit, 0x89, RDX, reg);
+  alu(jit, 0x21, RDX, NAN_MASK);
+  alu(jit, 0x39, RDX, NAN_MASK);
+  side_exit(jit, CC_E, offset, pop);
+}
+
+static void guard_operands(Jit* jit, int offset, int pop) {
+  // the two values on top of the stack, as numbers in xmm0 and xmm1
+  load(jit, RAX, SP, -16);
+  load(jit, RCX, SP, -8);
+  if (!jit->known[jit->sp - 2]) {
+    guard_number(jit, RAX, offset, pop);
+  }
+  if (!jit->known[jit->sp - 1]) {
+    guard_number(jit, RCX, offset, pop);
+  }
+  movq_to_xmm(jit, 0, RAX);
+  movq_to_xmm(jit, 1, RCX);
+}
+
+static void push_known(Jit* jit, bool known) {
+  if (jit->sp >= jit->limit) {
+    jit->failed = true;
+    return;
+  }
+  jit->known[jit->sp++] = known;
+}
+
+static void trace_arithmetic(Jit* jit, byte_t op, int offset, int pop) {
+  byte_t sse_op = op == $ADD ? ADDSD
+      : op == $SUBTRACT      ? SUBSD
+      : op == $MULTIPLY      ? MULSD
+                             : DIVSD;
+  guard_operands(jit, offset, pop);
+  sse(jit, 0xf2, sse_op, 0, 1);
+  movq_from_xmm(jit, RAX, 0);
+  store(jit, SP, -16, RAX);
+  SUB_IMM(jit, SP, 8);
+  jit->sp--;
+  jit->known[jit->sp - 1] = true;
+}
+
+static byte_t trace_compare(Jit* jit, byte_t op, int offset) {
+  // compares the two numbers on top of the stack, returns the condition
+  // code under which `op` holds (its negation is cc ^ 1)
+  guard_operands(jit, offset, 0);
+  if (op == $LESS || op == $LESS_OR_EQ) {
+    sse(jit, 0x66, 0x2e, 1, 0);  // ucomisd xmm1, xmm0
+  } else {
+    sse(jit, 0x66, 0x2e, 0, 1);  // ucomisd xmm0, xmm1
+  }
+  return op == $LESS || op == $GREATER ? CC_A : CC_AE;
+}
+
+static void trace_branch(Jit* jit, int i, bool taken) {
+  // a conditional jump that must go the recorded way
+  byte_t op = jit->code->bytes[i];
+  switch (op) {
+    case $JMP_FALSE:
+    case $JMP_FALSE_OR_POP: {
+      load(jit, RAX, SP, -8);
+      mov_imm(jit, RCX, taken ? FALSE_VAL : TRUE_VAL);
+      alu(jit, 0x39, RAX, RCX);
+      int same = jcc(jit, CC_E);
+      alu(jit, 0x89, RDI, RAX);
+      call(jit, jit_falsy);
+      test_al(jit);
+      side_exit(jit, taken ? CC_E : CC_NE, i, 0);
+      land(jit, same);
+      if (op == $JMP_FALSE_OR_POP && !taken) {
+        SUB_IMM(jit, SP, 8);
+        jit->sp--;
+      }
+      return;
+    }
+    case $FOR_ITER:
+      // the iteration took the next element; the exhausted iterator or a
+      // user-defined one leave for run() to do it again
+      if (taken) {
+        jit->failed = true;
+        return;
+      }
+      sync(jit, jit->code->bytes + i + 3);
+      call(jit, jit_for_iter);
+      load(jit, SP, VMR, offsetof(VM, sp));
+      cmp_eax(jit, 1);
+      side_exit(jit, CC_NE, i, 0);
+      push_known(jit, false);
+      return;
+    case $EQ_JMP:
+    case $NOT_EQ_JMP:
+      equality_test(jit, op == $EQ_JMP);
+      mov_imm(jit, RCX, TRUE_VAL);
+      alu(jit, 0x39, RAX, RCX);
+      side_exit(jit, taken ? CC_E : CC_NE, i, 0);
+      break;
+    default: {
+      byte_t cc = trace_compare(jit, compare_op(op), i);
+      side_exit(jit, taken ? cc : cc ^ 1, i, 0);
+      break;
+    }
+  }
+  // a compare-and-jump pops its operands, and pushes false if it jumps
+  if (taken) {
+    mov_imm(jit, RAX, FALSE_VAL);
+    store(jit, SP, -16, RAX);
+    SUB_IMM(jit, SP, 8);
+    jit->sp--;
+    jit->known[jit->sp - 1] = false;
+  } else {
+    SUB_IMM(jit, SP, 16);
+    jit->sp -= 2;
+  }
+}
+
+static void trace_translate(Jit* jit, int i) {
+  // translate() with the types along the trace
+  Code* code = jit->code;
+  byte_t* ip = code->bytes + i;
+  Value* consts = code->vpool.values;
+  byte_t op = generic_opcode(*ip);
+  switch (op) {
+    case $LOAD_CONST:
+      push_value(jit, consts[ip[1]]);
+      push_known(jit, IS_NUMBER(consts[ip[1]]));
+      break;
+    case $GET_LOCAL:
+      load(jit, RAX, SLOTS, ip[1] * 8);
+      PUSH_RAX(jit);
+      push_known(jit, jit->known[ip[1]]);
+      break;
+    case $SET_LOCAL:
+    case $SET_LOCAL_POP:
+      load(jit, RAX, SP, -8);
+      store(jit, SLOTS, ip[1] * 8, RAX);
+      jit->known[ip[1]] = jit->known[jit->sp - 1];
+      if (op == $SET_LOCAL_POP) {
+        SUB_IMM(jit, SP, 8);
+        jit->sp--;
+      }
+      break;
+    case $ADD:
+    case $SUBTRACT:
+    case $MULTIPLY:
+    case $DIVIDE:
+      trace_arithmetic(jit, op, i, 0);
+      break;
+    case $ADD_LOCALS:
+      for (int k = 1; k <= 2; k++) {
+        load(jit, RAX, SLOTS, ip[k] * 8);
+        PUSH_RAX(jit);
+        push_known(jit, jit->known[ip[k]]);
+      }
+      trace_arithmetic(jit, $ADD, i, 2);
+      break;
+    case $ADD_CONST:
+    case $SUBTRACT_CONST:
+      push_value(jit, consts[ip[1]]);
+      push_known(jit, IS_NUMBER(consts[ip[1]]));
+      trace_arithmetic(jit, op == $ADD_CONST ? $ADD : $SUBTRACT, i, 1);
+      break;
+    case $LESS:
+    case $GREATER:
+    case $LESS_OR_EQ:
+    case $GREATER_OR_EQ:
+      mov_imm(jit, RDI, FALSE_VAL);
+      mov_imm(jit, RSI, TRUE_VAL);
+      cmov(jit, trace_compare(jit, op, i), RDI, RSI);
+      store(jit, SP, -16, RDI);
+      SUB_IMM(jit, SP, 8);
+      jit->sp--;
+      jit->known[jit->sp - 1] = false;
+      break;
+    case $CALL:
+      translate(jit, i);
+      jit->sp -= ip[1];
+      // the callee may set this frame's locals through upvalues
+      memset(jit->known, 0, jit->limit);
+      break;
+    case $LEN:
+      // unless it leaves, the builtin ran and gave a number
+      translate(jit, i);
+      jit->known[jit->sp - 1] = true;
+      break;
+    case $TAIL_CALL:
+    case $RET:
+    case $RET_LOCAL:
+    case $LOOP:
+      // leaves the loop, or an inner loop's: only innermost loops are traced
+      jit->failed = true;
+      break;
+    default:
+      translate(jit, i);
+      jit->sp += inst_effect(code, i);
+      if (jit->sp > 0 && jit->sp <= jit->limit) {
+        jit->known[jit->sp - 1] = false;
+      } else {
+        jit->failed = true;
+      }
+      break;
+  }
+}
+
+Trace* loop_trace(VM* vm, ObjFn* fn, int head) {
+  // the trace of the loop starting at `head`, made on first use
+  Trace* trace = fn->traces;
+  while (trace && trace->head != head) {
+    trace = trace->next;
+  }
+  if (!trace) {
+    trace = ALLOC(vm, Trace, 1);
+    *trace = (Trace) {
+        .head = head,
+        .state = TRACE_COUNTING,
+        .bytes = NULL,
+        .next = fn->traces};
+    fn->traces = trace;
+  }
+  return trace;
+}
+
+bool trace_compile(VM* vm, ObjFn* fn, Trace* trace) {
+  Code* code = &fn->code;
+  Jit jit = new_jit(vm, fn);
+  jit.limit = fn->max_stack + 2;  // +2 for $ADD_LOCALS' operands
+  jit.known = ALLOC(vm, bool, jit.limit);
+  memset(jit.known, 0, jit.limit);
+  jit.sp = trace->depth;
+  jit.failed = jit.sp > jit.limit;
+  prologue(&jit);
+  int start = jit.length, branch = 0;
+  for (int i = trace->head; !jit.failed;) {
+    // the path only goes forward until a $LOOP goes around
+    int target = jump_target(code, i), next = i + inst_length(code, i);
+    byte_t op = code->bytes[i];
+    if (op == $LOOP && target == trace->head) {
+      // count the iteration and go around
+      count_at(&jit, (uint64_t*)&trace->iterations);
+#ifdef EVE_PROFILE
+      count_at(&jit, back_edges(fn, i));
+#endif
+      jmp_to(&jit, start);
+      break;
+    }
+    if (op == $WIDE) {
+      jit.failed = true;
+    } else if (op == $JMP) {
+      i = target;
+    } else if (target != -1 && op != $LOOP) {
+      int to = branch < trace->branch_count ? trace->branches[branch++] : -1;
+      if (target == next || (to != target && to != next)) {
+        jit.failed = true;
+        break;
+      }
+      trace_branch(&jit, i, to == target);
+      i = to;
+    } else {
+      trace_translate(&jit, i);
+      i = next;
+    }
+    jit.failed |= i <= trace->head || i >= code->length;
+  }
+  jit.failed |= branch != trace->branch_count || jit.sp != trace->depth;
+  for (int i = 0; i < jit.exit_count && !jit.failed; i++) {
+    land(&jit, jit.exits[i].at);
+    if (jit.exits[i].pop) {
+      SUB_IMM(&jit, SP, jit.exits[i].pop * 8);
+    }
+    leave_at(&jit, code->bytes + jit.exits[i].offset);
+  }
+  FREE_BUFFER(vm, jit.known, bool, jit.limit);
+  size_t size = jit.length;
+  if (!(trace->bytes = install(&jit))) {
+    trace->state = TRACE_DECLINED;
+    return false;
+  }
+  trace->size = size;
+  trace->entry = start;
+  trace->state = TRACE_COMPILED;
+  return true;
+}
+
+JitStatus trace_run(VM* vm, Trace* trace) {
+  // run the current frame's loop from its head, until a guard fails
+  return ((JitEntry)trace->bytes)(vm, vm->fp, trace->bytes + trace->entry);
+}
+
+void drop_trace(Trace* trace) {
+  if (trace->bytes) {
+    munmap(trace->bytes, trace->size);
+    trace->bytes = NULL;
+  }
+  trace->state = TRACE_DECLINED;
+}
+
+void free_traces(ObjFn* fn, VM* vm) {
+  for (Trace *trace = fn->traces, *next; trace; trace = next) {
+    next = trace->next;
+    drop_trace(trace);
+    FREE(vm, trace, Trace);
+  }
+  fn->traces = NULL;
+}
+#endif
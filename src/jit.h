@@ -0,0 +1,55 @@
+#ifndef EVE_JIT_H
+#define EVE_JIT_H
+#include "gen.h"
+#include "vm.h"
+
+typedef enum {
+  JIT_EXIT,  // the frame continues in run() at its ip
+  JIT_ERROR,  // a runtime error was raised, see TRY_RECOVER()
+  JIT_RETURN,  // the frame returned, its caller continues
+  JIT_DONE,  // the last frame returned
+} JitStatus;
+
+#ifdef EVE_JIT
+bool jit_compile(VM* vm, ObjFn* fn);
+JitStatus jit_run(VM* vm);
+void free_jit_code(JitCode* code, VM* vm);
+Trace* loop_trace(VM* vm, ObjFn* fn, int head);
+bool trace_compile(VM* vm, ObjFn* fn, Trace* trace);
+JitStatus trace_run(VM* vm, Trace* trace);
+void drop_trace(Trace* trace);
+void free_traces(ObjFn* fn, VM* vm);
+#endif
+
+// slow paths of the machine code and of C compiled ahead of time, in vm.c.
+// like run_reg()'s handlers they work on vm->sp, and those that can fail
+// return false after runtime_error()
+bool jit_falsy(Value val);
+bool jit_binary(VM* vm, int op);
+bool jit_unary(VM* vm, int op);
+void jit_define_global(VM* vm, int slot);
+bool jit_get_global(VM* vm, int slot);
+bool jit_set_global(VM* vm, int slot);
+bool jit_get_field(VM* vm, Value property, InlineCache* ic);
+bool jit_get_property(VM* vm, Value property, InlineCache* ic);
+bool jit_set_property(VM* vm, Value property);
+bool jit_is_core(VM* vm, int core);
+bool jit_intrinsic(VM* vm, int index);
+// a `for` loop over a list, string, hashmap or iterator; false or -1 leave
+// the frame to run() for other iterables, see prep_iter()
+bool jit_iter_prep(VM* vm);
+int jit_for_iter(VM* vm);
+bool jit_subscript(VM* vm);
+bool jit_set_subscript(VM* vm);
+void jit_build_list(VM* vm, int len);
+void jit_build_map(VM* vm, int len);
+void jit_build_closure(VM* vm, ObjFn* fn, byte_t* upvalues);
+bool jit_build_struct(VM* vm, ObjString* name, int field_count);
+bool jit_build_instance(VM* vm, int field_count);
+void jit_display(VM* vm, int len);
+bool jit_assert(VM* vm);
+bool jit_throw(VM* vm);
+void jit_close_upvalue(VM* vm);
+JitStatus jit_call(VM* vm, int argc);
+bool jit_return(VM* vm);
+#endif  //EVE_JIT_H
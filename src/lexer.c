@@ -32,6 +32,7 @@ char* token_types[] = {
     [TK_QMARK] = "?",
     [TK_AT] = "@",
     [TK_DCOLON] = "::",
+    [TK_DOT_DOT] = "..",
     [TK_PIPE_PIPE] = "||",
     [TK_AMP_AMP] = "&&",
     [TK_GRT_EQ] = ">=",
@@ -218,7 +219,8 @@ Token lex_num(Lexer* lexer, char start) {
   char curr = PEEK(lexer);
   bool is_hex = start == '0' && tolower(curr) == 'x';
   bool is_exp = !is_hex && tolower(curr) == 'e';
-  bool is_dec = curr == '.';
+  // `0..n` is a range, not 0. followed by .n
+  bool is_dec = curr == '.' && peek(lexer, 1) != '.';
   if (is_dec || is_exp || is_hex) {
   rescan:
     advance(lexer);
@@ -370,7 +372,7 @@ Token get_token(Lexer* lexer) {
     case '@':
       return new_token(lexer, TK_AT);
     case '.':
-      return new_token(lexer, TK_DOT);
+      return new_token(lexer, check(lexer, '.') ? TK_DOT_DOT : TK_DOT);
     case ',':
       return new_token(lexer, TK_COMMA);
     case ';':
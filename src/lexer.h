@@ -37,6 +37,7 @@ typedef enum {
   TK_QMARK,         // ?
   TK_STAR_STAR,     // **
   TK_DCOLON,        // ::
+  TK_DOT_DOT,       // ..
   TK_PIPE_PIPE,     // ||
   TK_AMP_AMP,       // &&
   TK_GRT_EQ,        // >=
@@ -1,14 +1,36 @@
 #include <stdio.h>
 
+#include "aot.h"
 #include "compiler.h"
+#include "profile.h"
 #include "serde.h"
 #include "vm.h"
 //#ifdef EVE_DEBUG
 #include "debug.h"
 //#endif
 
-int execute_eve(char* fp, const char* bin, bool dis) {
+typedef struct {
+  bool dis;  // -d
+  bool optimize;  // cleared by -O0
+  Engine engine;  // --reg selects the register engine
+  int jit_threshold;  // --jit, or 0 under --jit-all; -1 without
+  int trace_threshold;  // --trace, or 0 under --trace-all; -1 without
+  bool emit_c;  // --emit-c prints the program as C instead of running it
+  bool profile;  // --profile prints the execution counters on exit
+  char* sample_profile;  // --sample-profile=<file> gets sampled stacks
+  bool opcode_stats;  // --opcode-stats prints the opcode counts on exit
+  char* opcode_json;  // --opcode-stats=<file> also writes them as JSON
+} Options;
+
+int execute_eve(char* fp, const char* bin, Options* opts) {
   VM vm = new_vm();
+  vm.optimize = opts->optimize;
+  vm.engine = opts->engine;
+  // the JIT and traces are the stack engine's, not even the functions --reg
+  // declines get them
+  vm.jit_threshold = opts->engine == ENGINE_STACK ? opts->jit_threshold : -1;
+  vm.trace_threshold =
+      opts->engine == ENGINE_STACK ? opts->trace_threshold : -1;
   // parse
   char* src = NULL;
   char* msg = read_file(fp, &src);
@@ -39,12 +61,31 @@ int execute_eve(char* fp, const char* bin, bool dis) {
     serialize(&serde, bin, func);
     free_serde(&serde);
   }
-  if (dis) {
+  if (opts->emit_c) {
+    IResult ret = emit_c(&vm, func, stdout) ? RESULT_SUCCESS
+                                             : RESULT_COMPILE_ERROR;
+    free(src);
+    free_vm(&vm);
+    return ret;
+  }
+  if (opts->dis && opts->engine == ENGINE_REG) {
+    dis_reg_functions(&vm, func);
+  } else if (opts->dis) {
+    dis_functions(&func->code);
     dis_code(&func->code, "<debug>");
   }
   // run
   boot_vm(&vm, func);
-  IResult ret = run(&vm);
+  if (opts->sample_profile && !start_sampling(&vm, opts->sample_profile)) {
+    fputs("Could not start the sampling profiler\n", stderr);
+  }
+  IResult ret = vm_run(&vm);
+  if (opts->profile) {
+    dump_profile(&vm, stderr);
+  }
+  if (opts->opcode_stats) {
+    dump_opcode_stats(stderr, opts->opcode_json);
+  }
   // destruct
   free(src);
   free_vm(&vm);
@@ -59,17 +100,22 @@ int execute_eco(char* fp) {
   vm.is_compiling = true;
   Compiler compiler;
   new_compiler(&compiler, NULL, de_fun, &vm, NULL);
+  free_compiler(&compiler);
 #ifdef EVE_DEBUG
   dis_code(&de_fun->code, get_func_name(de_fun));
 #endif
   boot_vm(&vm, de_fun);
-  IResult ret = run(&vm);
+  IResult ret = vm_run(&vm);
   free_vm(&vm);
   return ret;
 }
 
 int show_options() {
-  printf("Usage: eve [-h | --help] [-v | --version] -d? <input-file>\n");
+  printf(
+      "Usage: eve [-h | --help] [-v | --version] [-d] [-O0] [--reg] "
+      "[--jit | --jit-all] [--trace | --trace-all] [--emit-c] "
+      "[--profile] [--sample-profile=<file>] [--opcode-stats[=<file>]] "
+      "<input-file>\n");
   return 0;
 }
 
@@ -90,26 +136,61 @@ int parse_args(int argc, char* argv[]) {
   if (argc < 2) {
     return show_options();
   }
-  switch (*(argv[1])) {
-    case '-': {
-      if (strlen(argv[1]) == 2 && argv[1][1] == 'd') {
-        return execute_eve(argv[2], NULL, true);
-      } else if (
-          strlen(argv[1]) == 2 && argv[1][1] == 'h'
-          || strncmp(argv[1], "--help", 6) == 0) {
-        return show_help();
-      } else if (
-          strlen(argv[1]) == 2 && argv[1][1] == 'v'
-          || strncmp(argv[1], "--version", 9) == 0) {
-        return show_version();
-      } else {
-        fputs("Err. Invalid arguments.\n", stderr);
-        return show_options();
-      }
+  Options opts = {
+      .dis = false,
+      .optimize = true,
+      .engine = ENGINE_STACK,
+      .jit_threshold = -1,
+      .trace_threshold = -1,
+      .emit_c = false,
+      .profile = false,
+      .sample_profile = NULL,
+      .opcode_stats = false,
+      .opcode_json = NULL};
+  int i = 1;
+  // options precede the input file
+  for (char* arg; i < argc && *(arg = argv[i]) == '-'; i++) {
+    if (strcmp(arg, "-d") == 0) {
+      opts.dis = true;
+    } else if (strcmp(arg, "-O0") == 0) {
+      opts.optimize = false;
+    } else if (strcmp(arg, "--reg") == 0) {
+      opts.engine = ENGINE_REG;
+    } else if (strcmp(arg, "--jit") == 0) {
+      opts.jit_threshold = JIT_THRESHOLD;
+    } else if (strcmp(arg, "--jit-all") == 0) {
+      // compile every function on its first call
+      opts.jit_threshold = 0;
+    } else if (strcmp(arg, "--trace") == 0) {
+      opts.trace_threshold = TRACE_THRESHOLD;
+    } else if (strcmp(arg, "--trace-all") == 0) {
+      // record every loop on its first iteration
+      opts.trace_threshold = 0;
+    } else if (strcmp(arg, "--emit-c") == 0) {
+      opts.emit_c = true;
+    } else if (strcmp(arg, "--profile") == 0) {
+      opts.profile = true;
+    } else if (strncmp(arg, "--sample-profile=", 17) == 0 && arg[17]) {
+      opts.sample_profile = arg + 17;
+    } else if (strcmp(arg, "--opcode-stats") == 0) {
+      opts.opcode_stats = true;
+    } else if (strncmp(arg, "--opcode-stats=", 15) == 0 && arg[15]) {
+      opts.opcode_stats = true;
+      opts.opcode_json = arg + 15;
+    } else if (strcmp(arg, "-h") == 0 || strncmp(arg, "--help", 6) == 0) {
+      return show_help();
+    } else if (strcmp(arg, "-v") == 0 || strncmp(arg, "--version", 9) == 0) {
+      return show_version();
+    } else {
+      fputs("Err. Invalid arguments.\n", stderr);
+      return show_options();
     }
-    default:
-      return execute_eve(argv[1], NULL, false);
   }
+  if (i >= argc) {
+    fputs("Err. Invalid arguments.\n", stderr);
+    return show_options();
+  }
+  return execute_eve(argv[i], NULL, &opts);
 }
 
 int main(int argc, char* argv[]) {
@@ -2,6 +2,11 @@
 
 /// map_get map_put map_remove map_has_key
 
+// a removed entry: unlike a fresh one (NULL key, NOTHING_VAL), lookups probe
+// past it
+#define TOMBSTONE TRUE_VAL
+#define IS_FRESH(entry) ((entry)->key == NULL && (entry)->value == NOTHING_VAL)
+
 void adjust_map(Map* map, VM* vm) {
   int new_cap = GROW_CAPACITY(map->capacity);
   MapEntry* entries = ALLOC(vm, MapEntry, new_cap);
@@ -13,6 +18,7 @@ void adjust_map(Map* map, VM* vm) {
   int old_capacity = map->capacity;
   map->entries = entries;
   map->capacity = new_cap;
+  map->length = map->tombstones = 0;
   // store old entries
   for (int i = 0; i < old_capacity; i++) {
     if (old_entries[i].key != NULL) {
@@ -24,19 +30,25 @@ void adjust_map(Map* map, VM* vm) {
 
 bool map_put(Map* map, VM* vm, ObjString* key, Value value) {
   // check capacity
-  if (map->length >= map->capacity * MAP_LOAD_FACTOR) {
+  if (map->length + map->tombstones >= map->capacity * MAP_LOAD_FACTOR) {
     adjust_map(map, vm);
   }
   int cap = (map->capacity - 1);
   uint32_t index = key->hash & cap;
-  MapEntry* entry;
+  MapEntry *entry, *tombstone = NULL;
   for (;;) {
     entry = &map->entries[index];
-    if (entry->key == NULL) {
+    if (IS_FRESH(entry)) {
+      if (tombstone) {
+        entry = tombstone;
+        map->tombstones--;
+      }
       entry->key = key;
       entry->value = value;
       map->length++;
       return true;
+    } else if (entry->key == NULL) {
+      tombstone = tombstone ? tombstone : entry;
     } else if (entry->key == key) {
       entry->value = value;
       return false;
@@ -56,7 +68,7 @@ Value map_get(Map* map, ObjString* key) {
     entry = &map->entries[index];
     if (entry->key == key) {
       return entry->value;
-    } else if (entry->key == NULL) {
+    } else if (IS_FRESH(entry)) {
       return NOTHING_VAL;
     }
     index = (index + 1) & cap;
@@ -64,6 +76,24 @@ Value map_get(Map* map, ObjString* key) {
   UNREACHABLE("map_get");
 }
 
+int map_find_slot(Map* map, ObjString* key) {
+  if (map->capacity == 0)
+    return -1;
+  int cap = (map->capacity - 1);
+  uint32_t index = key->hash & cap;
+  MapEntry* entry;
+  for (;;) {
+    entry = &map->entries[index];
+    if (entry->key == key) {
+      return (int)index;
+    } else if (IS_FRESH(entry)) {
+      return -1;
+    }
+    index = (index + 1) & cap;
+  }
+  UNREACHABLE("map_find_slot");
+}
+
 bool map_remove(Map* map, ObjString* key) {
   int cap = (map->capacity - 1);
   uint32_t index = key->hash & cap;
@@ -72,10 +102,11 @@ bool map_remove(Map* map, ObjString* key) {
     entry = &map->entries[index];
     if (entry->key == key) {
       entry->key = NULL;
-      entry->value = NOTHING_VAL;
+      entry->value = TOMBSTONE;
       map->length--;
+      map->tombstones++;
       return true;
-    } else if (entry->key == NULL) {
+    } else if (IS_FRESH(entry)) {
       return false;
     }
     index = (index + 1) & cap;
@@ -94,7 +125,7 @@ bool map_has_key(Map* map, ObjString* key, Value* value) {
     if (entry->key == key) {
       *value = entry->value;
       return true;
-    } else if (entry->key == NULL) {
+    } else if (IS_FRESH(entry)) {
       return false;
     }
     index = (index + 1) & cap;
@@ -110,9 +141,9 @@ ObjString* map_find_interned(Map* map, char* str, int len, uint32_t hash) {
   MapEntry* entry;
   for (;;) {
     entry = &map->entries[index];
-    if (entry->key == NULL) {
+    if (IS_FRESH(entry)) {
       return NULL;
-    } else {
+    } else if (entry->key) {
       ObjString* string = entry->key;
       if (string->length == len && string->hash == hash
           && memcmp(string->str, str, len) == 0) {
@@ -139,5 +170,8 @@ void map_copy(VM* vm, Map* map1, Map* map2) {
 
 void map_init(Map* map) {
   map->entries = NULL;
-  map->length = map->capacity = 0;
-}
\ No newline at end of file
+  map->length = map->capacity = map->tombstones = 0;
+}
+
+#undef TOMBSTONE
+#undef IS_FRESH
\ No newline at end of file
@@ -9,6 +9,7 @@ ObjString* map_find_interned(Map* map, char* str, int len, uint32_t hash);
 bool map_has_key(Map* map, ObjString* key, Value* value);
 bool map_remove(Map* map, ObjString* key);
 Value map_get(Map* map, ObjString* key);
+int map_find_slot(Map* map, ObjString* key);
 bool map_put(Map* map, VM* vm, ObjString* key, Value value);
 void map_copy(VM* vm, Map* map1, Map* map2);
 #endif  //EVE_MAP_H
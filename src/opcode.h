@@ -46,7 +46,7 @@ typedef enum {
   $GET_PROPERTY,  // instance
   $SET_PROPERTY,  // instance
   $SET_SUBSCRIPT,
-  $DEFINE_GLOBAL,
+  $DEFINE_GLOBAL,  // by slot in the module, see module_slot()
   $GET_GLOBAL,
   $GET_LOCAL,
   $SET_GLOBAL,
@@ -55,13 +55,127 @@ typedef enum {
   $SET_UPVALUE,
   $CLOSE_UPVALUE,
   $ASSERT,
-  $SET_TRY,
-  $TEAR_TRY,
   $THROW,
   $LOOP,
   $CALL,
   $TAIL_CALL,
-  $RET
+  $RET,
+  // `for` loops, see c_for_stmt(): $ITER_PREP replaces the iterable on top
+  // of the stack with a cursor and the iterator it walks, which $FOR_ITER
+  // advances, pushing the next element or jumping (2-byte offset) past the
+  // loop
+  $ITER_PREP,
+  $FOR_ITER,
+  // Intrinsics: calls of builtins compiled to instructions on their argument,
+  // see c_intrinsic(). operands: `core`'s 1-byte global slot and the
+  // intrinsic's index (see core.h); a slot past 255 compiles to a call
+  $LEN,
+  $TYPEOF,
+  // prefix: every operand byte of the next instruction takes two bytes,
+  // for constants, locals and upvalues past 255 and jumps past 64 KB
+  $WIDE,
+  // Fused (superinstructions), see fuse_code() in gen.c
+  $ADD_LOCALS,  // $GET_LOCAL a; $GET_LOCAL b; $ADD
+  $ADD_CONST,  // $LOAD_CONST k; $ADD
+  $SUBTRACT_CONST,  // $LOAD_CONST k; $SUBTRACT
+  $LESS_JMP,  // $LESS; $JMP_FALSE_OR_POP
+  $GREATER_JMP,  // $GREATER; $JMP_FALSE_OR_POP
+  $LESS_OR_EQ_JMP,  // $LESS_OR_EQ; $JMP_FALSE_OR_POP
+  $GREATER_OR_EQ_JMP,  // $GREATER_OR_EQ; $JMP_FALSE_OR_POP
+  $EQ_JMP,  // $EQ; $JMP_FALSE_OR_POP
+  $NOT_EQ_JMP,  // $NOT_EQ; $JMP_FALSE_OR_POP
+  $SET_LOCAL_POP,  // $SET_LOCAL a; $POP
+  $RET_LOCAL,  // $GET_LOCAL a; $RET
+  // Quickened, rewritten in place by run() and never serialized
+  $ADD_NUM,
+  $SUBTRACT_NUM,
+  $MULTIPLY_NUM,
+  $DIVIDE_NUM,
+  $LESS_NUM,
+  $GREATER_NUM,
+  $LESS_OR_EQ_NUM,
+  $GREATER_OR_EQ_NUM,
 } OpCode;
 
+// register instruction set executed by run_reg(), translated from the above
+// by regen.c. registers are frame slots: A is a destination, B and C are
+// sources, K a constant index, G a global's slot in the module, D the stack
+// depth at which an instruction that works on the stack (calls, builders,
+// ...) runs and S a 2-byte jump.
+typedef enum {
+  // Moves
+  $R_MOVE,  // A B
+  $R_LOADK,  // A K
+  $R_GET_UPVALUE,  // A U
+  $R_SET_UPVALUE,  // U B
+  $R_GET_GLOBAL,  // A G
+  $R_SET_GLOBAL,  // D G
+  $R_DEFINE_GLOBAL,  // D G
+  // Arith & Bitwise: A B C
+  $R_ADD,
+  $R_SUBTRACT,
+  $R_MULTIPLY,
+  $R_DIVIDE,
+  $R_MOD,
+  $R_POW,
+  $R_BW_LSHIFT,
+  $R_BW_RSHIFT,
+  $R_BW_AND,
+  $R_BW_XOR,
+  $R_BW_OR,
+  $R_ADDK,  // A B K
+  $R_SUBTRACTK,  // A B K
+  // Unary: A B
+  $R_NEGATE,
+  $R_NOT,
+  $R_BW_INVERT,
+  // Conditional: A B C
+  $R_EQ,
+  $R_NOT_EQ,
+  $R_LESS,
+  $R_GREATER,
+  $R_LESS_OR_EQ,
+  $R_GREATER_OR_EQ,
+  // Control
+  $R_JMP,  // S
+  $R_LOOP,  // O S, O the $LOOP's offset in the stack code (see profile.h)
+  $R_JMP_FALSE,  // B S
+  // compare B and C, on false store false in A and jump: A B C S
+  $R_EQ_JMP,
+  $R_NOT_EQ_JMP,
+  $R_LESS_JMP,
+  $R_GREATER_JMP,
+  $R_LESS_OR_EQ_JMP,
+  $R_GREATER_OR_EQ_JMP,
+  // as above, comparing B with constant K: A B K S
+  $R_EQ_JMPK,
+  $R_NOT_EQ_JMPK,
+  $R_LESS_JMPK,
+  $R_GREATER_JMPK,
+  $R_LESS_OR_EQ_JMPK,
+  $R_GREATER_OR_EQ_JMPK,
+  $R_CALL,  // D argc
+  $R_TAIL_CALL,  // D argc
+  $R_RET,  // B
+  $R_ITER_PREP,  // D
+  $R_FOR_ITER,  // D S
+  // Stack: as their stack counterparts, run at depth D
+  $R_SUBSCRIPT,  // D
+  $R_SET_SUBSCRIPT,  // D
+  $R_GET_FIELD,  // D K IC
+  $R_GET_PROPERTY,  // D K IC
+  $R_SET_PROPERTY,  // D K
+  $R_LEN,  // D G n
+  $R_TYPEOF,  // D G n
+  $R_BUILD_LIST,  // D n
+  $R_BUILD_MAP,  // D n
+  $R_BUILD_CLOSURE,  // D K (index, is_local)...
+  $R_BUILD_STRUCT,  // D K n
+  $R_BUILD_INSTANCE,  // D n
+  $R_DISPLAY,  // D n
+  $R_ASSERT,  // D
+  $R_THROW,  // D
+  $R_CLOSE_UPVALUE,  // A
+} RegOpCode;
+
 #endif  //EVE_OPCODE_H
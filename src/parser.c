@@ -94,6 +94,7 @@ ExprParseTable p_table[] = {
   [TK_HASH] = {.bp = BP_NONE, .prefix = parse_map, .infix = NULL},
   [TK_COLON] = {.bp = BP_NONE, .prefix = NULL, .infix = NULL},
   [TK_DCOLON] = {.bp = BP_ACCESS, .prefix = NULL, .infix = parse_dcol_expr},
+  [TK_DOT_DOT] = {.bp = BP_NONE, .prefix = NULL, .infix = NULL},
   [TK_SEMI_COLON] = {.bp = BP_NONE, .prefix = NULL, .infix = NULL},
   [TK_LCURLY] = {.bp = BP_NONE, .prefix = NULL, .infix = NULL},
   [TK_RCURLY] = {.bp = BP_NONE, .prefix = NULL, .infix = NULL},
@@ -412,14 +413,18 @@ static AstNode* parse_num(Parser* parser, bool assignable) {
   int line = parser->current_tk.line;
   consume(parser, TK_NUM);
   Token tok = parser->previous_tk;
+  // a copy, as strtod() would read on into the `.` of a range such as 0..n
+  char num[tok.length + 1];
+  memcpy(num, tok.value, tok.length);
+  num[tok.length] = '\0';
   char* endptr;
   double val;
-  if (*tok.value == '0' && tolower(*(tok.value + 1)) == 'x') {
-    val = (double)strtol(tok.value, &endptr, 16);
+  if (*num == '0' && tolower(*(num + 1)) == 'x') {
+    val = (double)strtol(num, &endptr, 16);
   } else {
-    val = strtod(tok.value, &endptr);
+    val = strtod(num, &endptr);
   }
-  ASSERT(tok.value + tok.length == endptr, "failed to convert number");
+  ASSERT(num + tok.length == endptr, "failed to convert number");
   AstNode* node = new_num(&parser->store, val, line);
   return node;
 }
@@ -440,7 +445,8 @@ static AstNode* parse_var(Parser* parser, bool assignable) {
   bool is_struct = prev_tok.ty == TK_STRUCT;
   bool is_if = !is_struct && prev_tok.ty == TK_IF;
   bool is_while = !is_if && prev_tok.ty == TK_WHILE;
-  bool is_in = !is_while && prev_tok.ty == TK_IN;
+  bool is_in = !is_while
+      && (prev_tok.ty == TK_IN || prev_tok.ty == TK_DOT_DOT);
   bool is_allowable = !is_struct && !is_if && !is_while && !is_in;
   // ID { (ID = expr ("," ID = expr)*)? }
   if (is_allowable && assignable && is_tty(parser, TK_LCURLY)) {
@@ -889,15 +895,22 @@ static AstNode* parse_for_stmt(Parser* parser) {
    * for let elem in iterable {
    *  stmt
    * }
+   * or, counting from start up to (not including) stop:
+   * for let elem in start..stop {
+   *  stmt
+   * }
    */
   parser->loop++;
   int line = parser->current_tk.line;
-  int column = parser->lexer.column;
   consume(parser, TK_FOR);
   consume(parser, TK_LET);
   AstNode* elem = parse_var(parser, false);
   consume(parser, TK_IN);
   AstNode* iterable = parse_expr(parser);
+  AstNode* stop = NULL;
+  if (match(parser, TK_DOT_DOT)) {
+    stop = parse_expr(parser);
+  }
   AstNode* block = parse_block_stmt(parser);
   AstNode* node = new_node(parser);
   node->for_stmt = (ForStmtNode) {
@@ -905,33 +918,8 @@ static AstNode* parse_for_stmt(Parser* parser) {
       .type = AST_FOR_STMT,
       .block = block,
       .elem = elem,
-      .iterable = iterable};
-
-  char* template =
-      "{\n"
-      "  let e_ = None;\n"
-      "  let is_error = false;\n"
-      "  let itr = core::iter(obj);\n"
-      "  while true {\n"
-      "      let i = try core::next(itr) ? e_ else is_error = true;\n"
-      "      if is_error {\n"
-      "         if e_ == core::StopIteration {\n"
-      "             break;\n"
-      "         } else {\n"
-      "             throw e_;\n"
-      "         }\n"
-      "      }\n"
-      "      ## rest of code here...\n"
-      "  }\n"
-      "}";
-  Parser prs = new_parser(template, "");
-  prs.lexer.line = line;
-  prs.lexer.column = column;
-  AstNode* desugar = parse(&prs);
-  node->for_stmt.desugar = desugar->program.decls.items[0];
-  vec_free(&desugar->program.decls);  // free ProgramNode Vec decls
-  // store all allocated nodes in the original parser.
-  vec_extend(&parser->store.nodes, &prs.store.nodes);
+      .iterable = iterable,
+      .stop = stop};
   parser->loop--;
   return node;
 }
@@ -0,0 +1,482 @@
+#include "profile.h"
+
+#ifndef _WIN32
+  #include <sys/time.h>
+#endif
+
+#include "debug.h"
+#include "gen.h"
+
+#define PROFILE_KEY_MAX (256)
+
+static bool is_loop(Code* code, int offset) {
+  byte_t op = code->bytes[offset];
+  return op == $LOOP || (op == $WIDE && code->bytes[offset + 1] == $LOOP);
+}
+
+LoopCount* loop_counts(ObjFn* fn) {
+  // the function's counters, one per $LOOP, made on its first back edge.
+  // they're outside the gc's heap, as they're made wherever a loop runs
+  Code* code = &fn->code;
+  int count = 0;
+  for (int i = 0; i < code->length; i += inst_length(code, i)) {
+    count += is_loop(code, i);
+  }
+  LoopCount* loops = alloc(NULL, sizeof(LoopCount) * count);
+  for (int i = 0, n = 0; n < count; i += inst_length(code, i)) {
+    if (is_loop(code, i)) {
+      loops[n++] = (LoopCount) {.offset = i, .count = 0};
+    }
+  }
+  fn->loop_count = count;
+  fn->back_edges = loops;
+  return loops;
+}
+
+void reset_profile(VM* vm) {
+  for (Obj* obj = vm->objects; obj; obj = obj->next) {
+    if (obj->type == OBJ_FN) {
+      ObjFn* fn = (ObjFn*)obj;
+      fn->calls = 0;
+      for (int i = 0; i < fn->loop_count; i++) {
+        fn->back_edges[i].count = 0;
+      }
+    }
+  }
+}
+
+static Value profile_key(VM* vm, ObjFn* fn, int offset) {
+  // "name (module:line)", with the line of `offset` in the function's code
+  char key[PROFILE_KEY_MAX];
+  int len = snprintf(
+      key,
+      PROFILE_KEY_MAX,
+      "%s (%s:%d)",
+      get_func_name(fn),
+      fn->module->name->str,
+      fn->code.lines[offset]);
+  len = len < PROFILE_KEY_MAX ? len : PROFILE_KEY_MAX - 1;
+  return create_stringv(vm, &vm->strings, key, len, false);
+}
+
+static void add_count(VM* vm, ObjHashMap* counts, Value key, uint64_t n) {
+  // functions and loops may share a key, e.g. on a single line
+  Value count = hashmap_get(counts, key);
+  double total = (count == NOTHING_VAL ? 0 : AS_NUMBER(count)) + (double)n;
+  hashmap_put(counts, vm, key, NUMBER_VAL(total));
+}
+
+static void collect_counts(VM* vm, ObjHashMap* calls, ObjHashMap* loops) {
+  // functions keyed by their first lines, loops by the lines they start at
+  for (Obj* obj = vm->objects; obj; obj = obj->next) {
+    if (obj->type != OBJ_FN) {
+      continue;
+    }
+    ObjFn* fn = (ObjFn*)obj;
+    Code* code = &fn->code;
+    if (fn->calls) {
+      add_count(vm, calls, profile_key(vm, fn, 0), fn->calls);
+    }
+    for (int i = 0; i < fn->loop_count; i++) {
+      LoopCount* loop = &fn->back_edges[i];
+      if (loop->count) {
+        Value key = profile_key(vm, fn, jump_target(code, loop->offset));
+        add_count(vm, loops, key, loop->count);
+      }
+    }
+  }
+}
+
+ObjHashMap* profile_snapshot(VM* vm) {
+  // #{"calls": #{function: calls}, "loops": #{loop: back edges}}
+  bool compiling = vm->is_compiling;
+  vm->is_compiling = true;  // keeps the gc off the maps being built
+  ObjHashMap* calls = create_hashmap(vm);
+  ObjHashMap* loops = create_hashmap(vm);
+  collect_counts(vm, calls, loops);
+  ObjHashMap* snapshot = create_hashmap(vm);
+  hashmap_put(
+      snapshot,
+      vm,
+      create_stringv(vm, &vm->strings, "calls", 5, false),
+      OBJ_VAL(calls));
+  hashmap_put(
+      snapshot,
+      vm,
+      create_stringv(vm, &vm->strings, "loops", 5, false),
+      OBJ_VAL(loops));
+  vm->is_compiling = compiling;
+  return snapshot;
+}
+
+static int compare_counts(const void* a, const void* b) {
+  double x = AS_NUMBER(((HashEntry*)a)->value);
+  double y = AS_NUMBER(((HashEntry*)b)->value);
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void dump_counts(
+    ObjHashMap* counts,
+    const char* count,
+    const char* what,
+    FILE* out) {
+  // a table of the counts, from most to least
+  HashEntry* entries = alloc(NULL, sizeof(HashEntry) * (counts->length + 1));
+  int n = 0;
+  for (int i = 0; i < counts->capacity; i++) {
+    if (!IS_NOTHING(counts->entries[i].key)) {
+      entries[n++] = counts->entries[i];
+    }
+  }
+  qsort(entries, n, sizeof(HashEntry), compare_counts);
+  fprintf(out, "%14s  %s\n", count, what);
+  for (int i = 0; i < n; i++) {
+    fprintf(
+        out,
+        "%14.0f  %s\n",
+        AS_NUMBER(entries[i].value),
+        AS_STRING(entries[i].key)->str);
+  }
+  free(entries);
+}
+
+void dump_profile(VM* vm, FILE* out) {
+#ifdef EVE_PROFILE
+  bool compiling = vm->is_compiling;
+  vm->is_compiling = true;
+  ObjHashMap* calls = create_hashmap(vm);
+  ObjHashMap* loops = create_hashmap(vm);
+  collect_counts(vm, calls, loops);
+  dump_counts(calls, "calls", "function", out);
+  dump_counts(loops, "back edges", "loop", out);
+  vm->is_compiling = compiling;
+#else
+  (void)vm;
+  fputs("eve was built without EVE_PROFILE, there are no counts\n", out);
+#endif
+}
+
+volatile sig_atomic_t sample_due = 0;
+
+typedef struct {
+  char* stack;  // "outermost (module:line);...;innermost (module:line)"
+  uint32_t hash;
+  uint64_t count;
+} Sample;
+
+typedef struct Sampler {
+  char* path;
+  int length;
+  int capacity;
+  Sample* samples;  // open addressing on the stacks' hashes
+  int size;
+  char* buffer;  // the stack being recorded
+} Sampler;
+
+static uint32_t hash_stack(const char* stack, int len) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < len; i++) {
+    hash = (hash ^ (byte_t)stack[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static Sample* find_sample(
+    Sample* samples,
+    int capacity,
+    uint32_t hash,
+    const char* stack) {
+  for (uint32_t i = hash & (capacity - 1);; i = (i + 1) & (capacity - 1)) {
+    Sample* sample = &samples[i];
+    if (!sample->stack
+        || (sample->hash == hash && strcmp(sample->stack, stack) == 0)) {
+      return sample;
+    }
+  }
+}
+
+static void grow_samples(Sampler* sampler) {
+  int capacity = GROW_CAPACITY(sampler->capacity);
+  Sample* samples = alloc(NULL, sizeof(Sample) * capacity);
+  memset(samples, 0, sizeof(Sample) * capacity);
+  for (int i = 0; i < sampler->capacity; i++) {
+    Sample* old = &sampler->samples[i];
+    if (old->stack) {
+      *find_sample(samples, capacity, old->hash, old->stack) = *old;
+    }
+  }
+  free(sampler->samples);
+  sampler->samples = samples;
+  sampler->capacity = capacity;
+}
+
+static void record_stack(Sampler* sampler, int len) {
+  if (sampler->length + 1 > sampler->capacity * 3 / 4) {
+    grow_samples(sampler);
+  }
+  uint32_t hash = hash_stack(sampler->buffer, len);
+  Sample* sample =
+      find_sample(sampler->samples, sampler->capacity, hash, sampler->buffer);
+  if (!sample->stack) {
+    sample->stack = alloc(NULL, len + 1);
+    memcpy(sample->stack, sampler->buffer, len + 1);
+    sample->hash = hash;
+    sampler->length++;
+  }
+  sample->count++;
+}
+
+#ifndef _WIN32
+static void on_sigprof(int signal) {
+  (void)signal;
+  sample_due = 1;
+}
+
+static bool set_timer(void (*handler)(int), int interval) {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = handler;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  struct itimerval timer = {
+      .it_interval = {.tv_sec = 0, .tv_usec = interval},
+      .it_value = {.tv_sec = 0, .tv_usec = interval}};
+  // the handler goes first when starting, the timer when stopping
+  if (interval) {
+    return sigaction(SIGPROF, &action, NULL) == 0
+        && setitimer(ITIMER_PROF, &timer, NULL) == 0;
+  }
+  return setitimer(ITIMER_PROF, &timer, NULL) == 0
+      && sigaction(SIGPROF, &action, NULL) == 0;
+}
+#endif
+
+bool start_sampling(VM* vm, const char* path) {
+#ifdef _WIN32
+  (void)vm, (void)path;
+  return false;
+#else
+  Sampler* sampler = alloc(NULL, sizeof(Sampler));
+  *sampler = (Sampler) {
+      .path = alloc(NULL, strlen(path) + 1),
+      .length = 0,
+      .capacity = 0,
+      .samples = NULL,
+      .size = 0,
+      .buffer = NULL};
+  strcpy(sampler->path, path);
+  vm->sampler = sampler;
+  sample_due = 0;
+  return set_timer(on_sigprof, SAMPLE_INTERVAL_US);
+#endif
+}
+
+void take_sample(VM* vm) {
+  // the frames from the outermost, as "name (module:line)" each
+  Sampler* sampler = vm->sampler;
+  if (!sampler) {
+    sample_due = 0;
+    return;
+  }
+  int len = 0;
+  int first = vm->frame_count - SAMPLE_DEPTH_MAX;
+  first = first > 0 ? first : 0;
+  for (int i = first; i < vm->frame_count; i++) {
+    CallFrame* frame = &vm->frames[i];
+    ObjFn* fn = frame->closure->func;
+    char name[PROFILE_KEY_MAX];
+    int n = snprintf(
+        name,
+        PROFILE_KEY_MAX,
+        "%s%s (%s:%d)",
+        i > first ? ";" : "",
+        get_func_name(fn),
+        fn->module->name->str,
+        frame_line(vm, frame));
+    n = n < PROFILE_KEY_MAX ? n : PROFILE_KEY_MAX - 1;
+    if (len + n + 1 > sampler->size) {
+      int size = sampler->size ? sampler->size * 2 : PROFILE_KEY_MAX * 8;
+      sampler->size = size < len + n + 1 ? len + n + 1 : size;
+      sampler->buffer = alloc(sampler->buffer, sampler->size);
+    }
+    memcpy(sampler->buffer + len, name, n + 1);
+    len += n;
+  }
+  if (len) {
+    record_stack(sampler, len);
+  }
+  // a tick that came meanwhile is the sampler's own
+  sample_due = 0;
+}
+
+static int compare_stacks(const void* a, const void* b) {
+  return strcmp(((Sample*)a)->stack, ((Sample*)b)->stack);
+}
+
+void finish_sampling(VM* vm) {
+  // stops the timer and writes the samples out
+  Sampler* sampler = vm->sampler;
+  if (!sampler) {
+    return;
+  }
+  vm->sampler = NULL;
+#ifndef _WIN32
+  set_timer(SIG_IGN, 0);
+#endif
+  int n = 0;
+  for (int i = 0; i < sampler->capacity; i++) {
+    if (sampler->samples[i].stack) {
+      sampler->samples[n++] = sampler->samples[i];
+    }
+  }
+  qsort(sampler->samples, n, sizeof(Sample), compare_stacks);
+  FILE* file = fopen(sampler->path, "w");
+  if (!file) {
+    fprintf(stderr, "Could not write the samples to '%s'\n", sampler->path);
+  }
+  for (int i = 0; i < n; i++) {
+    if (file) {
+      fprintf(
+          file,
+          "%s %" PRIu64 "\n",
+          sampler->samples[i].stack,
+          sampler->samples[i].count);
+    }
+    free(sampler->samples[i].stack);
+  }
+  if (file) {
+    fclose(file);
+  }
+  free(sampler->samples);
+  free(sampler->buffer);
+  free(sampler->path);
+  free(sampler);
+}
+
+#ifdef EVE_OPCODE_STATS
+  // the pairs --opcode-stats lists in its table; the JSON has all of them
+  #define OPCODE_PAIRS_SHOWN (40)
+
+uint64_t op_counts[UINT8_MAX + 1];
+uint64_t op_pairs[UINT8_MAX + 1][UINT8_MAX + 1];
+
+typedef struct {
+  byte_t first;
+  byte_t second;  // what ran after `first`, for pairs
+  uint64_t count;
+} OpCount;
+
+static int compare_op_counts(const void* a, const void* b) {
+  // from most to least run, then in opcode order
+  const OpCount* x = a;
+  const OpCount* y = b;
+  if (x->count != y->count) {
+    return x->count < y->count ? 1 : -1;
+  }
+  if (x->first != y->first) {
+    return x->first - y->first;
+  }
+  return x->second - y->second;
+}
+
+static int collect_op_counts(OpCount* counts, bool pairs) {
+  int n = 0;
+  for (int i = 0; i <= UINT8_MAX; i++) {
+    for (int j = 0; j <= (pairs ? UINT8_MAX : 0); j++) {
+      uint64_t count = pairs ? op_pairs[i][j] : op_counts[i];
+      if (count) {
+        counts[n++] = (OpCount) {
+            .first = (byte_t)i,
+            .second = (byte_t)j,
+            .count = count};
+      }
+    }
+  }
+  qsort(counts, n, sizeof(OpCount), compare_op_counts);
+  return n;
+}
+
+static void dump_op_counts(
+    OpCount* counts,
+    int n,
+    bool pairs,
+    uint64_t total,
+    FILE* out) {
+  fprintf(out, "%14s  %6s  %s\n", "count", "%", pairs ? "pair" : "opcode");
+  for (int i = 0; i < n; i++) {
+    fprintf(
+        out,
+        "%14" PRIu64 "  %6.2f  %s%s%s\n",
+        counts[i].count,
+        100.0 * (double)counts[i].count / (double)total,
+        op_name(counts[i].first),
+        pairs ? " " : "",
+        pairs ? op_name(counts[i].second) : "");
+  }
+}
+
+static void write_op_counts(OpCount* counts, int n, bool pairs, FILE* out) {
+  for (int i = 0; i < n; i++) {
+    if (pairs) {
+      fprintf(
+          out,
+          "    {\"first\": \"%s\", \"second\": \"%s\", \"count\": %" PRIu64
+          "}%s\n",
+          op_name(counts[i].first),
+          op_name(counts[i].second),
+          counts[i].count,
+          i + 1 < n ? "," : "");
+    } else {
+      fprintf(
+          out,
+          "    {\"opcode\": \"%s\", \"count\": %" PRIu64 "}%s\n",
+          op_name(counts[i].first),
+          counts[i].count,
+          i + 1 < n ? "," : "");
+    }
+  }
+}
+#endif
+
+void dump_opcode_stats(FILE* out, const char* json) {
+  // the table to `out`, and all of the counts as JSON to the file `json`
+#ifdef EVE_OPCODE_STATS
+  OpCount* ops = alloc(NULL, sizeof(OpCount) * (UINT8_MAX + 1));
+  OpCount* pairs =
+      alloc(NULL, sizeof(OpCount) * (UINT8_MAX + 1) * (UINT8_MAX + 1));
+  int op_count = collect_op_counts(ops, false);
+  int pair_count = collect_op_counts(pairs, true);
+  uint64_t total = 0;
+  for (int i = 0; i < op_count; i++) {
+    total += ops[i].count;
+  }
+  fprintf(out, "%" PRIu64 " instructions\n", total);
+  if (total) {
+    dump_op_counts(ops, op_count, false, total, out);
+    dump_op_counts(
+        pairs,
+        pair_count < OPCODE_PAIRS_SHOWN ? pair_count : OPCODE_PAIRS_SHOWN,
+        true,
+        total,
+        out);
+  }
+  FILE* file = json ? fopen(json, "w") : NULL;
+  if (json && !file) {
+    fprintf(stderr, "Could not write the opcode counts to '%s'\n", json);
+  } else if (file) {
+    fprintf(file, "{\n  \"total\": %" PRIu64 ",\n", total);
+    fputs("  \"opcodes\": [\n", file);
+    write_op_counts(ops, op_count, false, file);
+    fputs("  ],\n  \"pairs\": [\n", file);
+    write_op_counts(pairs, pair_count, true, file);
+    fputs("  ]\n}\n", file);
+    fclose(file);
+  }
+  free(ops);
+  free(pairs);
+#else
+  (void)json;
+  fputs("eve was built without EVE_OPCODE_STATS, there are no counts\n", out);
+#endif
+}
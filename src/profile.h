@@ -0,0 +1,83 @@
+#ifndef EVE_PROFILE_H
+#define EVE_PROFILE_H
+#include <signal.h>
+
+#include "vm.h"
+
+/*
+ * execution counters, built with EVE_PROFILE: calls to each function,
+ * counted by call_value(), and back edges of each $LOOP, counted wherever
+ * the loop goes around (run(), run_reg(), machine code and traces, and C
+ * from --emit-c). scripts read them through core::profile, and --profile
+ * prints them on exit.
+ */
+
+#ifdef EVE_PROFILE
+  #define PROFILE_CALL(_fn) ((_fn)->calls++)
+  // `_ip` is the $LOOP's in the function's Code
+  #define PROFILE_LOOP(_fn, _ip) \
+    ((*back_edges((_fn), (int)((_ip) - (_fn)->code.bytes)))++)
+#else
+  #define PROFILE_CALL(_fn)
+  #define PROFILE_LOOP(_fn, _ip)
+#endif
+
+LoopCount* loop_counts(ObjFn* fn);
+
+inline static uint64_t* back_edges(ObjFn* fn, int offset) {
+  // the counter of the $LOOP at `offset` in the function's Code
+  LoopCount* loops = fn->back_edges ? fn->back_edges : loop_counts(fn);
+  int lo = 0, hi = fn->loop_count - 1;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (loops[mid].offset < offset) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return &loops[lo].count;
+}
+void reset_profile(VM* vm);
+ObjHashMap* profile_snapshot(VM* vm);
+void dump_profile(VM* vm, FILE* out);
+
+/*
+ * --sample-profile: a SIGPROF timer sets `sample_due`, and the next $LOOP
+ * or call in run(), run_reg() or jit_call() records the frames' functions
+ * and lines. the samples are written as folded stacks, one line per stack
+ * with its count, for flamegraph tools. loops inside machine code or C from
+ * --emit-c are sampled at their next call.
+ */
+
+#define SAMPLE_INTERVAL_US (1000)  // 1 kHz
+// deeper stacks keep their innermost frames, so that a sample of deep
+// recursion stays cheaper than the interval
+#define SAMPLE_DEPTH_MAX (128)
+
+extern volatile sig_atomic_t sample_due;
+
+bool start_sampling(VM* vm, const char* path);
+void take_sample(VM* vm);
+void finish_sampling(VM* vm);
+
+/*
+ * opcode counts, built with EVE_OPCODE_STATS: run() counts each instruction
+ * it dispatches, and each pair of an instruction and the one dispatched
+ * before it, for --opcode-stats. an instruction under $WIDE counts as the
+ * $WIDE. without EVE_OPCODE_STATS the dispatch reads the next byte alone.
+ */
+
+#ifdef EVE_OPCODE_STATS
+extern uint64_t op_counts[UINT8_MAX + 1];
+extern uint64_t op_pairs[UINT8_MAX + 1][UINT8_MAX + 1];
+
+inline static byte_t count_op(byte_t prev, byte_t inst) {
+  op_counts[inst]++;
+  op_pairs[prev][inst]++;
+  return inst;
+}
+#endif
+
+void dump_opcode_stats(FILE* out, const char* json);
+#endif  //EVE_PROFILE_H
@@ -0,0 +1,641 @@
+#include "regen.h"
+
+/*
+ * translation of finished stack code (see gen.c) into the register code run
+ * by run_reg().
+ * a frame's operand stack doubles as its register file: the value at stack
+ * depth `i` lives in frame slot `i`. locals therefore keep their slots, and
+ * calls, natives, upvalues and the gc see the same frame layout under both
+ * engines. the translator tracks the stack abstractly: pushes of locals and
+ * constants are only recorded, and are materialized into their slot when
+ * something needs them there - jumps and labels, and instructions that call,
+ * allocate or otherwise look at the stack as a whole.
+ */
+
+typedef enum {
+  V_REAL,  // the value is in its slot
+  V_CONST,  // the value is a constant not yet loaded into its slot
+  V_ALIAS,  // the value is a copy of another slot, which is real
+} VKind;
+
+typedef struct {
+  byte_t kind;
+  byte_t index;  // constant index or aliased slot
+} VEntry;
+
+typedef struct {
+  int at;  // position of the 2-byte jump operand in the register code
+  int target;  // stack code offset jumped to
+} Patch;
+
+typedef struct {
+  VM* vm;
+  Code* code;
+  RegCode* out;
+  int line;
+  int depth;
+  bool failed;
+  bool* targets;
+  int* depths;  // stack code offset -> stack depth on entry, -1 if unknown
+  int* offsets;  // stack code offset -> register code offset
+  Patch* patches;
+  int patch_count;
+  VEntry stack[UINT8_MAX];
+} RegGen;
+
+static void emit_reg(RegGen* rg, byte_t byte) {
+  write_reg_code(rg->out, byte, rg->line, rg->vm);
+}
+
+static void emit2(RegGen* rg, byte_t op, byte_t a) {
+  emit_reg(rg, op);
+  emit_reg(rg, a);
+}
+
+static void emit3(RegGen* rg, byte_t op, byte_t a, byte_t b) {
+  emit2(rg, op, a);
+  emit_reg(rg, b);
+}
+
+static void emit4(RegGen* rg, byte_t op, byte_t a, byte_t b, byte_t c) {
+  emit3(rg, op, a, b);
+  emit_reg(rg, c);
+}
+
+static void emit_target(RegGen* rg, int target, int depth) {
+  // jumps are patched once all offsets are known
+  rg->patches[rg->patch_count++] = (Patch) {rg->out->length, target};
+  if (rg->depths[target] == -1) {
+    rg->depths[target] = depth;
+  }
+  emit_reg(rg, 0xff);
+  emit_reg(rg, 0xff);
+}
+
+static void push(RegGen* rg, byte_t kind, byte_t index) {
+  if (rg->depth >= UINT8_MAX) {
+    rg->failed = true;
+    return;
+  }
+  rg->stack[rg->depth++] = (VEntry) {kind, index};
+}
+
+static void set_result(RegGen* rg, int depth) {
+  // the instruction left its result in slot `depth - 1`
+  if (depth > UINT8_MAX) {
+    rg->failed = true;
+    return;
+  }
+  rg->depth = depth;
+  rg->stack[depth - 1].kind = V_REAL;
+}
+
+static VEntry local(RegGen* rg, byte_t slot) {
+  // a local that is itself still pending is read from its source
+  if (slot < rg->depth && rg->stack[slot].kind != V_REAL) {
+    return rg->stack[slot];
+  }
+  return (VEntry) {V_ALIAS, slot};
+}
+
+static void materialize(RegGen* rg, int slot) {
+  VEntry* entry = &rg->stack[slot];
+  if (entry->kind == V_CONST) {
+    emit3(rg, $R_LOADK, slot, entry->index);
+  } else if (entry->kind == V_ALIAS && entry->index != slot) {
+    emit3(rg, $R_MOVE, slot, entry->index);
+  }
+  entry->kind = V_REAL;
+}
+
+static void flush(RegGen* rg) {
+  for (int i = 0; i < rg->depth; i++) {
+    materialize(rg, i);
+  }
+}
+
+static void unalias(RegGen* rg, byte_t slot, int below) {
+  // `slot` is about to be written: copy out the pending reads of it
+  for (int i = 0; i < below; i++) {
+    if (rg->stack[i].kind == V_ALIAS && rg->stack[i].index == slot) {
+      materialize(rg, i);
+    }
+  }
+}
+
+static byte_t operand(RegGen* rg, int slot) {
+  // the register holding the value at `slot`
+  VEntry entry = rg->stack[slot];
+  if (entry.kind == V_ALIAS) {
+    return entry.index;
+  }
+  materialize(rg, slot);
+  return slot;
+}
+
+static int store_target(RegGen* rg, int next, int* after) {
+  // `<op>; $SET_LOCAL_POP a` and `<op>; $SET_LOCAL a; $POP` compute straight
+  // into `a`
+  Code* code = rg->code;
+  if (next >= code->length || rg->targets[next]) {
+    return -1;
+  }
+  int slot = -1;
+  if (code->bytes[next] == $SET_LOCAL_POP) {
+    slot = code->bytes[next + 1];
+    *after = next + 2;
+  } else if (
+      code->bytes[next] == $SET_LOCAL && next + 2 < code->length
+      && !rg->targets[next + 2] && code->bytes[next + 2] == $POP) {
+    slot = code->bytes[next + 1];
+    *after = next + 3;
+  }
+  // only locals below the consumed operands
+  return slot < rg->depth ? slot : -1;
+}
+
+static void set_local(RegGen* rg, byte_t slot) {
+  int top = rg->depth - 1;
+  VEntry entry = rg->stack[top];
+  if (entry.kind == V_ALIAS && entry.index == slot) {
+    return;
+  }
+  unalias(rg, slot, top);
+  if (entry.kind == V_CONST) {
+    emit3(rg, $R_LOADK, slot, entry.index);
+  } else {
+    emit3(rg, $R_MOVE, slot, entry.kind == V_ALIAS ? entry.index : top);
+  }
+  if (slot < top) {
+    rg->stack[slot].kind = V_REAL;
+  }
+}
+
+static void compare_jump(RegGen* rg, byte_t op, byte_t b, byte_t c, int jump) {
+  // operands already popped; on a false comparison, false is left in the
+  // slot the comparison would have been pushed to
+  int depth = rg->depth;
+  flush(rg);
+  emit4(rg, op, depth, b, c);
+  emit_target(rg, jump_target(rg->code, jump), depth + 1);
+}
+
+static byte_t jump_op(byte_t op, bool konst) {
+  if (konst) {
+    return jump_op(op, false) - $R_EQ_JMP + $R_EQ_JMPK;
+  }
+  switch (op) {
+    case $R_EQ:
+      return $R_EQ_JMP;
+    case $R_NOT_EQ:
+      return $R_NOT_EQ_JMP;
+    case $R_LESS:
+      return $R_LESS_JMP;
+    case $R_GREATER:
+      return $R_GREATER_JMP;
+    case $R_LESS_OR_EQ:
+      return $R_LESS_OR_EQ_JMP;
+    case $R_GREATER_OR_EQ:
+      return $R_GREATER_OR_EQ_JMP;
+    default:
+      return 0;
+  }
+}
+
+static int binary(RegGen* rg, byte_t op, int next) {
+  int top = rg->depth - 1;
+  Code* code = rg->code;
+  // <cmp>; $JMP_FALSE_OR_POP
+  bool jumps = jump_op(op, false) && next < code->length
+      && !rg->targets[next] && code->bytes[next] == $JMP_FALSE_OR_POP;
+  VEntry right = rg->stack[top];
+  bool konst = right.kind == V_CONST
+      && (jumps || op == $R_ADD || op == $R_SUBTRACT);
+  byte_t b = operand(rg, top - 1);
+  byte_t c = konst ? right.index : operand(rg, top);
+  rg->depth = top - 1;
+  if (jumps) {
+    compare_jump(rg, jump_op(op, konst), b, c, next);
+    return next + inst_length(code, next);
+  }
+  if (konst) {
+    op = op == $R_ADD ? $R_ADDK : $R_SUBTRACTK;
+  }
+  int after = next;
+  int dst = store_target(rg, next, &after);
+  if (dst == -1) {
+    dst = rg->depth;
+    set_result(rg, rg->depth + 1);
+  } else {
+    unalias(rg, dst, rg->depth);
+    rg->stack[dst].kind = V_REAL;
+  }
+  emit4(rg, op, dst, b, c);
+  return after;
+}
+
+static int unary(RegGen* rg, byte_t op, int next) {
+  byte_t b = operand(rg, --rg->depth);
+  int after = next;
+  int dst = store_target(rg, next, &after);
+  if (dst == -1) {
+    dst = rg->depth;
+    set_result(rg, rg->depth + 1);
+  } else {
+    unalias(rg, dst, rg->depth);
+    rg->stack[dst].kind = V_REAL;
+  }
+  emit3(rg, op, dst, b);
+  return after;
+}
+
+static byte_t binary_op(byte_t op) {
+  switch (op) {
+    case $ADD:
+      return $R_ADD;
+    case $SUBTRACT:
+      return $R_SUBTRACT;
+    case $MULTIPLY:
+      return $R_MULTIPLY;
+    case $DIVIDE:
+      return $R_DIVIDE;
+    case $MOD:
+      return $R_MOD;
+    case $POW:
+      return $R_POW;
+    case $BW_LSHIFT:
+      return $R_BW_LSHIFT;
+    case $BW_RSHIFT:
+      return $R_BW_RSHIFT;
+    case $BW_AND:
+      return $R_BW_AND;
+    case $BW_XOR:
+      return $R_BW_XOR;
+    case $BW_OR:
+      return $R_BW_OR;
+    case $EQ:
+      return $R_EQ;
+    case $NOT_EQ:
+      return $R_NOT_EQ;
+    case $LESS:
+      return $R_LESS;
+    case $GREATER:
+      return $R_GREATER;
+    case $LESS_OR_EQ:
+      return $R_LESS_OR_EQ;
+    case $GREATER_OR_EQ:
+      return $R_GREATER_OR_EQ;
+    default:
+      UNREACHABLE("not a binary opcode");
+  }
+}
+
+static int translate(RegGen* rg, int i, bool* live) {
+  Code* code = rg->code;
+  byte_t* ip = code->bytes + i;
+  int next = i + inst_length(code, i);
+  int depth = rg->depth;
+  byte_t op = generic_opcode(*ip);
+  switch (op) {
+    case $LOAD_CONST:
+      push(rg, V_CONST, ip[1]);
+      break;
+    case $GET_LOCAL: {
+      VEntry entry = local(rg, ip[1]);
+      push(rg, entry.kind, entry.index);
+      break;
+    }
+    case $SET_LOCAL:
+      set_local(rg, ip[1]);
+      break;
+    case $SET_LOCAL_POP:
+      set_local(rg, ip[1]);
+      rg->depth--;
+      break;
+    case $POP:
+      rg->depth--;
+      break;
+    case $POP_N:
+      rg->depth -= ip[1];
+      break;
+    case $GET_UPVALUE:
+      emit3(rg, $R_GET_UPVALUE, depth, ip[1]);
+      push(rg, V_REAL, 0);
+      break;
+    case $SET_UPVALUE: {
+      byte_t b = operand(rg, depth - 1);
+      emit3(rg, $R_SET_UPVALUE, ip[1], b);
+      break;
+    }
+    case $GET_GLOBAL:
+      emit3(rg, $R_GET_GLOBAL, depth, ip[1]);
+      push(rg, V_REAL, 0);
+      break;
+    case $SET_GLOBAL:
+      flush(rg);
+      emit3(rg, $R_SET_GLOBAL, depth, ip[1]);
+      break;
+    case $DEFINE_GLOBAL:
+      flush(rg);
+      emit3(rg, $R_DEFINE_GLOBAL, depth, ip[1]);
+      rg->depth--;
+      break;
+    case $ADD_LOCALS: {
+      VEntry a = local(rg, ip[1]), b = local(rg, ip[2]);
+      push(rg, a.kind, a.index);
+      push(rg, b.kind, b.index);
+      return rg->failed ? next : binary(rg, $R_ADD, next);
+    }
+    case $ADD_CONST:
+    case $SUBTRACT_CONST:
+      push(rg, V_CONST, ip[1]);
+      return rg->failed
+          ? next
+          : binary(rg, op == $ADD_CONST ? $R_ADD : $R_SUBTRACT, next);
+    case $ADD:
+    case $SUBTRACT:
+    case $MULTIPLY:
+    case $DIVIDE:
+    case $MOD:
+    case $POW:
+    case $BW_LSHIFT:
+    case $BW_RSHIFT:
+    case $BW_AND:
+    case $BW_XOR:
+    case $BW_OR:
+    case $EQ:
+    case $NOT_EQ:
+    case $LESS:
+    case $GREATER:
+    case $LESS_OR_EQ:
+    case $GREATER_OR_EQ:
+      return binary(rg, binary_op(op), next);
+    case $LESS_JMP:
+    case $GREATER_JMP:
+    case $LESS_OR_EQ_JMP:
+    case $GREATER_OR_EQ_JMP:
+    case $EQ_JMP:
+    case $NOT_EQ_JMP: {
+      VEntry right = rg->stack[depth - 1];
+      bool konst = right.kind == V_CONST;
+      byte_t b = operand(rg, depth - 2);
+      byte_t c = konst ? right.index : operand(rg, depth - 1);
+      rg->depth -= 2;
+      byte_t cmp = op == $LESS_JMP ? $R_LESS
+          : op == $GREATER_JMP     ? $R_GREATER
+          : op == $LESS_OR_EQ_JMP  ? $R_LESS_OR_EQ
+          : op == $GREATER_OR_EQ_JMP ? $R_GREATER_OR_EQ
+          : op == $EQ_JMP            ? $R_EQ
+                                     : $R_NOT_EQ;
+      compare_jump(rg, jump_op(cmp, konst), b, c, i);
+      break;
+    }
+    case $NEGATE:
+      return unary(rg, $R_NEGATE, next);
+    case $NOT:
+      return unary(rg, $R_NOT, next);
+    case $BW_INVERT:
+      return unary(rg, $R_BW_INVERT, next);
+    case $JMP:
+      flush(rg);
+      emit_reg(rg, $R_JMP);
+      emit_target(rg, jump_target(code, i), depth);
+      *live = false;
+      break;
+    case $LOOP: {
+      flush(rg);
+      emit_reg(rg, $R_LOOP);
+      emit_reg(rg, (i >> 8) & 0xff);
+      emit_reg(rg, i & 0xff);
+      int offset = rg->out->length + 2 - rg->offsets[jump_target(code, i)];
+      emit_reg(rg, (offset >> 8) & 0xff);
+      emit_reg(rg, offset & 0xff);
+      rg->failed |= offset > UINT16_MAX || i > UINT16_MAX;
+      *live = false;
+      break;
+    }
+    case $JMP_FALSE:
+    case $JMP_FALSE_OR_POP:
+      flush(rg);
+      emit2(rg, $R_JMP_FALSE, depth - 1);
+      emit_target(rg, jump_target(code, i), depth);
+      rg->depth -= op == $JMP_FALSE_OR_POP;
+      break;
+    case $ITER_PREP:
+      flush(rg);
+      emit2(rg, $R_ITER_PREP, depth);
+      set_result(rg, depth + 1);
+      break;
+    case $FOR_ITER:
+      // pushes the next element, unless it jumps
+      flush(rg);
+      emit2(rg, $R_FOR_ITER, depth);
+      emit_target(rg, jump_target(code, i), depth);
+      set_result(rg, depth + 1);
+      break;
+    case $THROW:
+      flush(rg);
+      emit2(rg, $R_THROW, depth);
+      *live = false;
+      break;
+    case $CALL:
+    case $TAIL_CALL:
+      flush(rg);
+      emit3(rg, op == $CALL ? $R_CALL : $R_TAIL_CALL, depth, ip[1]);
+      set_result(rg, depth - ip[1]);
+      break;
+    case $RET_LOCAL: {
+      VEntry entry = local(rg, ip[1]);
+      push(rg, entry.kind, entry.index);
+      if (rg->failed) {
+        break;
+      }
+      emit2(rg, $R_RET, operand(rg, depth));
+      *live = false;
+      break;
+    }
+    case $RET:
+      emit2(rg, $R_RET, operand(rg, depth - 1));
+      *live = false;
+      break;
+    case $SUBSCRIPT:
+      flush(rg);
+      emit2(rg, $R_SUBSCRIPT, depth);
+      set_result(rg, depth - 1);
+      break;
+    case $SET_SUBSCRIPT:
+      flush(rg);
+      emit2(rg, $R_SET_SUBSCRIPT, depth);
+      rg->depth -= 2;
+      break;
+    case $GET_FIELD:
+    case $GET_PROPERTY:
+      flush(rg);
+      emit_reg(rg, op == $GET_FIELD ? $R_GET_FIELD : $R_GET_PROPERTY);
+      emit4(rg, depth, ip[1], ip[2], ip[3]);
+      break;
+    case $SET_PROPERTY:
+      flush(rg);
+      emit3(rg, $R_SET_PROPERTY, depth, ip[1]);
+      rg->depth--;
+      break;
+    case $LEN:
+    case $TYPEOF:
+      // the call it may fall back to takes the slot at `depth` too
+      flush(rg);
+      emit4(rg, op == $LEN ? $R_LEN : $R_TYPEOF, depth, ip[1], ip[2]);
+      break;
+    case $BUILD_LIST:
+      flush(rg);
+      emit3(rg, $R_BUILD_LIST, depth, ip[1]);
+      set_result(rg, depth - ip[1] + 1);
+      break;
+    case $BUILD_MAP:
+      flush(rg);
+      emit3(rg, $R_BUILD_MAP, depth, ip[1]);
+      set_result(rg, depth - ip[1] * 2 + 1);
+      break;
+    case $BUILD_CLOSURE:
+      flush(rg);
+      emit3(rg, $R_BUILD_CLOSURE, depth, ip[1]);
+      for (int j = 2; j < next - i; j++) {
+        emit_reg(rg, ip[j]);
+      }
+      set_result(rg, depth + 1);
+      break;
+    case $BUILD_STRUCT:
+      flush(rg);
+      emit4(rg, $R_BUILD_STRUCT, depth, ip[1], ip[2]);
+      set_result(rg, depth - ip[2] * 2 + 1);
+      break;
+    case $BUILD_INSTANCE:
+      flush(rg);
+      emit3(rg, $R_BUILD_INSTANCE, depth, ip[1]);
+      set_result(rg, depth - ip[1] * 2);
+      break;
+    case $DISPLAY:
+      flush(rg);
+      emit3(rg, $R_DISPLAY, depth, ip[1]);
+      rg->depth -= ip[1];
+      break;
+    case $ASSERT:
+      flush(rg);
+      emit2(rg, $R_ASSERT, depth);
+      rg->depth -= 2;
+      break;
+    case $CLOSE_UPVALUE:
+      materialize(rg, depth - 1);
+      emit2(rg, $R_CLOSE_UPVALUE, depth - 1);
+      rg->depth--;
+      break;
+    case $WIDE:
+      // register operands are a byte, such functions run in run()
+      rg->failed = true;
+      break;
+    default:
+      UNREACHABLE("unknown opcode");
+  }
+  return next;
+}
+
+bool regen(VM* vm, ObjFn* fn) {
+  /*
+   * a single forward pass: the stack depth is carried through fall-through
+   * code and recorded at the targets of forward jumps, so code following an
+   * unconditional jump is only translated once a jump to it was seen (loop
+   * starts are always reached by fall-through first). all slots are real at
+   * labels.
+   */
+  Code* code = &fn->code;
+  int len = code->length;
+  RegGen rg = {
+      .vm = vm,
+      .code = code,
+      .out = &fn->reg,
+      .line = 0,
+      .depth = fn->arity + 1,
+      .failed = false,
+      .patch_count = 0};
+  rg.targets = ALLOC(vm, bool, len + 1);
+  rg.depths = ALLOC(vm, int, len + 1);
+  rg.offsets = ALLOC(vm, int, len + 1);
+  rg.patches = ALLOC(vm, Patch, len);
+  memset(rg.targets, 0, sizeof(bool) * (len + 1));
+  for (int i = 0; i <= len; i++) {
+    rg.depths[i] = -1;
+  }
+  int target;
+  for (int i = 0; i < len; i += inst_length(code, i)) {
+    if ((target = jump_target(code, i)) != -1) {
+      rg.targets[target] = true;
+    }
+  }
+  // a try's bounds are labels too: its slots are real when it starts, and
+  // no instruction is translated across them. its handler is entered with
+  // the error pushed
+  for (int i = 0; i < code->handler_count; i++) {
+    Handler* handler = &code->handlers[i];
+    rg.targets[handler->start] = true;
+    rg.targets[handler->end] = true;
+    rg.targets[handler->target] = true;
+    if (handler->depth != -1) {
+      rg.depths[handler->target] = handler->depth + 1;
+      rg.failed |= handler->depth + 1 > UINT8_MAX;
+    }
+  }
+  for (int i = 0; i < rg.depth; i++) {
+    rg.stack[i].kind = V_REAL;
+  }
+  bool live = true;
+  for (int i = 0; i < len && !rg.failed;) {
+    if (rg.targets[i]) {
+      if (live) {
+        flush(&rg);
+        rg.depths[i] = rg.depth;
+      } else if (rg.depths[i] != -1) {
+        live = true;
+        rg.depth = rg.depths[i];
+        for (int j = 0; j < rg.depth; j++) {
+          rg.stack[j].kind = V_REAL;
+        }
+      }
+    }
+    rg.offsets[i] = rg.out->length;
+    if (!live) {
+      i += inst_length(code, i);
+      continue;
+    }
+    rg.line = code->lines[i];
+    i = translate(&rg, i, &live);
+  }
+  rg.offsets[len] = rg.out->length;
+  for (int i = 0; i < rg.patch_count && !rg.failed; i++) {
+    Patch* patch = &rg.patches[i];
+    int offset = rg.offsets[patch->target] - (patch->at + 2);
+    rg.out->bytes[patch->at] = (offset >> 8) & 0xff;
+    rg.out->bytes[patch->at + 1] = offset & 0xff;
+    rg.failed |= offset > UINT16_MAX;
+  }
+  if (code->handler_count && !rg.failed) {
+    RegCode* out = rg.out;
+    out->handlers = ALLOC(vm, Handler, code->handler_count);
+    out->handler_count = code->handler_count;
+    for (int i = 0; i < code->handler_count; i++) {
+      Handler* handler = &code->handlers[i];
+      out->handlers[i] = (Handler) {
+          .start = rg.offsets[handler->start],
+          .end = rg.offsets[handler->end],
+          .target = rg.offsets[handler->target],
+          .depth = handler->depth};
+    }
+  }
+  FREE_BUFFER(vm, rg.targets, bool, len + 1);
+  FREE_BUFFER(vm, rg.depths, int, len + 1);
+  FREE_BUFFER(vm, rg.offsets, int, len + 1);
+  FREE_BUFFER(vm, rg.patches, Patch, len);
+  if (rg.failed) {
+    free_reg_code(&fn->reg, vm);
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,6 @@
+#ifndef EVE_REGEN_H
+#define EVE_REGEN_H
+#include "gen.h"
+
+bool regen(VM* vm, ObjFn* fn);
+#endif  //EVE_REGEN_H
@@ -1,5 +1,7 @@
 #include "serde.h"
 
+#include "gen.h"
+
 #define VALUE_TYPE (0xf5)
 #define VALUE_POOL_END (0xfff)
 #define UNUSED(_v_) (_v_)
@@ -42,6 +44,7 @@ void init_serde(EveSerde* serde, SerdeMode mode, VM* vm, error_cb cb) {
   serde->mode = mode;
   serde->callback = cb;
   serde->vm = vm;
+  serde->fn_count = 0;
 }
 
 void free_serde(EveSerde* serde) {
@@ -53,9 +56,13 @@ void free_serde(EveSerde* serde) {
 
 void write_magic_bits(EveSerde* serde) {
   uint64_t bits = MAGIC_BITS;
-  int version[] = {EVE_VERSION_MAJOR, EVE_VERSION_MINOR, EVE_VERSION_PATCH};
+  int version[] = {
+      EVE_VERSION_MAJOR,
+      EVE_VERSION_MINOR,
+      EVE_VERSION_PATCH,
+      EVE_BYTECODE_VERSION};
   fwrite(&bits, sizeof(uint64_t), 1, serde->file);
-  fwrite(&version, sizeof(int), 3, serde->file);
+  fwrite(&version, sizeof(int), 4, serde->file);
 }
 
 static inline bool check_magic_bits(EveSerde* serde) {
@@ -65,41 +72,64 @@ static inline bool check_magic_bits(EveSerde* serde) {
 }
 
 static inline bool check_version(EveSerde* serde) {
-  int version[3];
-  fread(&version, sizeof(int), 3, serde->file);
+  int version[4];
+  fread(&version, sizeof(int), 4, serde->file);
   return (
       version[0] == EVE_VERSION_MAJOR && version[1] == EVE_VERSION_MINOR
-      && version[2] == EVE_VERSION_PATCH);
+      && version[2] == EVE_VERSION_PATCH
+      && version[3] == EVE_BYTECODE_VERSION);
 }
 
 void ser_code(EveSerde* serde, Code* code) {
   /*
    * .length length
    * .capacity capacity
+   * .ic_count inline cache count
    * .code bytecode
    * .code bytecode
    * ...
    * .line line
    * .line line
    * ...
+   * .handler_count exception table length
+   * .handler start, end, target, depth
+   * ...
    * .serialise value-pool
    */
-  int buff[] = {code->length, code->capacity};
-  fwrite(buff, sizeof(int), 2, serde->file);
-  fwrite(code->bytes, sizeof(byte_t), code->length, serde->file);
+  int buff[] = {code->length, code->capacity, code->ic_count};
+  fwrite(buff, sizeof(int), 3, serde->file);
+  // only generic opcodes are persisted, quickening is a runtime detail
+  for (int i = 0; i < code->length; i += inst_length(code, i)) {
+    fputc(generic_opcode(code->bytes[i]), serde->file);
+    fwrite(
+        code->bytes + i + 1,
+        sizeof(byte_t),
+        inst_length(code, i) - 1,
+        serde->file);
+  }
   fwrite(code->lines, sizeof(int), code->length, serde->file);
+  fwrite(&code->handler_count, sizeof(int), 1, serde->file);
+  fwrite(code->handlers, sizeof(Handler), code->handler_count, serde->file);
   ser_vpool(serde, &code->vpool);
 }
 
 void de_code(EveSerde* serde, Code* code) {
-  int buff[2];
-  fread(buff, sizeof(int), 2, serde->file);
+  int buff[3];
+  fread(buff, sizeof(int), 3, serde->file);
   code->length = buff[0];
   code->capacity = buff[1];
+  code->ic_count = buff[2];
   code->bytes = GROW_BUFFER(serde->vm, NULL, byte_t, 0, code->capacity);
   code->lines = GROW_BUFFER(serde->vm, NULL, int, 0, code->capacity);
   fread(code->bytes, sizeof(byte_t), code->length, serde->file);
   fread(code->lines, sizeof(int), code->length, serde->file);
+  fread(&code->handler_count, sizeof(int), 1, serde->file);
+  code->handler_capacity = code->handler_count;
+  if (code->handler_count) {
+    code->handlers = ALLOC(serde->vm, Handler, code->handler_count);
+    fread(code->handlers, sizeof(Handler), code->handler_count, serde->file);
+  }
+  init_caches(code, serde->vm);
   de_vpool(serde, &code->vpool);
 }
 
@@ -190,6 +220,7 @@ ObjString* de_string(EveSerde* serde) {
   fread(&hash, sizeof(uint32_t), 1, serde->file);
   char* str = alloc(NULL, len + 1);
   fread(str, sizeof(char), len, serde->file);
+  str[len] = '\0';
   ObjString* string =
       create_de_string(serde->vm, &serde->vm->strings, str, len, hash);
   return string;
@@ -218,11 +249,27 @@ Value de_struct(EveSerde* serde, ObjTy ty) {
 }
 
 void ser_module(EveSerde* serde, ObjStruct* strukt) {
+  /*
+   * .serialise struct
+   * .globals-len len
+   * .serialise global names (ObjString), by slot
+   */
   ser_struct(serde, strukt);
+  fwrite(&strukt->globals.length, sizeof(int), 1, serde->file);
+  for (int i = 0; i < strukt->globals.length; i++) {
+    ser_string(serde, global_name(strukt, i));
+  }
 }
 
 Value de_module(EveSerde* serde) {
-  return de_struct(serde, OBJ_MODULE);
+  // the code indexes globals by slot, so they're reserved in the same order
+  Value module = de_struct(serde, OBJ_MODULE);
+  int len;
+  fread(&len, sizeof(int), 1, serde->file);
+  for (int i = 0; i < len; i++) {
+    module_slot(serde->vm, AS_MODULE(module), de_string(serde));
+  }
+  return module;
 }
 
 void ser_fn(EveSerde* serde, ObjFn* fn) {
@@ -230,14 +277,15 @@ void ser_fn(EveSerde* serde, ObjFn* fn) {
    * .type type
    * .arity arity
    * .env-len len
+   * .max-stack size
    * .serialise name (ObjString)
    * .serialise code
    * .serialise module (ObjStruct)
    */
-  static int i = 0;
   ser_obj(serde, &fn->obj);
   fputc(fn->arity, serde->file);
-  fputc(fn->env_len, serde->file);
+  fwrite(&fn->env_len, sizeof(int), 1, serde->file);
+  fwrite(&fn->max_stack, sizeof(int), 1, serde->file);
   if (fn->name) {
     fputc(1, serde->file);
     ser_string(serde, fn->name);
@@ -245,7 +293,7 @@ void ser_fn(EveSerde* serde, ObjFn* fn) {
     fputc(0, serde->file);
   }
   ser_code(serde, &fn->code);
-  if (i == 0) {
+  if (serde->fn_count++ == 0) {
     // $$SERDE_MODULE_HACK$$
     // we only need to ser this once, afterwards,
     // the others would be initialized through this.
@@ -253,7 +301,6 @@ void ser_fn(EveSerde* serde, ObjFn* fn) {
     // in the current module are initialized to the same module
     ser_module(serde, fn->module);
   }
-  i++;
 }
 
 ObjFn* de_fn(EveSerde* serde) {
@@ -261,7 +308,8 @@ ObjFn* de_fn(EveSerde* serde) {
   SERDE_ASSERT(serde, type == OBJ_FN, "start type should be function type");
   ObjFn* fn = create_function(serde->vm);
   fn->arity = fgetc(serde->file);
-  fn->env_len = fgetc(serde->file);
+  fread(&fn->env_len, sizeof(int), 1, serde->file);
+  fread(&fn->max_stack, sizeof(int), 1, serde->file);
   bool has_name = fgetc(serde->file);
   if (has_name) {
     fn->name = de_string(serde);
@@ -297,6 +345,8 @@ void ser_object(EveSerde* serde, Obj* obj) {
     case OBJ_INSTANCE:
     case OBJ_HMAP:
     case OBJ_CFN:
+    case OBJ_ITERATOR:
+    case OBJ_RANGE:
       SERDE_ASSERT(serde, false, "Unreachable: object type");
   }
 }
@@ -318,6 +368,8 @@ Value de_object(EveSerde* serde) {
     case OBJ_INSTANCE:
     case OBJ_CFN:
     case OBJ_HMAP:
+    case OBJ_ITERATOR:
+    case OBJ_RANGE:
     default:
       SERDE_ASSERT(serde, false, "Unreachable: object type");
   }
@@ -334,12 +386,19 @@ bool serialize(EveSerde* serde, const char* filename, ObjFn* script) {
   if (!file) {
     return false;
   }
+  serialize_file(serde, file, script);
+  fclose(file);
+  return true;
+}
+
+void serialize_file(EveSerde* serde, FILE* file, ObjFn* script) {
+  // `file` stays open, as the caller's
   serde->file = file;
+  serde->fn_count = 0;
   write_magic_bits(serde);
   ser_object(serde, (Obj*)script);
   fflush(serde->file);
-  fclose(file);
-  return true;
+  serde->file = NULL;
 }
 
 ObjFn* deserialize(EveSerde* serde, const char* filename) {
@@ -359,3 +418,14 @@ ObjFn* deserialize(EveSerde* serde, const char* filename) {
   ObjFn* func = de_fn(serde);
   return func;
 }
+
+ObjFn* deserialize_file(EveSerde* serde, FILE* file) {
+  // `file` stays open, as the caller's
+  serde->file = file;
+  ObjFn* func = NULL;
+  if (check_magic_bits(serde) && check_version(serde)) {
+    func = de_fn(serde);
+  }
+  serde->file = NULL;
+  return func;
+}
@@ -15,11 +15,14 @@ typedef struct {
   SerdeMode mode;
   VM* vm;
   error_cb callback;
+  int fn_count;  // functions written to the current file, see ser_fn()
 } EveSerde;
 
 void init_serde(EveSerde* serde, SerdeMode mode, VM* vm, error_cb cb);
 void free_serde(EveSerde* serde);
 bool serialize(EveSerde* serde, const char* filename, ObjFn* script);
 ObjFn* deserialize(EveSerde* serde, const char* filename);
+void serialize_file(EveSerde* serde, FILE* file, ObjFn* script);
+ObjFn* deserialize_file(EveSerde* serde, FILE* file);
 
 #endif  //EVE_SERDE_H
@@ -3,14 +3,19 @@
 #include "map.h"
 #include "vm.h"
 
+inline static uint32_t hash_bits(uint64_t hash);
+
 void init_value_pool(ValuePool* vp) {
   vp->values = NULL;
   vp->length = 0;
   vp->capacity = 0;
+  vp->index = NULL;
+  vp->index_capacity = 0;
 }
 
 void free_value_pool(ValuePool* vp, VM* vm) {
   FREE_BUFFER(vm, vp->values, Value, vp->capacity);
+  FREE_BUFFER(vm, vp->index, int, vp->index_capacity);
   init_value_pool(vp);
 }
 
@@ -24,17 +29,62 @@ int write_value(ValuePool* vp, Value v, VM* vm) {
   return vp->length++;
 }
 
+static int* index_entry(ValuePool* vp, Value v) {
+  // the index entry of `v`, or the empty one it would take
+  uint32_t mask = vp->index_capacity - 1;
+  for (uint32_t i = hash_bits(v) & mask;; i = (i + 1) & mask) {
+    int* entry = &vp->index[i];
+    if (!*entry || vp->values[*entry - 1] == v) {
+      return entry;
+    }
+  }
+}
+
+int intern_value(ValuePool* vp, Value v, VM* vm) {
+  // the slot of a value already in the pool, or a new one. values are equal
+  // by identity here: strings are interned, and numbers compare by their bits
+  if (vp->length * 2 >= vp->index_capacity) {
+    int* index = vp->index;
+    int capacity = vp->index_capacity;
+    vp->index_capacity = GROW_CAPACITY(capacity);
+    vp->index = ALLOC(vm, int, vp->index_capacity);
+    memset(vp->index, 0, sizeof(int) * vp->index_capacity);
+    for (int i = 0; i < capacity; i++) {
+      if (index[i]) {
+        *index_entry(vp, vp->values[index[i] - 1]) = index[i];
+      }
+    }
+    FREE_BUFFER(vm, index, int, capacity);
+  }
+  int* entry = index_entry(vp, v);
+  if (!*entry) {
+    *entry = write_value(vp, v, vm) + 1;
+  }
+  return *entry - 1;
+}
+
 void init_code(Code* code) {
   code->lines = NULL;
   code->bytes = NULL;
   code->length = 0;
   code->capacity = 0;
+  code->ic_count = 0;
+  code->caches = NULL;
+  code->handler_count = 0;
+  code->handler_capacity = 0;
+  code->handlers = NULL;
   init_value_pool(&code->vpool);
 }
 
 void free_code(Code* code, VM* vm) {
   FREE_BUFFER(vm, code->bytes, byte_t, code->capacity);
   FREE_BUFFER(vm, code->lines, int, code->capacity);
+  if (code->caches) {
+    FREE_BUFFER(vm, code->caches, InlineCache, code->ic_count);
+  }
+  if (code->handlers) {
+    FREE_BUFFER(vm, code->handlers, Handler, code->handler_capacity);
+  }
   free_value_pool(&code->vpool, vm);
   init_code(code);
 }
@@ -51,6 +101,67 @@ void write_code(Code* code, byte_t byte, int line, VM* vm) {
   code->lines[code->length++] = line;
 }
 
+void write_handler(Code* code, Handler handler, VM* vm) {
+  if (code->handler_count >= code->handler_capacity) {
+    int capacity = GROW_CAPACITY(code->handler_capacity);
+    code->handlers = GROW_BUFFER(
+        vm,
+        code->handlers,
+        Handler,
+        code->handler_capacity,
+        capacity);
+    code->handler_capacity = capacity;
+  }
+  code->handlers[code->handler_count++] = handler;
+}
+
+void init_reg_code(RegCode* code) {
+  code->declined = false;
+  code->lines = NULL;
+  code->bytes = NULL;
+  code->length = 0;
+  code->capacity = 0;
+  code->handler_count = 0;
+  code->handlers = NULL;
+}
+
+void free_reg_code(RegCode* code, VM* vm) {
+  FREE_BUFFER(vm, code->bytes, byte_t, code->capacity);
+  FREE_BUFFER(vm, code->lines, int, code->capacity);
+  if (code->handlers) {
+    FREE_BUFFER(vm, code->handlers, Handler, code->handler_count);
+  }
+  init_reg_code(code);
+}
+
+void init_jit_code(JitCode* code) {
+  code->declined = false;
+  code->size = 0;
+  code->bytes = NULL;
+  code->length = 0;
+  code->entries = NULL;
+  code->aot = NULL;
+}
+
+void write_reg_code(RegCode* code, byte_t byte, int line, VM* vm) {
+  if (code->length >= code->capacity) {
+    code->capacity = GROW_CAPACITY(code->capacity);
+    code->bytes =
+        GROW_BUFFER(vm, code->bytes, byte_t, code->length, code->capacity);
+    code->lines =
+        GROW_BUFFER(vm, code->lines, int, code->length, code->capacity);
+  }
+  code->bytes[code->length] = byte;
+  code->lines[code->length++] = line;
+}
+
+void init_caches(Code* code, VM* vm) {
+  if (code->ic_count) {
+    code->caches = ALLOC(vm, InlineCache, code->ic_count);
+    memset(code->caches, 0, sizeof(InlineCache) * code->ic_count);
+  }
+}
+
 char* get_object_type(Obj* obj) {
   switch (obj->type) {
     case OBJ_STR:
@@ -72,6 +183,10 @@ char* get_object_type(Obj* obj) {
       return "module";
     case OBJ_CFN:
       return "builtin_function";
+    case OBJ_ITERATOR:
+      return "iterator";
+    case OBJ_RANGE:
+      return "range";
   }
   UNREACHABLE("unknown object type");
 }
@@ -189,6 +304,19 @@ void print_object(Value val, Obj* obj) {
       printf("{builtin_fn %s}", AS_CFUNC(val)->name);
       return;
     }
+    case OBJ_ITERATOR: {
+      printf("{iterator}");
+      return;
+    }
+    case OBJ_RANGE: {
+      ObjRange* range = AS_RANGE(val);
+      printf("{range %.14g..%.14g", range->start, range->stop);
+      if (range->step != 1) {
+        printf(" by %.14g", range->step);
+      }
+      printf("}");
+      return;
+    }
   }
   UNREACHABLE("print: unknown object type");
 }
@@ -257,6 +385,20 @@ Value object_to_string(VM* vm, Value val) {
       len = snprintf(buff, len, "@builtin_fn[%s]", name);
       return create_stringv(vm, &vm->strings, buff, len, false);
     }
+    case OBJ_ITERATOR:
+      return create_stringv(vm, &vm->strings, "@iterator", 9, false);
+    case OBJ_RANGE: {
+      ObjRange* range = AS_RANGE(val);
+      char buff[80];
+      int len = snprintf(
+          buff,
+          80,
+          "@range[%.14g, %.14g, %.14g]",
+          range->start,
+          range->stop,
+          range->step);
+      return create_stringv(vm, &vm->strings, buff, len, false);
+    }
     case OBJ_FN:
     case OBJ_UPVALUE:
       break;
@@ -386,21 +528,30 @@ ObjHashMap* create_hashmap(VM* vm) {
 ObjFn* create_function(VM* vm) {
   ObjFn* fn = CREATE_OBJ(vm, ObjFn, OBJ_FN, sizeof(ObjFn));
   init_code(&fn->code);
+  init_reg_code(&fn->reg);
+  init_jit_code(&fn->jit);
+  fn->hotness = 0;
+  fn->calls = 0;
+  fn->loop_count = 0;
+  fn->back_edges = NULL;
+  fn->traces = NULL;
   fn->arity = 0;
   fn->env_len = 0;
+  fn->max_stack = 0;
   fn->name = NULL;
   fn->module = NULL;
   return fn;
 }
 
 ObjClosure* create_closure(VM* vm, ObjFn* func) {
-  Env env = GROW_BUFFER(vm, NULL, ObjUpvalue*, 0, func->env_len);
+  ObjClosure* closure = CREATE_OBJ(
+      vm,
+      ObjClosure,
+      OBJ_CLOSURE,
+      sizeof(ObjClosure) + (sizeof(ObjUpvalue*) * func->env_len));
   for (int i = 0; i < func->env_len; i++) {
-    env[i] = NULL;
+    closure->env[i] = NULL;
   }
-  ObjClosure* closure =
-      CREATE_OBJ(vm, ObjClosure, OBJ_CLOSURE, sizeof(ObjClosure));
-  closure->env = env;
   closure->func = func;
   closure->env_len = func->env_len;
   return closure;
@@ -409,7 +560,6 @@ ObjClosure* create_closure(VM* vm, ObjFn* func) {
 ObjUpvalue* create_upvalue(VM* vm, Value* location) {
   ObjUpvalue* upvalue =
       CREATE_OBJ(vm, ObjUpvalue, OBJ_UPVALUE, sizeof(ObjUpvalue));
-  upvalue->next = NULL;
   upvalue->location = location;
   upvalue->value = NONE_VAL;
   return upvalue;
@@ -420,6 +570,7 @@ ObjStruct* create_struct(VM* vm, ObjString* name) {
       CREATE_OBJ(vm, ObjStruct, OBJ_STRUCT, sizeof(ObjStruct));
   map_init(&strukt->fields);
   strukt->name = name;
+  init_value_pool(&strukt->globals);
   return strukt;
 }
 
@@ -429,6 +580,62 @@ ObjStruct* create_module(VM* vm, ObjString* name) {
   return mod;
 }
 
+int module_slot(VM* vm, ObjStruct* module, ObjString* name) {
+  // the slot of the global `name`, reserved (undefined) if it's new. the
+  // compiler resolves global names to slots, which $GET_GLOBAL, $SET_GLOBAL
+  // and $DEFINE_GLOBAL index; `fields` maps the names for everything else
+  Value slot = map_get(&module->fields, name);
+  if (slot != NOTHING_VAL) {
+    return (int)AS_NUMBER(slot);
+  }
+  int index = write_value(&module->globals, NOTHING_VAL, vm);
+  map_put(&module->fields, vm, name, NUMBER_VAL(index));
+  return index;
+}
+
+Value module_get(ObjStruct* module, ObjString* name) {
+  Value slot = map_get(&module->fields, name);
+  return slot == NOTHING_VAL ? slot
+                             : module->globals.values[(int)AS_NUMBER(slot)];
+}
+
+void module_put(VM* vm, ObjStruct* module, ObjString* name, Value value) {
+  // defines (or redefines) the global `name`
+  Value slot = map_get(&module->fields, name);
+  if (slot != NOTHING_VAL) {
+    module->globals.values[(int)AS_NUMBER(slot)] = value;
+  } else {
+    int index = write_value(&module->globals, value, vm);
+    map_put(&module->fields, vm, name, NUMBER_VAL(index));
+  }
+}
+
+void module_copy(VM* vm, ObjStruct* module, ObjStruct* from) {
+  // defines the globals `from` has defined in module
+  MapEntry* entry;
+  for (int i = 0; i < from->fields.capacity; i++) {
+    entry = &from->fields.entries[i];
+    if (entry->key) {
+      Value value = from->globals.values[(int)AS_NUMBER(entry->value)];
+      if (value != NOTHING_VAL) {
+        module_put(vm, module, entry->key, value);
+      }
+    }
+  }
+}
+
+ObjString* global_name(ObjStruct* module, int slot) {
+  // the name of the global at `slot`, for error messages
+  MapEntry* entry;
+  for (int i = 0; i < module->fields.capacity; i++) {
+    entry = &module->fields.entries[i];
+    if (entry->key && entry->value == NUMBER_VAL(slot)) {
+      return entry->key;
+    }
+  }
+  return NULL;
+}
+
 ObjInstance* create_instance(VM* vm, ObjStruct* strukt) {
   ObjInstance* instance =
       CREATE_OBJ(vm, ObjInstance, OBJ_INSTANCE, sizeof(ObjInstance));
@@ -445,6 +652,75 @@ ObjCFn* create_cfn(VM* vm, CFn fn, int arity, const char* name) {
   return func;
 }
 
+ObjIterator* create_iterator(VM* vm, IterKind kind, Obj* iterable) {
+  ObjIterator* iter =
+      CREATE_OBJ(vm, ObjIterator, OBJ_ITERATOR, sizeof(ObjIterator));
+  iter->kind = kind;
+  iter->cursor = 0;
+  iter->capacity = kind >= ITER_KEYS && kind <= ITER_ITEMS
+      ? ((ObjHashMap*)iterable)->capacity
+      : 0;
+  iter->iterable = iterable;
+  return iter;
+}
+
+ObjRange* create_range(VM* vm, double start, double stop, double step) {
+  ObjRange* range = CREATE_OBJ(vm, ObjRange, OBJ_RANGE, sizeof(ObjRange));
+  range->start = start;
+  range->stop = stop;
+  range->step = step;
+  return range;
+}
+
+bool iterate(VM* vm, IterKind kind, Obj* iterable, int* cursor, Value* elem) {
+  // the element at `*cursor` into `elem`, advancing the cursor past it;
+  // false once there is none. hashmaps are walked over their entries as they
+  // are; a map that grows meanwhile is caught by iterator_moved()
+  int index = *cursor;
+  if (kind == ITER_LIST) {
+    ObjList* list = (ObjList*)iterable;
+    if (index >= list->elems.length) {
+      return false;
+    }
+    *elem = list->elems.buffer[index];
+  } else if (kind == ITER_STRING) {
+    ObjString* str = (ObjString*)iterable;
+    if (index >= str->length) {
+      return false;
+    }
+    *elem = create_stringv(vm, &vm->strings, str->str + index, 1, false);
+  } else if (kind == ITER_RANGE) {
+    ObjRange* range = (ObjRange*)iterable;
+    double num = range->start + index * range->step;
+    if (range->step > 0 ? num >= range->stop : num <= range->stop) {
+      return false;
+    }
+    *elem = NUMBER_VAL(num);
+  } else {
+    ObjHashMap* map = (ObjHashMap*)iterable;
+    while (index < map->capacity && IS_NOTHING(map->entries[index].key)) {
+      index++;
+    }
+    if (index >= map->capacity) {
+      *cursor = index;
+      return false;
+    }
+    HashEntry* entry = &map->entries[index];
+    if (kind == ITER_KEYS) {
+      *elem = entry->key;
+    } else if (kind == ITER_VALUES) {
+      *elem = entry->value;
+    } else {
+      ObjList* item = create_list(vm, 2);
+      item->elems.buffer[0] = entry->key;
+      item->elems.buffer[1] = entry->value;
+      *elem = OBJ_VAL(item);
+    }
+  }
+  *cursor = index + 1;
+  return true;
+}
+
 inline char* get_func_name(ObjFn* fn) {
   return fn->name ? fn->name->str : "<anonymous>";
 }
@@ -581,6 +857,13 @@ static void rehash(ObjHashMap* table, VM* vm) {
 }
 
 bool hashmap_put(ObjHashMap* table, VM* vm, Value key, Value value) {
+  HashEntry* entry;
+  if (find_entry(table->entries, table->capacity, &entry, key)) {
+    // only new keys may grow the map, so updating a key while the map is
+    // walked leaves its entries where they are (see iterator_moved())
+    entry->value = value;
+    return false;
+  }
   if (table->length >= table->capacity * MAP_LOAD_FACTOR) {
     rehash(table, vm);
   }
@@ -50,6 +50,8 @@ typedef uint64_t Value;
 #define IS_INSTANCE(val) (is_object_type(val, OBJ_INSTANCE))
 #define IS_CFUNC(val) (is_object_type(val, OBJ_CFN))
 #define IS_MODULE(val) (is_object_type(val, OBJ_MODULE))
+#define IS_ITERATOR(val) (is_object_type(val, OBJ_ITERATOR))
+#define IS_RANGE(val) (is_object_type(val, OBJ_RANGE))
 
 #define AS_STRING(val) ((ObjString*)(AS_OBJ(val)))
 #define AS_LIST(val) ((ObjList*)(AS_OBJ(val)))
@@ -60,6 +62,8 @@ typedef uint64_t Value;
 #define AS_INSTANCE(val) ((ObjInstance*)(AS_OBJ(val)))
 #define AS_CFUNC(val) ((ObjCFn*)(AS_OBJ(val)))
 #define AS_MODULE(val) AS_STRUCT(val)
+#define AS_ITERATOR(val) ((ObjIterator*)(AS_OBJ(val)))
+#define AS_RANGE(val) ((ObjRange*)(AS_OBJ(val)))
 
 #define CREATE_OBJ(vm, obj_struct, obj_ty, size) \
   (obj_struct*)create_object(vm, obj_ty, size)
@@ -77,16 +81,107 @@ typedef struct {
   int length;
   int capacity;
   Value* values;
+  int* index;  // slot + 1 of the values added by intern_value(), 0 if empty
+  int index_capacity;
 } ValuePool;
 
+// per-site inline cache of $GET_FIELD and $GET_PROPERTY.
+// it remembers the entry slots at which the site's key was last found; a slot
+// is only trusted if the map being searched still holds the key there.
+#define IC_WAYS (4)
+
+typedef struct {
+  uint32_t slots[IC_WAYS];
+  uint32_t next;  // way to evict on the next miss
+} InlineCache;
+
+// a try's entry in its function's exception table: an error raised by an
+// instruction in [start, end) continues at `target`, with the stack cut back
+// to `depth` slots of the frame (see stack_size()) and the error pushed.
+// only consulted when unwinding, see runtime_error(). a nested try comes
+// before the ones around it.
+typedef struct {
+  int start;
+  int end;
+  int target;
+  int depth;
+} Handler;
+
 typedef struct Code {
   int length;
   int capacity;
+  int ic_count;
+  int handler_count;
+  int handler_capacity;
   int* lines;
   byte_t* bytes;
+  InlineCache* caches;
+  Handler* handlers;
   ValuePool vpool;
 } Code;
 
+// register-engine translation of a function's Code, built by regen.c on the
+// function's first call. it shares the Code's constants and inline caches.
+typedef struct {
+  bool declined;  // the function can't be translated, it runs in run()
+  int length;
+  int capacity;
+  int handler_count;  // the Code's, with register code offsets
+  int* lines;
+  byte_t* bytes;
+  Handler* handlers;
+} RegCode;
+
+// runs the current frame of a function compiled to C ahead of time
+// (--emit-c, see aot.h) from its ip, returns a JitStatus like jit_run()
+typedef int (*AotFn)(VM* vm);
+
+// machine code compiled from a function's Code by jit.c once the function
+// gets hot (--jit). `entries` lets a frame move between run() and the machine
+// code at any instruction.
+typedef struct {
+  bool declined;  // the function can't be compiled, don't retry
+  size_t size;
+  byte_t* bytes;  // mmap'd, executable
+  int length;  // of entries, the stack code's length
+  int* entries;  // Code offset -> machine code offset, -1 mid-instruction
+  AotFn aot;  // instead of the above in programs built from --emit-c
+} JitCode;
+
+#define TRACE_BRANCHES (0x40)
+
+typedef enum {
+  TRACE_COUNTING,
+  TRACE_RECORDING,
+  TRACE_COMPILED,
+  TRACE_DECLINED,
+} TraceState;
+
+// a hot loop (--trace): the path one iteration took from the loop's head
+// back to it, compiled by jit.c into machine code that guards the types and
+// branch directions it saw, and leaves for run() where they don't hold.
+typedef struct Trace {
+  int head;  // Code offset its $LOOPs jump back to, which identifies the loop
+  int depth;  // of the stack at the head
+  int frame;  // index of the frame recording the trace
+  int hotness;
+  TraceState state;
+  int branch_count;
+  int branches[TRACE_BRANCHES];  // where each conditional jump on the path went
+  int entered;
+  int64_t iterations;  // counted by the machine code, see hot_loop()
+  int entry;  // of the head in bytes
+  size_t size;
+  byte_t* bytes;  // mmap'd, executable
+  struct Trace* next;
+} Trace;
+
+// the back edges of one of a function's $LOOPs, see profile.h
+typedef struct {
+  int offset;  // of the $LOOP (or its $WIDE) in the Code
+  uint64_t count;
+} LoopCount;
+
 typedef struct {
   int length;
   int capacity;
@@ -104,6 +199,8 @@ typedef enum {
   OBJ_INSTANCE,
   OBJ_MODULE,
   OBJ_CFN,
+  OBJ_ITERATOR,
+  OBJ_RANGE,
 } ObjTy;
 
 typedef struct Obj {
@@ -145,19 +242,29 @@ typedef struct Map {
   MapEntry* entries;
   int capacity;
   int length;
+  int tombstones;  // removed entries, which keep probe sequences intact
 } Map;
 
 typedef struct {
   Obj obj;
-  Map fields;
+  Map fields;  // of a module: each global's slot in `globals`
   ObjString* name;
+  ValuePool globals;  // a module's globals, NOTHING_VAL until defined
 } ObjStruct;
 
 typedef struct {
   Obj obj;
   int arity;
   int env_len;
+  int max_stack;  // deepest the stack gets in a call, see stack_size()
   Code code;
+  RegCode reg;
+  int hotness;  // calls and loop iterations, see JIT_THRESHOLD
+  uint64_t calls;  // see profile.h
+  int loop_count;  // of `back_edges`
+  LoopCount* back_edges;  // per $LOOP, in Code order; see profile.h
+  JitCode jit;
+  Trace* traces;
   ObjString* name;
   ObjStruct* module;
 } ObjFn;
@@ -175,16 +282,13 @@ typedef struct ObjUpvalue {
   Obj obj;
   Value* location;
   Value value;
-  struct ObjUpvalue* next;
 } ObjUpvalue;
 
-typedef ObjUpvalue** Env;
-
 typedef struct {
   Obj obj;
   int env_len;
   ObjFn* func;
-  Env env;
+  ObjUpvalue* env[];  // allocated with the closure
 } ObjClosure;
 
 typedef struct {
@@ -193,6 +297,39 @@ typedef struct {
   ObjStruct* strukt;
 } ObjInstance;
 
+typedef enum {
+  ITER_LIST,
+  ITER_STRING,
+  ITER_KEYS,  // of a hashmap, as are the next two
+  ITER_VALUES,
+  ITER_ITEMS,  // [key, value] lists
+  ITER_RANGE,
+} IterKind;
+
+// core::range(): start, start + step, ... up to (not including) stop
+typedef struct {
+  Obj obj;
+  double start;
+  double stop;
+  double step;
+} ObjRange;
+
+// what core::iter() returns for lists, strings, hashmaps and ranges
+typedef struct {
+  Obj obj;
+  IterKind kind;
+  int cursor;  // the next element's index, or the entry a hashmap's is from
+  int capacity;  // a hashmap's when the walk started
+  Obj* iterable;
+} ObjIterator;
+
+inline static bool iterator_moved(ObjIterator* iter) {
+  // whether the hashmap walked grew (or was cleared) since the walk started,
+  // moving its entries from under the cursor
+  return iter->kind >= ITER_KEYS && iter->kind <= ITER_ITEMS
+      && ((ObjHashMap*)iter->iterable)->capacity != iter->capacity;
+}
+
 inline static Value num_to_val(double num) {
   return *((Value*)&(num));
 }
@@ -208,9 +345,16 @@ inline static bool is_object_type(Value c, ObjTy type) {
 void init_code(Code* code);
 void free_code(Code* code, VM* vm);
 void write_code(Code* code, byte_t byte, int line, VM* vm);
+void write_handler(Code* code, Handler handler, VM* vm);
+void init_caches(Code* code, VM* vm);
+void init_reg_code(RegCode* code);
+void free_reg_code(RegCode* code, VM* vm);
+void init_jit_code(JitCode* code);
+void write_reg_code(RegCode* code, byte_t byte, int line, VM* vm);
 void init_value_pool(ValuePool* vp);
 void free_value_pool(ValuePool* vp, VM* vm);
 int write_value(ValuePool* vp, Value v, VM* vm);
+int intern_value(ValuePool* vp, Value v, VM* vm);
 char* get_value_type(Value val);
 void print_value(Value val);
 void print_object(Value val, Obj* obj);
@@ -232,6 +376,14 @@ ObjStruct* create_struct(VM* vm, ObjString* name);
 ObjInstance* create_instance(VM* vm, ObjStruct* strukt);
 ObjCFn* create_cfn(VM* vm, CFn fn, int arity, const char* name);
 ObjStruct* create_module(VM* vm, ObjString* name);
+int module_slot(VM* vm, ObjStruct* module, ObjString* name);
+Value module_get(ObjStruct* module, ObjString* name);
+void module_put(VM* vm, ObjStruct* module, ObjString* name, Value value);
+void module_copy(VM* vm, ObjStruct* module, ObjStruct* from);
+ObjString* global_name(ObjStruct* module, int slot);
+ObjIterator* create_iterator(VM* vm, IterKind kind, Obj* iterable);
+ObjRange* create_range(VM* vm, double start, double stop, double step);
+bool iterate(VM* vm, IterKind kind, Obj* iterable, int* cursor, Value* elem);
 char* get_func_name(ObjFn* fn);
 void hashmap_init(ObjHashMap* table);
 bool hashmap_put(ObjHashMap* table, VM* vm, Value key, Value value);
@@ -1,27 +1,98 @@
 #include "vm.h"
 
 #include "core.h"
+#include "jit.h"
 #include "map.h"
+#include "profile.h"
+#include "regen.h"
 
-#define READ_BYTE(vm) (*(vm->fp->ip++))
-#define READ_SHORT(vm) \
-  (vm->fp->ip += 2, ((vm->fp->ip[-2]) << 8u) | (vm->fp->ip[-1]))
-#define READ_CONST(vm) (vm->fp->closure->func->code.vpool.values[READ_BYTE(vm)])
-#define READ_STRING(vm) AS_STRING(READ_CONST(vm))
+// run() keeps the instruction pointer, stack pointer, current frame and
+// constant pool in locals; these macros operate on those locals.
+#define READ_BYTE() (*ip++)
+#define READ_SHORT() (ip += 2, (ip[-2] << 8u) | ip[-1])
+#define READ_LONG() \
+  (ip += 4, \
+   ((uint32_t)ip[-4] << 24u) | (ip[-3] << 16u) | (ip[-2] << 8u) | ip[-1])
+#define READ_CONST() (consts[READ_BYTE()])
+#define READ_STRING() AS_STRING(READ_CONST())
+#define READ_CACHE() (&caches[READ_SHORT()])
+#define PUSH(val) (*sp++ = (val))
+#define POP() (*(--sp))
+#define PEEK() (sp[-1])
+#define PEEK_AT(n) (sp[-1 - (n)])
+// sync points: the locals are written back to the VM before anything that
+// may observe it (calls, returns, allocation/gc, runtime_error, native
+// functions), and reloaded after anything that may change it.
+#define STORE_STATE() (frame->ip = ip, vm->sp = sp)
+#define LOAD_FRAME() \
+  (frame = vm->fp, \
+   ip = frame->ip, \
+   slots = frame->stack, \
+   consts = frame->closure->func->code.vpool.values, \
+   caches = frame->closure->func->code.caches)
+#define LOAD_STATE() (LOAD_FRAME(), sp = vm->sp)
 #define PEEK_STACK(vm) (*(vm->sp - 1))
 #define PEEK_STACK_AT(vm, n) (*(vm->sp - 1 - (n)))
-#define TRY_RECOVER(_vm_) \
-  if (_vm_->has_error) \
+#define TRY_RECOVER() \
+  if (vm->has_error) { \
     return RESULT_RUNTIME_ERROR; \
-  else \
-    DISPATCH();
-#define BINARY_OP(vm, _op, _val_func) \
+  } else { \
+    LOAD_STATE(); \
+    JIT_HOOK(false); \
+    DISPATCH(); \
+  }
+// wherever run() switches to a frame or a position in it: hand the frame to
+// run_reg() if it's at register code (--reg runs the functions the register
+// engine declines here), or continue in machine code (or C from --emit-c) if
+// the frame's function is (or just became) compiled
+#define JIT_HOOK(_loop) \
+  if (frame->closure->func->reg.bytes) { \
+    STORE_STATE(); \
+    return RESULT_SWITCH; \
+  } \
+  if (vm->jit_threshold >= 0 \
+      && (STORE_STATE(), jit_ready(vm, frame, (_loop)))) { \
+    goto jit_enter; \
+  }
+// --sample-profile: record the stack at a $LOOP or call once the timer has
+// gone off
+#define SAMPLE() \
+  if (sample_due) { \
+    STORE_STATE(); \
+    take_sample(vm); \
+  }
+#ifdef EVE_JIT
+  // --trace: a $LOOP that went around counts its loop and may run its trace;
+  // conditional jumps note where they went while an iteration is recorded
+  #define TRACE_LOOP() \
+    if (vm->trace_threshold >= 0) { \
+      goto trace_loop; \
+    }
+  #define TRACE_BRANCH() \
+    if (vm->recording) { \
+      record_branch(vm, ip); \
+    }
+  // ...or take a way traces don't follow, which declines the loop
+  #define TRACE_DECLINE() \
+    if (vm->recording) { \
+      record_branch(vm, NULL); \
+    }
+#else
+  #define TRACE_LOOP()
+  #define TRACE_BRANCH()
+  #define TRACE_DECLINE()
+#endif
+// generic arithmetic/comparison: quickens the instruction to its numeric
+// variant `_quick` once it has seen numeric operands
+#define BINARY_OP(_op, _val_func, _quick) \
   { \
-    Value _r = pop_stack(vm); \
-    Value _l = pop_stack(vm); \
+    Value _r = POP(); \
+    Value _l = POP(); \
     if (IS_NUMBER(_l) && IS_NUMBER(_r)) { \
-      push_stack(vm, _val_func(AS_NUMBER(_l) _op AS_NUMBER(_r))); \
+      PUSH(_val_func(AS_NUMBER(_l) _op AS_NUMBER(_r))); \
+      ip[-1] = (_quick); \
     } else { \
+      STORE_STATE(); \
       runtime_error( \
           vm, \
           NOTHING_VAL, \
@@ -30,11 +101,25 @@
           "'" #_op "'", \
           get_value_type(_l), \
           get_value_type(_r)); \
-      TRY_RECOVER(vm) \
+      TRY_RECOVER() \
     } \
   }
-#define BINARY_CHECK(vm, _op, _a, _b, check) \
+// quickened numeric variant of BINARY_OP: deoptimizes back to `_generic` and
+// re-executes it when the operands aren't numbers
+#define QUICK_BINARY_OP(_op, _val_func, _generic) \
+  { \
+    Value _r = PEEK(); \
+    Value _l = PEEK_AT(1); \
+    if (!IS_NUMBER(_l) || !IS_NUMBER(_r)) { \
+      *--ip = (_generic); \
+      DISPATCH(); \
+    } \
+    sp--; \
+    sp[-1] = _val_func(AS_NUMBER(_l) _op AS_NUMBER(_r)); \
+  }
+#define BINARY_CHECK(_op, _a, _b, check) \
   if (!check((_a)) || !check((_b))) { \
+    STORE_STATE(); \
     runtime_error( \
         vm, \
         NOTHING_VAL, \
@@ -43,10 +128,11 @@
         "'" #_op "'", \
         get_value_type(_a), \
         get_value_type(_b)); \
-    TRY_RECOVER(vm) \
+    TRY_RECOVER() \
   }
-#define UNARY_CHECK(vm, _op, _a, check) \
+#define UNARY_CHECK(_op, _a, check) \
   if (!check((_a))) { \
+    STORE_STATE(); \
     runtime_error( \
         vm, \
         NOTHING_VAL, \
@@ -54,12 +140,42 @@
         "Unsupported operand type for " \
         "'" #_op "'", \
         get_value_type((_a))); \
-    TRY_RECOVER(vm) \
+    TRY_RECOVER() \
+  }
+// <cmp>; $JMP_FALSE_OR_POP: the comparison result is only materialized
+// when the jump is taken, since the fall-through path would pop it.
+#define COMPARE_JMP(_op) \
+  { \
+    uint16_t _offset = READ_SHORT(); \
+    Value _r = POP(); \
+    Value _l = POP(); \
+    BINARY_CHECK(_op, _l, _r, IS_NUMBER); \
+    if (!(AS_NUMBER(_l) _op AS_NUMBER(_r))) { \
+      PUSH(FALSE_VAL); \
+      ip += _offset; \
+    } \
   }
-#define VM_LOOP \
-  vm_loop: \
-  switch ((inst = READ_BYTE(vm)))
-#define DISPATCH() goto vm_loop
+#ifdef EVE_OPCODE_STATS
+  // --opcode-stats: `inst` still holds the instruction dispatched before
+  #define NEXT_INST() count_op(inst, READ_BYTE())
+#else
+  #define NEXT_INST() READ_BYTE()
+#endif
+#ifdef EVE_COMPUTED_GOTO
+  // threaded dispatch: each handler ends with its own indirect jump through
+  // the label table, which gives the branch predictor one site per opcode.
+  #define VM_LOOP DISPATCH();
+  #define CASE(op) op##_handler
+  #define DEFAULT unknown_opcode
+  #define DISPATCH() goto* dispatch_table[(inst = NEXT_INST())]
+#else
+  #define VM_LOOP \
+    vm_loop: \
+    switch ((inst = NEXT_INST()))
+  #define CASE(op) case op
+  #define DEFAULT default
+  #define DISPATCH() goto vm_loop
+#endif
 #define END_BRACE
 #define KB_SIZE (1024)
 #define pop_stack(vm) (*(--(vm)->sp))
@@ -73,10 +189,6 @@
 inline static void close_upvalues(VM* vm, const Value* slot);
 inline static bool call_value(VM* vm, Value val, int argc, bool is_tco);
 
-inline static TryCtx new_tryctx() {
-  return (TryCtx) {.sp = NULL, .handler_ip = NULL};
-}
-
 Value vm_pop_stack(VM* vm) {
   return pop_stack(vm);
 }
@@ -89,13 +201,84 @@ bool vm_call_value(VM* vm, Value val, int argc) {
   return call_value(vm, val, argc, false);
 }
 
+inline static byte_t* entry_ip(VM* vm, ObjFn* fn) {
+  // where a call to `fn` starts executing in the current engine
+  if (vm->engine == ENGINE_STACK) {
+    return fn->code.bytes;
+  }
+  if (!fn->reg.bytes && !fn->reg.declined && !regen(vm, fn)) {
+    // too large for byte registers, the function's frames run in run()
+    fn->reg.declined = true;
+  }
+  return fn->reg.bytes ? fn->reg.bytes : fn->code.bytes;
+}
+
+int frame_line(VM* vm, CallFrame* fp) {
+  // a frame is at the register code iff its function was translated
+  ObjFn* fn = fp->closure->func;
+  if (fn->reg.bytes) {
+    return fn->reg.lines[fp->ip - fn->reg.bytes - 1];
+  }
+  return fn->code.lines[fp->ip - fn->code.bytes - 1];
+}
+
+static void grow_stack(VM* vm, int size) {
+  // move the stack into a bigger buffer and point everything that refers
+  // into it - frames and open upvalues - at the new one
+  int capacity = vm->stack_capacity;
+  while (capacity < size) {
+    capacity *= 2;
+  }
+  Value* stack = alloc(NULL, sizeof(Value) * capacity);
+  memcpy(stack, vm->stack, sizeof(Value) * (vm->sp - vm->stack));
+#define RELOCATE(ptr) ((ptr) = stack + ((ptr) - vm->stack))
+  for (int i = 0; i < vm->frame_count; i++) {
+    RELOCATE(vm->frames[i].stack);
+  }
+  for (int i = 0; i < vm->upvalue_count; i++) {
+    RELOCATE(vm->upvalues[i]->location);
+  }
+  RELOCATE(vm->sp);
+#undef RELOCATE
+  free(vm->stack);
+  vm->stack = stack;
+  // upvalues stay at their slot's index
+  vm->slot_upvalues =
+      alloc(vm->slot_upvalues, sizeof(ObjUpvalue*) * capacity);
+  memset(
+      vm->slot_upvalues + vm->stack_capacity,
+      0,
+      sizeof(ObjUpvalue*) * (capacity - vm->stack_capacity));
+  vm->stack_capacity = capacity;
+}
+
+inline static void reserve_stack(VM* vm, ObjFn* fn) {
+  // the one growth check per call: room for the current frame's deepest
+  // point, as computed by the compiler
+  int size = (int)(vm->fp->stack - vm->stack) + fn->max_stack + STACK_RESERVE;
+  if (size > vm->stack_capacity) {
+    grow_stack(vm, size);
+  }
+}
+
 inline static bool push_frame(VM* vm, CallFrame frame) {
   if (vm->frame_count >= CALL_FRAME_MAX) {
     runtime_error(vm, NOTHING_VAL, "Stack overflow: too many call frames");
     return false;
   }
+  ObjFn* fn = frame.closure->func;
+  if (vm->engine == ENGINE_REG && frame.ip == fn->code.bytes) {
+    // new frames (including those of natives) start at the stack code
+    frame.ip = entry_ip(vm, fn);
+  }
+  if (vm->frame_count == vm->frame_capacity) {
+    vm->frame_capacity *= 2;
+    vm->frames =
+        alloc(vm->frames, sizeof(CallFrame) * vm->frame_capacity);
+  }
   vm->fp = &vm->frames[vm->frame_count++];
   *vm->fp = frame;
+  reserve_stack(vm, fn);
   // set the current module
   vm->current_module = vm->fp->closure->func->module;
   return true;
@@ -114,24 +297,38 @@ inline static CallFrame pop_frame(VM* vm) {
   return frame;
 }
 
-inline static bool set_try(VM* vm, int handler_ip) {
-  TryCtx ctx = {.handler_ip = vm->fp->ip + handler_ip, .sp = vm->sp};
-  vm->fp->try_ctx = ctx;
-  return true;
-}
-
-inline static TryCtx tear_try(VM* vm) {
-  TryCtx ctx = vm->fp->try_ctx;
-  vm->fp->try_ctx = new_tryctx();
-  return ctx;
+static Handler* find_handler(VM* vm, CallFrame* fp) {
+  // the innermost try around the instruction the frame is at, NULL if none.
+  // the frame's ip is past the instruction's opcode, at the next
+  // instruction once it has read its operands
+  ObjFn* fn = fp->closure->func;
+  Handler* handlers = fn->code.handlers;
+  int count = fn->code.handler_count;
+  int offset = (int)(fp->ip - fn->code.bytes) - 1;
+  if (fn->reg.bytes) {
+    handlers = fn->reg.handlers;
+    count = fn->reg.handler_count;
+    offset = (int)(fp->ip - fn->reg.bytes) - 1;
+  }
+  for (int i = 0; i < count; i++) {
+    if (offset >= handlers[i].start && offset < handlers[i].end) {
+      return &handlers[i];
+    }
+  }
+  return NULL;
 }
 
-inline static void handle_error(VM* vm, Value err, char* fmt, va_list* ap) {
-  vm->sp = vm->fp->try_ctx.sp;
-  vm->fp->ip = vm->fp->try_ctx.handler_ip;
-  vm->current_module = vm->fp->closure->func->module;
+inline static void
+handle_error(VM* vm, Handler* handler, Value err, char* fmt, va_list* ap) {
+  // the frames above were unwound; so are the try's own pushes, and any
+  // upvalues still pointing into them
+  ObjFn* fn = vm->fp->closure->func;
+  vm->sp = vm->fp->stack + handler->depth;
+  close_upvalues(vm, vm->sp);
+  vm->fp->ip = (fn->reg.bytes ? fn->reg.bytes : fn->code.bytes)
+      + handler->target;
+  vm->current_module = fn->module;
   vm->has_error = false;
-  tear_try(vm);
   char buff[KB_SIZE];
   int len = vsnprintf(buff, KB_SIZE, fmt, *ap);
   va_end(*ap);
@@ -168,10 +365,26 @@ VM new_vm() {
       .sp = NULL,
       .frame_count = 0,
       .is_compiling = true,
+      .optimize = true,
+      .engine = ENGINE_STACK,
+      .jit_threshold = -1,
+      .jit_depth = 0,
+      .trace_threshold = -1,
+      .recording = NULL,
+      .recording_fn = NULL,
       .upvalues = NULL,
+      .upvalue_count = 0,
+      .upvalue_capacity = 0,
       .compiler = NULL,
       .builtins = NULL,
-      .current_module = NULL};
+      .current_module = NULL,
+      .sampler = NULL};
+  vm.stack_capacity = STACK_INIT;
+  vm.frame_capacity = CALL_FRAME_INIT;
+  vm.stack = alloc(NULL, sizeof(Value) * vm.stack_capacity);
+  vm.slot_upvalues = alloc(NULL, sizeof(ObjUpvalue*) * vm.stack_capacity);
+  memset(vm.slot_upvalues, 0, sizeof(ObjUpvalue*) * vm.stack_capacity);
+  vm.frames = alloc(NULL, sizeof(CallFrame) * vm.frame_capacity);
   vm.sp = vm.stack;
   map_init(&vm.strings);
   map_init(&vm.modules);
@@ -180,6 +393,14 @@ VM new_vm() {
 }
 
 void free_vm(VM* vm) {
+  // also where core::exit() ends the program
+  finish_sampling(vm);
+#ifdef EVE_DEBUG_CACHES
+  printf(
+      "inline caches: %" PRIu64 " hits, %" PRIu64 " misses\n",
+      vm->ic_hits,
+      vm->ic_misses);
+#endif
   if (vm->modules.entries) {
     FREE_BUFFER(vm, vm->modules.entries, MapEntry, vm->modules.capacity);
   }
@@ -192,6 +413,14 @@ void free_vm(VM* vm) {
     free_object(vm, obj);
   }
   gc_free(&vm->gc);
+  free(vm->stack);
+  free(vm->frames);
+  free(vm->upvalues);
+  free(vm->slot_upvalues);
+  vm->upvalues = vm->slot_upvalues = NULL;
+  vm->upvalue_count = vm->upvalue_capacity = 0;
+  vm->stack = vm->sp = NULL;
+  vm->frames = vm->fp = NULL;
 }
 
 bool boot_vm(VM* vm, ObjFn* func) {
@@ -205,8 +434,7 @@ bool boot_vm(VM* vm, ObjFn* func) {
   CallFrame frame = {
       .ip = func->code.bytes,
       .closure = closure,
-      .stack = vm->sp,
-      .try_ctx = new_tryctx()};
+      .stack = vm->sp};
   push_frame(vm, frame);
   push_stack(vm, OBJ_VAL(closure));
   init_builtins(vm, closure->func->module);
@@ -225,14 +453,15 @@ IResult runtime_error(VM* vm, Value err, char* fmt, ...) {
   // try to recover:
   int frame_count = vm->frame_count;
   CallFrame* fp;
+  Handler* handler;
   while (frame_count) {
     fp = &vm->frames[frame_count - 1];
     // check for error handlers
-    if (fp->try_ctx.handler_ip) {
+    if ((handler = find_handler(vm, fp))) {
       vm->frame_count = frame_count;
       vm->fp = fp;
       va_start(ap, fmt);
-      handle_error(vm, err, fmt, &ap);
+      handle_error(vm, handler, err, fmt, &ap);
       return 0;
     }
     frame_count--;
@@ -240,7 +469,6 @@ IResult runtime_error(VM* vm, Value err, char* fmt, ...) {
   int repeating_frames = 0;
   CallFrame* prev_frame = NULL;
   ObjString* last_file = NULL;
-  size_t offset;
   fputs("Runtime Error: ", stderr);
   va_start(ap, fmt);
   vfprintf(stderr, fmt, ap);
@@ -256,7 +484,6 @@ IResult runtime_error(VM* vm, Value err, char* fmt, ...) {
         continue;
       }
     }
-    offset = vm->fp->ip - vm->fp->closure->func->code.bytes - 1;
     if (vm->frame_count > 1) {
       if (last_file != vm->fp->closure->func->module->name) {
         fprintf(
@@ -270,14 +497,14 @@ IResult runtime_error(VM* vm, Value err, char* fmt, ...) {
           stderr,
           "in %s(), line %d\n",
           get_func_name(vm->fp->closure->func),
-          vm->fp->closure->func->code.lines[offset]);
+          frame_line(vm, vm->fp));
     } else {
       // last frame
       fprintf(
           stderr,
           "File %s, line %d\n",
           vm->fp->closure->func->module->name->str,
-          vm->fp->closure->func->code.lines[offset]);
+          frame_line(vm, vm->fp));
     }
     last_file = vm->fp->closure->func->module->name;
     prev_frame = vm->fp;
@@ -377,8 +604,9 @@ static bool struct_prop_access(VM* vm, Value value, Value property) {
   ObjString* prop = AS_STRING(property);
   if (IS_STRUCT(value) || IS_MODULE(value)) {
     ObjStruct* strukt = AS_STRUCT(value);
-    Value res;
-    if ((res = map_get(&strukt->fields, AS_STRING(property))) != NOTHING_VAL) {
+    Value res = IS_STRUCT(value) ? map_get(&strukt->fields, prop)
+                                 : module_get(strukt, prop);
+    if (res != NOTHING_VAL) {
       push_stack(vm, res);
       return true;
     } else {
@@ -511,12 +739,12 @@ inline bool call_value(VM* vm, Value val, int argc, bool is_tco) {
   if (IS_CLOSURE(val)) {
     ObjFn* fn = AS_CLOSURE(val)->func;
     if (argc == fn->arity) {
+      PROFILE_CALL(fn);
       if (!is_tco) {
         CallFrame frame = {
             .closure = AS_CLOSURE(val),
             .stack = vm->sp - 1 - argc,
-            .ip = fn->code.bytes,
-            .try_ctx = new_tryctx()};
+            .ip = fn->code.bytes};
         return push_frame(vm, frame);
       } else {
         // close all upvalues currently still unclosed
@@ -526,7 +754,8 @@ inline bool call_value(VM* vm, Value val, int argc, bool is_tco) {
           vm->fp->stack[j] = PEEK_STACK_AT(vm, i);
         }
         vm->sp = vm->fp->stack + j;
-        vm->fp->ip = fn->code.bytes;
+        reserve_stack(vm, fn);
+        vm->fp->ip = entry_ip(vm, fn);
         return true;
       }
     }
@@ -566,484 +795,2159 @@ inline bool call_value(VM* vm, Value val, int argc, bool is_tco) {
   return false;
 }
 
-inline static ObjUpvalue* capture_upvalue(VM* vm, Value* position) {
-  ObjUpvalue *current = vm->upvalues, *previous = NULL;
-  while (current != NULL && current->location > position) {
-    previous = current;
-    current = current->next;
+inline static Value
+cached_get(VM* vm, InlineCache* ic, Map* map, ObjString* key) {
+  // fast path: a slot remembered by this site still holds the key
+  MapEntry* entry;
+  for (int i = 0; i < IC_WAYS; i++) {
+    if (ic->slots[i] < (uint32_t)map->capacity
+        && (entry = &map->entries[ic->slots[i]])->key == key) {
+#ifdef EVE_DEBUG_CACHES
+      vm->ic_hits++;
+#endif
+      return entry->value;
+    }
   }
-  // if the location is already captured, return the upvalue
-  if (current && current->location == position) {
-    return current;
+#ifdef EVE_DEBUG_CACHES
+  vm->ic_misses++;
+#endif
+  int slot = map_find_slot(map, key);
+  if (slot == -1) {
+    return NOTHING_VAL;
   }
+  ic->slots[ic->next] = slot;
+  ic->next = (ic->next + 1) % IC_WAYS;
+  return map->entries[slot].value;
+}
 
-  ObjUpvalue* new_uv = create_upvalue(vm, position);
-  new_uv->next = current;  // enables sorting of the locations
-  if (previous == NULL) {  // if head is empty
-    vm->upvalues = new_uv;
-  } else {
-    /*
-     * if all the captured locations are above 'position'
-     * | p | x | x | x |
-     * or if we passed 'position' during our search
-     * | x | p | x | x |
-     */
-    previous->next = new_uv;
+inline static Value
+cached_field(VM* vm, InlineCache* ic, Value value, ObjString* key) {
+  // $GET_FIELD's lookup: a struct's field, or a module's global by name
+  if (IS_STRUCT(value)) {
+    return cached_get(vm, ic, &AS_STRUCT(value)->fields, key);
+  } else if (IS_MODULE(value)) {
+    ObjStruct* module = AS_MODULE(value);
+    Value slot = cached_get(vm, ic, &module->fields, key);
+    return slot == NOTHING_VAL ? slot
+                               : module->globals.values[(int)AS_NUMBER(slot)];
+  }
+  return NOTHING_VAL;
+}
+
+inline static Value* global_at(VM* vm, int slot) {
+  return &vm->current_module->globals.values[slot];
+}
+
+inline static bool is_core(VM* vm, int core) {
+  // whether the global `core` is still the builtin module, which is what an
+  // intrinsic (see c_intrinsic()) was compiled against
+  return *global_at(vm, core) == OBJ_VAL(vm->builtins);
+}
+
+static IResult undefined_global(VM* vm, char* fmt, int slot) {
+  // a global used before its definition, named in `fmt`
+  return runtime_error(
+      vm,
+      NOTHING_VAL,
+      fmt,
+      global_name(vm->current_module, slot)->str);
+}
+
+inline static bool call_intrinsic(VM* vm, int index) {
+  // the builtin on the value on top of the stack, which it replaces. $LEN
+  // handles its own type; the rest, and errors, are left to the builtin
+  const Intrinsic* intrinsic = &intrinsics[index];
+  Value val = PEEK_STACK(vm);
+  if (intrinsic->op == $LEN && IS_OBJ(val)
+      && AS_OBJ(val)->type == intrinsic->type) {
+    int len = intrinsic->type == OBJ_STR ? AS_STRING(val)->length
+        : intrinsic->type == OBJ_LIST       ? AS_LIST(val)->elems.length
+                                            : AS_HMAP(val)->length;
+    vm->sp[-1] = NUMBER_VAL(len);
+    return true;
+  }
+  Value res = intrinsic->fn(vm, 1, vm->sp - 1);
+  if (res == NOTHING_VAL) {
+    return false;
+  }
+  vm->sp[-1] = res;
+  return true;
+}
+
+static bool intrinsic_callee(VM* vm, int core, int index) {
+  // with `core` shadowed, an intrinsic makes the call it stands for: the
+  // callee is looked up as $GET_GLOBAL and $GET_FIELD would, and goes under
+  // the argument (a slot past the compiler's count, within STACK_RESERVE)
+  const Intrinsic* intrinsic = &intrinsics[index];
+  Value callee = *global_at(vm, core);
+  if (callee == NOTHING_VAL) {
+    undefined_global(vm, "Name '%s' is not defined", core);
+    return false;
   }
+  push_stack(vm, callee);
+  char* names[] = {intrinsic->module, intrinsic->name};
+  for (int i = intrinsic->module ? 0 : 1; i < 2; i++) {
+    Value name = create_stringv(
+        vm,
+        &vm->strings,
+        names[i],
+        (int)strlen(names[i]),
+        false);
+    if (!struct_prop_access(vm, PEEK_STACK(vm), name)) {
+      return false;
+    }
+    vm->sp[-2] = vm->sp[-1];
+    vm->sp--;
+  }
+  Value arg = vm->sp[-2];
+  vm->sp[-2] = vm->sp[-1];
+  vm->sp[-1] = arg;
+  return true;
+}
+
+inline static ObjUpvalue* capture_upvalue(VM* vm, Value* position) {
+  // a slot already captured has its upvalue at its index. a new one goes
+  // into the sorted upvalues: only the running frame captures, so it moves
+  // past that frame's upvalues above it at most
+  ObjUpvalue** open = &vm->slot_upvalues[position - vm->stack];
+  if (*open) {
+    return *open;
+  }
+  ObjUpvalue* new_uv = *open = create_upvalue(vm, position);
+  if (vm->upvalue_count == vm->upvalue_capacity) {
+    vm->upvalue_capacity = GROW_CAPACITY(vm->upvalue_capacity);
+    vm->upvalues =
+        alloc(vm->upvalues, sizeof(ObjUpvalue*) * vm->upvalue_capacity);
+  }
+  int i = vm->upvalue_count++;
+  for (; i > 0 && vm->upvalues[i - 1]->location > position; i--) {
+    vm->upvalues[i] = vm->upvalues[i - 1];
+  }
+  vm->upvalues[i] = new_uv;
   return new_uv;
 }
 
 inline static void close_upvalues(VM* vm, const Value* slot) {
-  ObjUpvalue* current = vm->upvalues;
-  while (current != NULL && current->location >= slot) {
-    current->value = *current->location;
-    current->location = &current->value;
-    current = current->next;
+  // those at `slot` and above are the last in the sorted upvalues
+  ObjUpvalue* uv;
+  while (vm->upvalue_count > 0
+         && (uv = vm->upvalues[vm->upvalue_count - 1])->location >= slot) {
+    vm->slot_upvalues[uv->location - vm->stack] = NULL;
+    uv->value = *uv->location;
+    uv->location = &uv->value;
+    vm->upvalue_count--;
   }
-  vm->upvalues = current;
 }
 
-IResult run(VM* vm) {
-  register byte_t inst;
-#if defined(EVE_DEBUG_EXECUTION)
-  print_stack(vm);
-  dis_instruction(
-      &vm->fp->closure->func->code,
-      (int)(vm->fp->ip - vm->fp->closure->func->code.bytes));
-#endif
-  VM_LOOP {
-    case $LOAD_CONST: {
-      push_stack(vm, READ_CONST(vm));
-      DISPATCH();
-    }
-    case $DEFINE_GLOBAL: {
-      ObjString* var = READ_STRING(vm);
-      map_put(&vm->current_module->fields, vm, var, PEEK_STACK(vm));
-      pop_stack(vm);
-      DISPATCH();
-    }
-    case $GET_GLOBAL: {
-      ObjString* var = READ_STRING(vm);
-      Value val;
-      if ((val = map_get(&vm->current_module->fields, var)) != NOTHING_VAL) {
-        push_stack(vm, val);
-      } else {
-        runtime_error(vm, NOTHING_VAL, "Name '%s' is not defined", var->str);
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $GET_LOCAL: {
-      push_stack(vm, vm->fp->stack[READ_BYTE(vm)]);
-      DISPATCH();
-    }
-    case $GET_UPVALUE: {
-      push_stack(vm, *vm->fp->closure->env[READ_BYTE(vm)]->location);
-      DISPATCH();
-    }
-    case $SET_GLOBAL: {
-      ObjString* var = READ_STRING(vm);
-      if (map_put(&vm->current_module->fields, vm, var, PEEK_STACK(vm))) {
-        // true if key is new - new insertion, false if key already exists
-        map_remove(&vm->current_module->fields, var);
-        return runtime_error(
-            vm,
-            NOTHING_VAL,
-            "use of undefined variable '%s'",
-            var->str);
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $SET_LOCAL: {
-      vm->fp->stack[READ_BYTE(vm)] = PEEK_STACK(vm);
-      DISPATCH();
-    }
-    case $SET_UPVALUE: {
-      *vm->fp->closure->env[READ_BYTE(vm)]->location = PEEK_STACK(vm);
-      DISPATCH();
-    }
-    case $SET_SUBSCRIPT: {
-      Value subscript = PEEK_STACK(vm);
-      Value var = PEEK_STACK_AT(vm, 1);  // gc reasons
-      Value value = PEEK_STACK_AT(vm, 2);  // gc reasons
-      if (!perform_subscript_assign(vm, var, subscript, value)) {
-        TRY_RECOVER(vm)
-      }
-      pop_stack(vm);  // gc reasons
-      pop_stack(vm);  // gc reasons
-      DISPATCH();
-    }
-    case $RET: {
-      CallFrame frame = pop_frame(vm);
-      if (vm->frame_count == 0) {
-        return RESULT_SUCCESS;
-      }
-      Value ret_val = pop_stack(vm);
-      // close all upvalues currently still unclosed
-      close_upvalues(vm, frame.stack);
-      vm->sp = frame.stack;
-      push_stack(vm, ret_val);
-      DISPATCH();
-    }
-    case $TAIL_CALL:
-    case $CALL: {
-      int argc = READ_BYTE(vm);
-      if (!call_value(vm, PEEK_STACK_AT(vm, argc), argc, inst == $TAIL_CALL)) {
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $ADD: {
-      BINARY_OP(vm, +, NUMBER_VAL)
-      DISPATCH();
-    }
-    case $SUBTRACT: {
-      BINARY_OP(vm, -, NUMBER_VAL)
-      DISPATCH();
-    }
-    case $DIVIDE: {
-      BINARY_OP(vm, /, NUMBER_VAL)
-      DISPATCH();
-    }
-    case $MULTIPLY: {
-      BINARY_OP(vm, *, NUMBER_VAL)
-      DISPATCH();
-    }
-    case $LESS: {
-      BINARY_OP(vm, <, BOOL_VAL);
-      DISPATCH();
-    }
-    case $GREATER: {
-      BINARY_OP(vm, >, BOOL_VAL);
-      DISPATCH();
-    }
-    case $LESS_OR_EQ: {
-      BINARY_OP(vm, <=, BOOL_VAL);
-      DISPATCH();
-    }
-    case $GREATER_OR_EQ: {
-      BINARY_OP(vm, >=, BOOL_VAL);
-      DISPATCH();
-    }
-    case $POW: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, **, a, b, IS_NUMBER);
-      double res = pow(AS_NUMBER(a), AS_NUMBER(b));
-      push_stack(vm, NUMBER_VAL(res));
-      DISPATCH();
-    }
-    case $MOD: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, %, a, b, IS_NUMBER);
-      double res = fmod(AS_NUMBER(a), AS_NUMBER(b));
-      push_stack(vm, NUMBER_VAL(res));
-      DISPATCH();
-    }
-    case $NOT: {
-      Value v = pop_stack(vm);
-      push_stack(vm, BOOL_VAL(value_falsy(v)));
-      DISPATCH();
-    }
-    case $NEGATE: {
-      Value v = pop_stack(vm);
-      UNARY_CHECK(vm, -, v, IS_NUMBER);
-      push_stack(vm, NUMBER_VAL(-AS_NUMBER(v)));
-      DISPATCH();
-    }
-    case $BW_INVERT: {
-      Value v = pop_stack(vm);
-      UNARY_CHECK(vm, ~, v, IS_NUMBER);
-      push_stack(vm, NUMBER_VAL((~(int64_t)AS_NUMBER(v))));
-      DISPATCH();
-    }
-    case $EQ: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      push_stack(vm, BOOL_VAL(value_equal(a, b)));
-      DISPATCH();
-    }
-    case $NOT_EQ: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      push_stack(vm, BOOL_VAL(!value_equal(a, b)));
-      DISPATCH();
-    }
-    case $POP: {
-      pop_stack(vm);
-      DISPATCH();
-    }
-    case $POP_N: {
-      vm->sp -= READ_BYTE(vm);
-      DISPATCH();
-    }
-    case $SUBSCRIPT: {
-      Value subscript = PEEK_STACK(vm);
-      Value val = PEEK_STACK_AT(vm, 1);
-      if (!perform_subscript(vm, val, subscript)) {
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $GET_FIELD: {
-      Value property = READ_CONST(vm);
-      Value value = pop_stack(vm);
-      if (!struct_prop_access(vm, value, property)) {
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $GET_PROPERTY: {
-      Value property = READ_CONST(vm);
-      Value value = pop_stack(vm);
-      if (!instance_prop_access(vm, value, AS_STRING(property))) {
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $SET_PROPERTY: {
-      Value property = READ_CONST(vm);
-      Value var = PEEK_STACK(vm);
-      if (!instance_prop_assign(vm, AS_STRING(property), var)) {
-        TRY_RECOVER(vm)
-      }
-      DISPATCH();
-    }
-    case $DISPLAY: {
-      byte_t len = READ_BYTE(vm);
-      for (int i = 0; i < len; i++) {
-        print_value(PEEK_STACK_AT(vm, i));
-        if (i < len - 1) {
-          printf(" ");
-        }
-      }
-      printf("\n");
-      vm->sp -= len;
-      DISPATCH();
-    }
-    case $ASSERT: {
-      Value test = PEEK_STACK(vm);  // gc reasons
-      Value msg = PEEK_STACK_AT(vm, 1);  // gc reasons
-      if (value_falsy(test)) {
-        runtime_error(
-            vm,
-            NOTHING_VAL,
-            "Assertion Failed: %s",
-            AS_STRING(value_to_string(vm, msg))->str);
-        TRY_RECOVER(vm)
-      }
-      pop_stack(vm);  // gc reasons
-      pop_stack(vm);  // gc reasons
-      DISPATCH();
-    }
-    case $JMP: {
-      uint16_t offset = READ_SHORT(vm);
-      vm->fp->ip += offset;
-      DISPATCH();
-    }
-    case $JMP_FALSE: {
-      uint16_t offset = READ_SHORT(vm);
-      if (value_falsy(PEEK_STACK(vm))) {
-        vm->fp->ip += offset;
-      }
-      DISPATCH();
-    }
-    case $JMP_FALSE_OR_POP: {
-      uint16_t offset = READ_SHORT(vm);
-      if (value_falsy(PEEK_STACK(vm))) {
-        vm->fp->ip += offset;
-      } else {
-        pop_stack(vm);
-      }
-      DISPATCH();
-    }
-    case $LOOP: {
-      uint16_t offset = READ_SHORT(vm);
-      vm->fp->ip -= offset;
-      DISPATCH();
-    }
-    case $SET_TRY: {
-      set_try(vm, READ_SHORT(vm));
-      DISPATCH();
-    }
-    case $TEAR_TRY: {
-      tear_try(vm);
-      DISPATCH();
-    }
-    case $THROW: {
-      Value val = pop_stack(vm);
-      if (IS_STRING(val)) {
-        runtime_error(vm, val, "%s", AS_STRING(val)->str);
-      } else {
-        runtime_error(vm, val, "");
-      }
-      TRY_RECOVER(vm)
-    }
-    case $BUILD_LIST: {
-      ObjList* list = create_list(vm, READ_BYTE(vm));
-      for (int i = 0; i < list->elems.length; i++) {
-        list->elems.buffer[i] = PEEK_STACK_AT(vm, i);
-      }
-      vm->sp -= list->elems.length;
-      push_stack(vm, OBJ_VAL(list));
-      DISPATCH();
-    }
-    case $BUILD_MAP: {
-      uint32_t len = READ_BYTE(vm) * 2;
-      ObjHashMap* map = create_hashmap(vm);
-      push_stack(vm, OBJ_VAL(map));  // gc reasons
-      Value key, val;
-      for (int i = 0; i < len; i += 2) {
-        val = PEEK_STACK_AT(vm, i + 1);
-        key = PEEK_STACK_AT(vm, i + 2);
-        hashmap_put(map, vm, key, val);
-      }
-      vm->sp -= len + 1;  // +1 for map (gc reasons)
-      push_stack(vm, OBJ_VAL(map));
-      DISPATCH();
-    }
-    case $BUILD_CLOSURE: {
-      ObjClosure* closure = create_closure(vm, AS_FUNC(READ_CONST(vm)));
-      push_stack(vm, OBJ_VAL(closure));
-      for (int i = 0; i < closure->env_len; i++) {
-        byte_t index = READ_BYTE(vm);
-        byte_t is_local = READ_BYTE(vm);
-        if (is_local) {
-          closure->env[i] = capture_upvalue(vm, vm->fp->stack + index);
-        } else {
-          closure->env[i] = vm->fp->closure->env[index];
-        }
-      }
-      DISPATCH();
-    }
-    case $BUILD_STRUCT: {
-      ObjString* name = READ_STRING(vm);
-      byte_t field_count = READ_BYTE(vm) * 2;  // k-v pairs
-      ObjStruct* strukt = create_struct(vm, name);
-      push_stack(vm, OBJ_VAL(strukt));  // gc reasons
-      ObjString* var;
-      Value val;
-      for (byte_t i = 0; i < field_count; i += 2) {
-        val = PEEK_STACK_AT(vm, i + 1);
-        var = AS_STRING(PEEK_STACK_AT(vm, i + 2));
-        if (!map_put(&strukt->fields, vm, var, val)) {
-          runtime_error(
-              vm,
-              NOTHING_VAL,
-              "Duplicate field '%s'\n"
-              "struct fields must be unique irrespective of meta-type",
-              var->str);
-          TRY_RECOVER(vm)
-        }
-      }
-      vm->sp -= field_count + 1;  // +1 for strukt (gc reasons)
-      push_stack(vm, OBJ_VAL(strukt));
-      DISPATCH();
-    }
-    case $BUILD_INSTANCE: {
-      Value var = PEEK_STACK(vm);  // gc reasons
-      byte_t field_count = READ_BYTE(vm) * 2;  // k-v pairs
-      if (!IS_STRUCT(var)) {
-        runtime_error(
-            vm,
-            NOTHING_VAL,
-            "Cannot instantiate '%s' type",
-            get_value_type(var));
-        TRY_RECOVER(vm)
-      }
-      ObjString* key;
-      Value val, check;
-      ObjStruct* strukt = AS_STRUCT(var);
-      ObjInstance* instance = create_instance(vm, strukt);
-      push_stack(vm, OBJ_VAL(instance));  // gc reasons
-      for (int i = 0; i < field_count; i += 2) {
-        val = PEEK_STACK_AT(vm, i + 2);
-        key = AS_STRING(PEEK_STACK_AT(vm, i + 3));
-        if (map_has_key(&strukt->fields, key, &check) && check == NOTHING_VAL) {
-          // only store fields with NOTHING_VAL value flag in the instance's field
-          map_put(&instance->fields, vm, key, val);
-        } else {
-          runtime_error(
-              vm,
-              NOTHING_VAL,
-              "Illegal/unknown instance property access '%s'",
-              key->str);
-          TRY_RECOVER(vm)
-        }
-      }
-      vm->sp -= field_count + 2;  // +2 for var and instance (gc reasons)
-      push_stack(vm, OBJ_VAL(instance));
-      DISPATCH();
+// the colder stack instructions, shared by run() and run_reg(); they work on
+// vm->sp, which their callers sync around them.
+
+static void build_list(VM* vm, int len) {
+  ObjList* list = create_list(vm, len);
+  for (int i = 0; i < list->elems.length; i++) {
+    list->elems.buffer[i] = PEEK_STACK_AT(vm, i);
+  }
+  vm->sp -= list->elems.length;
+  push_stack(vm, OBJ_VAL(list));
+}
+
+static void build_map(VM* vm, int len) {
+  len *= 2;
+  ObjHashMap* map = create_hashmap(vm);
+  push_stack(vm, OBJ_VAL(map));  // gc reasons
+  Value key, val;
+  for (int i = 0; i < len; i += 2) {
+    val = PEEK_STACK_AT(vm, i + 1);
+    key = PEEK_STACK_AT(vm, i + 2);
+    hashmap_put(map, vm, key, val);
+  }
+  vm->sp -= len + 1;  // +1 for map (gc reasons)
+  push_stack(vm, OBJ_VAL(map));
+}
+
+static byte_t*
+build_closure(VM* vm, ObjFn* fn, byte_t* ip, Value* slots, bool wide) {
+  // reads the (index, is_local) pair of each upvalue, 2 bytes each if
+  // `wide`, returns the new `ip`
+  ObjClosure* closure = create_closure(vm, fn);
+  push_stack(vm, OBJ_VAL(closure));
+  int index, is_local;
+  for (int i = 0; i < closure->env_len; i++) {
+    if (wide) {
+      index = (ip[0] << 8) | ip[1];
+      is_local = ip[3];
+      ip += 4;
+    } else {
+      index = *ip++;
+      is_local = *ip++;
     }
-    case $CLOSE_UPVALUE: {
-      close_upvalues(vm, vm->sp - 1);
-      pop_stack(vm);
-      DISPATCH();
+    if (is_local) {
+      closure->env[i] = capture_upvalue(vm, slots + index);
+    } else {
+      closure->env[i] = vm->fp->closure->env[index];
     }
-    case $BW_XOR: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, ^, a, b, IS_NUMBER);
-      push_stack(
+  }
+  return ip;
+}
+
+static bool build_struct(VM* vm, ObjString* name, int field_count) {
+  field_count *= 2;  // k-v pairs
+  ObjStruct* strukt = create_struct(vm, name);
+  push_stack(vm, OBJ_VAL(strukt));  // gc reasons
+  ObjString* var;
+  Value val;
+  for (int i = 0; i < field_count; i += 2) {
+    val = PEEK_STACK_AT(vm, i + 1);
+    var = AS_STRING(PEEK_STACK_AT(vm, i + 2));
+    if (!map_put(&strukt->fields, vm, var, val)) {
+      runtime_error(
           vm,
-          NUMBER_VAL(((int64_t)AS_NUMBER(a) ^ (int64_t)AS_NUMBER(b))));
-      DISPATCH();
+          NOTHING_VAL,
+          "Duplicate field '%s'\n"
+          "struct fields must be unique irrespective of meta-type",
+          var->str);
+      return false;
     }
-    case $BW_OR: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, |, a, b, IS_NUMBER);
-      push_stack(
+  }
+  vm->sp -= field_count + 1;  // +1 for strukt (gc reasons)
+  push_stack(vm, OBJ_VAL(strukt));
+  return true;
+}
+
+static bool build_instance(VM* vm, int field_count) {
+  Value var = PEEK_STACK(vm);  // gc reasons
+  field_count *= 2;  // k-v pairs
+  if (!IS_STRUCT(var)) {
+    runtime_error(
+        vm,
+        NOTHING_VAL,
+        "Cannot instantiate '%s' type",
+        get_value_type(var));
+    return false;
+  }
+  ObjString* key;
+  Value val, check;
+  ObjStruct* strukt = AS_STRUCT(var);
+  ObjInstance* instance = create_instance(vm, strukt);
+  push_stack(vm, OBJ_VAL(instance));  // gc reasons
+  for (int i = 0; i < field_count; i += 2) {
+    val = PEEK_STACK_AT(vm, i + 2);
+    key = AS_STRING(PEEK_STACK_AT(vm, i + 3));
+    if (map_has_key(&strukt->fields, key, &check) && check == NOTHING_VAL) {
+      // only store fields with NOTHING_VAL value flag in the instance's field
+      map_put(&instance->fields, vm, key, val);
+    } else {
+      runtime_error(
           vm,
-          NUMBER_VAL(((int64_t)AS_NUMBER(a) | (int64_t)AS_NUMBER(b))));
-      DISPATCH();
+          NOTHING_VAL,
+          "Illegal/unknown instance property access '%s'",
+          key->str);
+      return false;
     }
-    case $BW_AND: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, &, a, b, IS_NUMBER);
-      push_stack(
-          vm,
-          NUMBER_VAL(((int64_t)AS_NUMBER(a) & (int64_t)AS_NUMBER(b))));
-      DISPATCH();
+  }
+  vm->sp -= field_count + 2;  // +2 for var and instance (gc reasons)
+  push_stack(vm, OBJ_VAL(instance));
+  return true;
+}
+
+static void display(VM* vm, int len) {
+  for (int i = 0; i < len; i++) {
+    print_value(PEEK_STACK_AT(vm, i));
+    if (i < len - 1) {
+      printf(" ");
     }
-    case $BW_LSHIFT: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, <<, a, b, IS_NUMBER);
-      push_stack(
-          vm,
-          NUMBER_VAL((double)((int64_t)AS_NUMBER(a) << (int64_t)AS_NUMBER(b))));
+  }
+  printf("\n");
+  vm->sp -= len;
+}
+
+static bool check_assert(VM* vm) {
+  Value test = PEEK_STACK(vm);  // gc reasons
+  Value msg = PEEK_STACK_AT(vm, 1);  // gc reasons
+  if (value_falsy(test)) {
+    runtime_error(
+        vm,
+        NOTHING_VAL,
+        "Assertion Failed: %s",
+        AS_STRING(value_to_string(vm, msg))->str);
+    return false;
+  }
+  vm->sp -= 2;  // gc reasons
+  return true;
+}
+
+static void throw_value(VM* vm) {
+  Value val = pop_stack(vm);
+  if (IS_STRING(val)) {
+    runtime_error(vm, val, "%s", AS_STRING(val)->str);
+  } else {
+    runtime_error(vm, val, "");
+  }
+}
+
+// `for` loops (see c_for_stmt()): $ITER_PREP replaces the iterable with a
+// cursor and the iterator it walks. lists, strings and ranges are walked in
+// place, and the cursor is the index of the next element; hashmaps get an
+// iterator over their keys, which notices the map growing under it, and
+// iterators from core::iter() and the like keep a cursor of their own.
+// anything else gets a None cursor and goes through core::iter() and
+// core::next().
+
+static bool call_builtin(VM* vm, CFn fn, Value arg) {
+  // fn(arg), the way call_value() calls natives; the callee's slot is left
+  // for a closure the builtin may call in turn
+  push_stack(vm, NONE_VAL);
+  push_stack(vm, arg);
+  Value res = fn(vm, 1, vm->sp - 1);
+  if (res != NOTHING_VAL) {
+    vm->sp -= 2;
+    push_stack(vm, res);
+  }
+  return !vm->has_error;
+}
+
+static bool prep_native(VM* vm) {
+  // false, leaving the stack as it is, for anything but a list, a string, a
+  // hashmap, a range or an iterator
+  Value iterable = PEEK_STACK(vm);
+  if (IS_HMAP(iterable)) {
+    iterable = OBJ_VAL(create_iterator(vm, ITER_KEYS, AS_OBJ(iterable)));
+    vm->sp[-1] = NONE_VAL;
+  } else if (IS_ITERATOR(iterable)) {
+    vm->sp[-1] = NONE_VAL;
+  } else if (IS_LIST(iterable) || IS_STRING(iterable) || IS_RANGE(iterable)) {
+    vm->sp[-1] = NUMBER_VAL(0);
+  } else {
+    return false;
+  }
+  push_stack(vm, iterable);
+  return true;
+}
+
+static bool prep_iter(VM* vm) {
+  Value iterable = PEEK_STACK(vm);
+  if (prep_native(vm)) {
+    return true;
+  }
+  vm->sp[-1] = NONE_VAL;
+  return call_builtin(vm, fn_iter, iterable);
+}
+
+inline static int next_native(VM* vm) {
+  // $FOR_ITER: 1 if it pushed the next element, 0 if there is none. -1 for
+  // iterators that core::next() advances, or fails on
+  Value cursor = PEEK_STACK_AT(vm, 1), iterator = PEEK_STACK(vm);
+  Value elem;
+  if (IS_ITERATOR(iterator)) {
+    ObjIterator* iter = AS_ITERATOR(iterator);
+    if (iterator_moved(iter)) {
+      return -1;
+    }
+    if (!iterate(vm, iter->kind, iter->iterable, &iter->cursor, &elem)) {
+      return 0;
+    }
+    push_stack(vm, elem);
+    return 1;
+  }
+  if (!IS_NUMBER(cursor)) {
+    return -1;
+  }
+  int index = (int)AS_NUMBER(cursor);
+  if (IS_LIST(iterator)) {
+    ObjList* list = AS_LIST(iterator);
+    if (index >= list->elems.length) {
+      return 0;
+    }
+    elem = list->elems.buffer[index++];
+  } else if (!iterate(
+                 vm,
+                 IS_STRING(iterator) ? ITER_STRING : ITER_RANGE,
+                 AS_OBJ(iterator),
+                 &index,
+                 &elem)) {
+    return 0;
+  }
+  push_stack(vm, elem);
+  vm->sp[-3] = NUMBER_VAL(index);
+  return 1;
+}
+
+// slow paths of the machine code and of --emit-c programs, see jit.h
+
+static const char* jit_symbol(int op) {
+  switch (op) {
+    case $ADD:
+      return "+";
+    case $SUBTRACT:
+    case $NEGATE:
+      return "-";
+    case $MULTIPLY:
+      return "*";
+    case $DIVIDE:
+      return "/";
+    case $LESS:
+      return "<";
+    case $GREATER:
+      return ">";
+    case $LESS_OR_EQ:
+      return "<=";
+    case $GREATER_OR_EQ:
+      return ">=";
+    case $MOD:
+      return "%";
+    case $POW:
+      return "**";
+    case $BW_LSHIFT:
+      return "<<";
+    case $BW_RSHIFT:
+      return ">>";
+    case $BW_AND:
+      return "&";
+    case $BW_OR:
+      return "|";
+    case $BW_XOR:
+      return "^";
+    default:
+      return "~";
+  }
+}
+
+bool jit_falsy(Value val) {
+  return value_falsy(val);
+}
+
+bool jit_binary(VM* vm, int op) {
+  Value b = pop_stack(vm);
+  Value a = pop_stack(vm);
+  if (!IS_NUMBER(a) || !IS_NUMBER(b)) {
+    runtime_error(
+        vm,
+        NOTHING_VAL,
+        "Unsupported operand types for '%s': %s and %s",
+        jit_symbol(op),
+        get_value_type(a),
+        get_value_type(b));
+    return false;
+  }
+  double x = AS_NUMBER(a), y = AS_NUMBER(b);
+  int64_t i = (int64_t)x, j = (int64_t)y;
+  Value res;
+  switch (op) {
+    case $ADD:
+      res = NUMBER_VAL(x + y);
+      break;
+    case $SUBTRACT:
+      res = NUMBER_VAL(x - y);
+      break;
+    case $MULTIPLY:
+      res = NUMBER_VAL(x * y);
+      break;
+    case $DIVIDE:
+      res = NUMBER_VAL(x / y);
+      break;
+    case $LESS:
+      res = BOOL_VAL(x < y);
+      break;
+    case $GREATER:
+      res = BOOL_VAL(x > y);
+      break;
+    case $LESS_OR_EQ:
+      res = BOOL_VAL(x <= y);
+      break;
+    case $GREATER_OR_EQ:
+      res = BOOL_VAL(x >= y);
+      break;
+    case $MOD:
+      res = NUMBER_VAL(fmod(x, y));
+      break;
+    case $POW:
+      res = NUMBER_VAL(pow(x, y));
+      break;
+    case $BW_LSHIFT:
+      res = NUMBER_VAL((double)(i << j));
+      break;
+    case $BW_RSHIFT:
+      res = NUMBER_VAL((double)(i >> j));
+      break;
+    case $BW_AND:
+      res = NUMBER_VAL(i & j);
+      break;
+    case $BW_OR:
+      res = NUMBER_VAL(i | j);
+      break;
+    default:
+      res = NUMBER_VAL(i ^ j);
+      break;
+  }
+  push_stack(vm, res);
+  return true;
+}
+
+bool jit_unary(VM* vm, int op) {
+  Value v = pop_stack(vm);
+  if (!IS_NUMBER(v)) {
+    runtime_error(
+        vm,
+        NOTHING_VAL,
+        "Unsupported operand type for '%s': %s",
+        jit_symbol(op),
+        get_value_type(v));
+    return false;
+  }
+  push_stack(
+      vm,
+      op == $NEGATE ? NUMBER_VAL(-AS_NUMBER(v))
+                    : NUMBER_VAL(~(int64_t)AS_NUMBER(v)));
+  return true;
+}
+
+bool jit_is_core(VM* vm, int core) {
+  return is_core(vm, core);
+}
+
+bool jit_intrinsic(VM* vm, int index) {
+  return call_intrinsic(vm, index);
+}
+
+bool jit_iter_prep(VM* vm) {
+  return prep_native(vm);
+}
+
+int jit_for_iter(VM* vm) {
+  return next_native(vm);
+}
+
+void jit_define_global(VM* vm, int slot) {
+  *global_at(vm, slot) = pop_stack(vm);
+}
+
+bool jit_get_global(VM* vm, int slot) {
+  Value val = *global_at(vm, slot);
+  if (val == NOTHING_VAL) {
+    undefined_global(vm, "Name '%s' is not defined", slot);
+    return false;
+  }
+  push_stack(vm, val);
+  return true;
+}
+
+bool jit_set_global(VM* vm, int slot) {
+  Value* global = global_at(vm, slot);
+  if (*global == NOTHING_VAL) {
+    undefined_global(vm, "use of undefined variable '%s'", slot);
+    return false;
+  }
+  *global = PEEK_STACK(vm);
+  return true;
+}
+
+bool jit_get_field(VM* vm, Value property, InlineCache* ic) {
+  Value value = PEEK_STACK(vm), res;
+  if ((res = cached_field(vm, ic, value, AS_STRING(property)))
+      != NOTHING_VAL) {
+    vm->sp[-1] = res;
+    return true;
+  }
+  pop_stack(vm);
+  return struct_prop_access(vm, value, property);
+}
+
+bool jit_get_property(VM* vm, Value property, InlineCache* ic) {
+  Value value = PEEK_STACK(vm), res;
+  if (IS_INSTANCE(value)
+      && (res = cached_get(
+              vm,
+              ic,
+              &AS_INSTANCE(value)->fields,
+              AS_STRING(property)))
+          != NOTHING_VAL) {
+    vm->sp[-1] = res;
+    return true;
+  }
+  pop_stack(vm);
+  return instance_prop_access(vm, value, AS_STRING(property));
+}
+
+bool jit_set_property(VM* vm, Value property) {
+  return instance_prop_assign(vm, AS_STRING(property), PEEK_STACK(vm));
+}
+
+bool jit_subscript(VM* vm) {
+  return perform_subscript(vm, PEEK_STACK_AT(vm, 1), PEEK_STACK(vm));
+}
+
+bool jit_set_subscript(VM* vm) {
+  if (!perform_subscript_assign(
+          vm,
+          PEEK_STACK_AT(vm, 1),
+          PEEK_STACK(vm),
+          PEEK_STACK_AT(vm, 2))) {
+    return false;
+  }
+  vm->sp -= 2;  // gc reasons
+  return true;
+}
+
+void jit_build_list(VM* vm, int len) {
+  build_list(vm, len);
+}
+
+void jit_build_map(VM* vm, int len) {
+  build_map(vm, len);
+}
+
+void jit_build_closure(VM* vm, ObjFn* fn, byte_t* upvalues) {
+  build_closure(vm, fn, upvalues, vm->fp->stack, false);
+}
+
+bool jit_build_struct(VM* vm, ObjString* name, int field_count) {
+  return build_struct(vm, name, field_count);
+}
+
+bool jit_build_instance(VM* vm, int field_count) {
+  return build_instance(vm, field_count);
+}
+
+void jit_display(VM* vm, int len) {
+  display(vm, len);
+}
+
+bool jit_assert(VM* vm) {
+  return check_assert(vm);
+}
+
+bool jit_throw(VM* vm) {
+  throw_value(vm);
+  return false;
+}
+
+void jit_close_upvalue(VM* vm) {
+  close_upvalues(vm, vm->sp - 1);
+  pop_stack(vm);
+}
+
+bool jit_return(VM* vm) {
+  Value* slots = vm->fp->stack;
+  pop_frame(vm);
+  if (vm->frame_count == 0) {
+    return false;
+  }
+  Value ret_val = pop_stack(vm);
+  // close all upvalues currently still unclosed
+  close_upvalues(vm, slots);
+  vm->sp = slots;
+  push_stack(vm, ret_val);
+  return true;
+}
+
+inline static bool jit_ready(VM* vm, CallFrame* frame, bool loop) {
+  // counts calls (frames entered at their first instruction) and `loop`
+  // iterations, and compiles the function once it passes the threshold
+  ObjFn* fn = frame->closure->func;
+  if (fn->jit.bytes || fn->jit.aot) {
+    return true;
+  }
+#ifdef EVE_JIT
+  if (fn->jit.declined || vm->jit_threshold == JIT_AOT
+      || (frame->ip != fn->code.bytes && !loop)) {
+    return false;
+  }
+  return ++fn->hotness > vm->jit_threshold && jit_compile(vm, fn);
+#else
+  (void)loop;
+  return false;
+#endif
+}
+
+static JitStatus run_native(VM* vm) {
+  // the current frame continues in its function's C or machine code
+  AotFn aot = vm->fp->closure->func->jit.aot;
+  if (aot) {
+    return aot(vm);
+  }
+#ifdef EVE_JIT
+  return jit_run(vm);
+#else
+  UNREACHABLE("no machine code without EVE_JIT");
+#endif
+}
+
+JitStatus jit_call(VM* vm, int argc) {
+  // the callee runs in machine code too if it's compiled, nested on the C
+  // stack; anything else (a callee that isn't, a recovered error) is left
+  // to run(). without --jit (calls from a trace) the threshold is -1, so a
+  // callee is compiled on its first such call
+  if (sample_due) {
+    take_sample(vm);
+  }
+  int count = vm->frame_count;
+  byte_t* ip = vm->fp->ip;
+  if (!call_value(vm, PEEK_STACK_AT(vm, argc), argc, false)) {
+    return JIT_ERROR;
+  }
+  if (vm->frame_count == count && vm->fp->ip == ip) {
+    return JIT_RETURN;  // a native
+  }
+  if (vm->frame_count != count + 1 || vm->jit_depth >= JIT_DEPTH_MAX
+      || !jit_ready(vm, vm->fp, false)) {
+    return JIT_EXIT;
+  }
+  vm->jit_depth++;
+  JitStatus status = run_native(vm);
+  vm->jit_depth--;
+  return status;
+}
+
+#ifdef EVE_JIT
+
+static void stop_recording(VM* vm, TraceState state) {
+  vm->recording->state = state;
+  vm->recording->hotness = 0;
+  vm->recording = NULL;
+  vm->recording_fn = NULL;
+}
+
+static void record_branch(VM* vm, byte_t* ip) {
+  // the recorded iteration's path is where its frame's conditional jumps went;
+  // a NULL `ip` is a way it cannot follow
+  Trace* trace = vm->recording;
+  ObjFn* fn = vm->fp->closure->func;
+  if (vm->frame_count - 1 != trace->frame || fn != vm->recording_fn) {
+    return;
+  }
+  if (!ip || trace->branch_count == TRACE_BRANCHES) {
+    stop_recording(vm, TRACE_DECLINED);
+    return;
+  }
+  trace->branches[trace->branch_count++] = (int)(ip - fn->code.bytes);
+}
+
+static Trace* hot_loop(VM* vm, int depth) {
+  // counts iterations of the loop the current frame's $LOOP went around to,
+  // records the next one once it's hot and compiles that, and returns the
+  // trace once it's compiled
+  ObjFn* fn = vm->fp->closure->func;
+  int frame = vm->frame_count - 1;
+  Trace* trace = loop_trace(vm, fn, (int)(vm->fp->ip - fn->code.bytes));
+  Trace* recording = vm->recording;
+  if (recording == trace && trace->frame == frame && vm->recording_fn == fn) {
+    // the recorded iteration went around
+    stop_recording(vm, TRACE_DECLINED);
+    trace_compile(vm, fn, trace);
+  } else if (recording && recording->frame >= frame) {
+    // its frame returned, or another loop went around: the recorded loop
+    // was left, or has an inner loop. it may be recorded again later
+    stop_recording(vm, TRACE_COUNTING);
+  }
+  switch (trace->state) {
+    case TRACE_COUNTING:
+      if (++trace->hotness > vm->trace_threshold && !vm->recording) {
+        trace->state = TRACE_RECORDING;
+        trace->branch_count = 0;
+        trace->frame = frame;
+        trace->depth = depth;
+        vm->recording = trace;
+        vm->recording_fn = fn;
+      }
+      return NULL;
+    case TRACE_COMPILED:
+      // traces that mostly exit before an iteration is done don't pay off
+      if (++trace->entered > TRACE_THRESHOLD
+          && trace->iterations * 2 < trace->entered) {
+        drop_trace(trace);
+        return NULL;
+      }
+      return trace;
+    default:
+      return NULL;
+  }
+}
+#endif
+
+IResult run(VM* vm) {
+  register byte_t inst;
+  register byte_t* ip;
+  register Value* sp;
+  Value* slots;
+  Value* consts;
+  InlineCache* caches;
+  CallFrame* frame;
+  // operands of the instructions $WIDE shares handlers with
+  int arg, count;
+  InlineCache* ic;
+#ifdef EVE_COMPUTED_GOTO
+  #define LABEL(op) [op] = &&op##_handler
+  static void* dispatch_table[] = {
+      [0 ... UINT8_MAX] = &&unknown_opcode,
+      LABEL($ADD),
+      LABEL($SUBTRACT),
+      LABEL($MULTIPLY),
+      LABEL($DIVIDE),
+      LABEL($NEGATE),
+      LABEL($MOD),
+      LABEL($POW),
+      LABEL($NOT),
+      LABEL($EQ),
+      LABEL($NOT_EQ),
+      LABEL($LESS),
+      LABEL($GREATER),
+      LABEL($LESS_OR_EQ),
+      LABEL($GREATER_OR_EQ),
+      LABEL($JMP),
+      LABEL($JMP_FALSE),
+      LABEL($JMP_FALSE_OR_POP),
+      LABEL($BW_LSHIFT),
+      LABEL($BW_RSHIFT),
+      LABEL($BW_INVERT),
+      LABEL($BW_AND),
+      LABEL($BW_XOR),
+      LABEL($BW_OR),
+      LABEL($LOAD_CONST),
+      LABEL($BUILD_LIST),
+      LABEL($BUILD_MAP),
+      LABEL($BUILD_CLOSURE),
+      LABEL($BUILD_STRUCT),
+      LABEL($BUILD_INSTANCE),
+      LABEL($POP),
+      LABEL($POP_N),
+      LABEL($DISPLAY),
+      LABEL($SUBSCRIPT),
+      LABEL($GET_FIELD),
+      LABEL($GET_PROPERTY),
+      LABEL($SET_PROPERTY),
+      LABEL($SET_SUBSCRIPT),
+      LABEL($DEFINE_GLOBAL),
+      LABEL($GET_GLOBAL),
+      LABEL($GET_LOCAL),
+      LABEL($SET_GLOBAL),
+      LABEL($SET_LOCAL),
+      LABEL($GET_UPVALUE),
+      LABEL($SET_UPVALUE),
+      LABEL($CLOSE_UPVALUE),
+      LABEL($ASSERT),
+      LABEL($THROW),
+      LABEL($LOOP),
+      LABEL($CALL),
+      LABEL($TAIL_CALL),
+      LABEL($RET),
+      LABEL($ITER_PREP),
+      LABEL($FOR_ITER),
+      LABEL($LEN),
+      LABEL($TYPEOF),
+      LABEL($WIDE),
+      LABEL($ADD_LOCALS),
+      LABEL($ADD_CONST),
+      LABEL($SUBTRACT_CONST),
+      LABEL($LESS_JMP),
+      LABEL($GREATER_JMP),
+      LABEL($LESS_OR_EQ_JMP),
+      LABEL($GREATER_OR_EQ_JMP),
+      LABEL($EQ_JMP),
+      LABEL($NOT_EQ_JMP),
+      LABEL($SET_LOCAL_POP),
+      LABEL($RET_LOCAL),
+      LABEL($ADD_NUM),
+      LABEL($SUBTRACT_NUM),
+      LABEL($MULTIPLY_NUM),
+      LABEL($DIVIDE_NUM),
+      LABEL($LESS_NUM),
+      LABEL($GREATER_NUM),
+      LABEL($LESS_OR_EQ_NUM),
+      LABEL($GREATER_OR_EQ_NUM),
+  };
+  #undef LABEL
+#endif
+  LOAD_STATE();
+#ifdef EVE_OPCODE_STATS
+  inst = $CALL;  // what started the frame, as far as pairs go
+#endif
+#if defined(EVE_DEBUG_EXECUTION)
+  print_stack(vm);
+  dis_instruction(
+      &vm->fp->closure->func->code,
+      (int)(vm->fp->ip - vm->fp->closure->func->code.bytes));
+#endif
+  JIT_HOOK(false);
+  VM_LOOP {
+    CASE($LOAD_CONST): {
+      PUSH(READ_CONST());
+      DISPATCH();
+    }
+    CASE($DEFINE_GLOBAL): {
+      arg = READ_BYTE();
+    define_global:;
+      *global_at(vm, arg) = POP();
+      DISPATCH();
+    }
+    CASE($GET_GLOBAL): {
+      arg = READ_BYTE();
+    get_global:;
+      Value val = *global_at(vm, arg);
+      if (val != NOTHING_VAL) {
+        PUSH(val);
+      } else {
+        STORE_STATE();
+        undefined_global(vm, "Name '%s' is not defined", arg);
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($GET_LOCAL): {
+      PUSH(slots[READ_BYTE()]);
+      DISPATCH();
+    }
+    CASE($GET_UPVALUE): {
+      PUSH(*frame->closure->env[READ_BYTE()]->location);
+      DISPATCH();
+    }
+    CASE($SET_GLOBAL): {
+      arg = READ_BYTE();
+    set_global:;
+      Value* global = global_at(vm, arg);
+      if (*global == NOTHING_VAL) {
+        STORE_STATE();
+        undefined_global(vm, "use of undefined variable '%s'", arg);
+        TRY_RECOVER()
+      }
+      *global = PEEK();
+      DISPATCH();
+    }
+    CASE($SET_LOCAL): {
+      slots[READ_BYTE()] = PEEK();
+      DISPATCH();
+    }
+    CASE($SET_UPVALUE): {
+      *frame->closure->env[READ_BYTE()]->location = PEEK();
+      DISPATCH();
+    }
+    CASE($SET_SUBSCRIPT): {
+      Value subscript = PEEK();
+      Value var = PEEK_AT(1);  // gc reasons
+      Value value = PEEK_AT(2);  // gc reasons
+      STORE_STATE();
+      if (!perform_subscript_assign(vm, var, subscript, value)) {
+        TRY_RECOVER()
+      }
+      POP();  // gc reasons
+      POP();  // gc reasons
+      DISPATCH();
+    }
+    CASE($RET_LOCAL): {
+      PUSH(slots[READ_BYTE()]);
+      // fall through
+    }
+    CASE($RET): {
+      vm->sp = sp;
+      pop_frame(vm);
+      if (vm->frame_count == 0) {
+        return RESULT_SUCCESS;
+      }
+      Value ret_val = POP();
+      // close all upvalues currently still unclosed
+      close_upvalues(vm, slots);
+      sp = slots;
+      PUSH(ret_val);
+      LOAD_FRAME();
+      JIT_HOOK(false);
+      DISPATCH();
+    }
+    CASE($TAIL_CALL):
+    CASE($CALL): {
+      int argc = READ_BYTE();
+      SAMPLE();
+      STORE_STATE();
+      if (!call_value(vm, PEEK_AT(argc), argc, inst == $TAIL_CALL)) {
+        TRY_RECOVER()
+      }
+      LOAD_STATE();
+      JIT_HOOK(false);
+      DISPATCH();
+    }
+    CASE($ITER_PREP): {
+      STORE_STATE();
+      if (!prep_iter(vm)) {
+        TRY_RECOVER()
+      }
+      // core::iter() may have called the iterable's `iter`
+      LOAD_STATE();
+      JIT_HOOK(false);
+      DISPATCH();
+    }
+    CASE($FOR_ITER): {
+      count = READ_SHORT();
+    for_iter:;
+      STORE_STATE();
+      int next = next_native(vm);
+      if (next == -1) {
+        // StopIteration ends the loop, see c_for_stmt()
+        TRACE_DECLINE();
+        if (!call_builtin(vm, fn_next, PEEK())) {
+          TRY_RECOVER()
+        }
+        LOAD_STATE();
+        JIT_HOOK(false);
+        DISPATCH();
+      }
+      sp = vm->sp;
+      if (!next) {
+        ip += count;
+      }
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($LEN):
+    CASE($TYPEOF): {
+      arg = READ_BYTE();
+      count = READ_BYTE();
+      STORE_STATE();
+      if (!is_core(vm, arg)) {
+        if (!intrinsic_callee(vm, arg, count)
+            || !call_value(vm, PEEK_STACK_AT(vm, 1), 1, false)) {
+          TRY_RECOVER()
+        }
+        LOAD_STATE();
+        JIT_HOOK(false);
+        DISPATCH();
+      }
+      if (!call_intrinsic(vm, count)) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($ADD): {
+      BINARY_OP(+, NUMBER_VAL, $ADD_NUM)
+      DISPATCH();
+    }
+    CASE($SUBTRACT): {
+      BINARY_OP(-, NUMBER_VAL, $SUBTRACT_NUM)
+      DISPATCH();
+    }
+    CASE($DIVIDE): {
+      BINARY_OP(/, NUMBER_VAL, $DIVIDE_NUM)
+      DISPATCH();
+    }
+    CASE($MULTIPLY): {
+      BINARY_OP(*, NUMBER_VAL, $MULTIPLY_NUM)
+      DISPATCH();
+    }
+    CASE($LESS): {
+      BINARY_OP(<, BOOL_VAL, $LESS_NUM)
+      DISPATCH();
+    }
+    CASE($GREATER): {
+      BINARY_OP(>, BOOL_VAL, $GREATER_NUM)
+      DISPATCH();
+    }
+    CASE($LESS_OR_EQ): {
+      BINARY_OP(<=, BOOL_VAL, $LESS_OR_EQ_NUM)
+      DISPATCH();
+    }
+    CASE($GREATER_OR_EQ): {
+      BINARY_OP(>=, BOOL_VAL, $GREATER_OR_EQ_NUM)
+      DISPATCH();
+    }
+    CASE($POW): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(**, a, b, IS_NUMBER);
+      double res = pow(AS_NUMBER(a), AS_NUMBER(b));
+      PUSH(NUMBER_VAL(res));
+      DISPATCH();
+    }
+    CASE($MOD): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(%, a, b, IS_NUMBER);
+      double res = fmod(AS_NUMBER(a), AS_NUMBER(b));
+      PUSH(NUMBER_VAL(res));
+      DISPATCH();
+    }
+    CASE($NOT): {
+      Value v = POP();
+      PUSH(BOOL_VAL(value_falsy(v)));
+      DISPATCH();
+    }
+    CASE($NEGATE): {
+      Value v = POP();
+      UNARY_CHECK(-, v, IS_NUMBER);
+      PUSH(NUMBER_VAL(-AS_NUMBER(v)));
+      DISPATCH();
+    }
+    CASE($BW_INVERT): {
+      Value v = POP();
+      UNARY_CHECK(~, v, IS_NUMBER);
+      PUSH(NUMBER_VAL((~(int64_t)AS_NUMBER(v))));
+      DISPATCH();
+    }
+    CASE($EQ): {
+      Value b = POP();
+      Value a = POP();
+      PUSH(BOOL_VAL(value_equal(a, b)));
+      DISPATCH();
+    }
+    CASE($NOT_EQ): {
+      Value b = POP();
+      Value a = POP();
+      PUSH(BOOL_VAL(!value_equal(a, b)));
+      DISPATCH();
+    }
+    CASE($POP): {
+      POP();
+      DISPATCH();
+    }
+    CASE($POP_N): {
+      sp -= READ_BYTE();
+      DISPATCH();
+    }
+    CASE($SUBSCRIPT): {
+      Value subscript = PEEK();
+      Value val = PEEK_AT(1);
+      STORE_STATE();
+      if (!perform_subscript(vm, val, subscript)) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($GET_FIELD): {
+      arg = READ_BYTE();
+      ic = READ_CACHE();
+    get_field:;
+      Value property = consts[arg];
+      Value value = PEEK(), res;
+      if ((res = cached_field(vm, ic, value, AS_STRING(property)))
+          != NOTHING_VAL) {
+        sp[-1] = res;
+        DISPATCH();
+      }
+      POP();
+      STORE_STATE();
+      if (!struct_prop_access(vm, value, property)) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($GET_PROPERTY): {
+      arg = READ_BYTE();
+      ic = READ_CACHE();
+    get_property:;
+      Value property = consts[arg];
+      Value value = PEEK(), res;
+      if (IS_INSTANCE(value)
+          && (res = cached_get(
+                  vm,
+                  ic,
+                  &AS_INSTANCE(value)->fields,
+                  AS_STRING(property)))
+              != NOTHING_VAL) {
+        sp[-1] = res;
+        DISPATCH();
+      }
+      POP();
+      STORE_STATE();
+      if (!instance_prop_access(vm, value, AS_STRING(property))) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($SET_PROPERTY): {
+      arg = READ_BYTE();
+    set_property:;
+      Value property = consts[arg];
+      Value var = PEEK();
+      STORE_STATE();
+      if (!instance_prop_assign(vm, AS_STRING(property), var)) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($DISPLAY): {
+      byte_t len = READ_BYTE();
+      STORE_STATE();
+      display(vm, len);
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($ASSERT): {
+      STORE_STATE();
+      if (!check_assert(vm)) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($JMP): {
+      uint16_t offset = READ_SHORT();
+      ip += offset;
+      DISPATCH();
+    }
+    CASE($JMP_FALSE): {
+      count = READ_SHORT();
+    jmp_false:
+      if (value_falsy(PEEK())) {
+        ip += count;
+      }
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($JMP_FALSE_OR_POP): {
+      count = READ_SHORT();
+    jmp_false_or_pop:
+      if (value_falsy(PEEK())) {
+        ip += count;
+      } else {
+        POP();
+      }
+      TRACE_BRANCH();
       DISPATCH();
     }
-    case $BW_RSHIFT: {
-      Value b = pop_stack(vm);
-      Value a = pop_stack(vm);
-      BINARY_CHECK(vm, >>, a, b, IS_NUMBER);
-      push_stack(
-          vm,
+    CASE($LOOP): {
+      count = READ_SHORT();
+      PROFILE_LOOP(frame->closure->func, ip - 3);
+    loop:
+      SAMPLE();
+      ip -= count;
+      TRACE_LOOP();
+      JIT_HOOK(true);
+      DISPATCH();
+    }
+    CASE($THROW): {
+      STORE_STATE();
+      throw_value(vm);
+      TRY_RECOVER()
+    }
+    CASE($BUILD_LIST): {
+      byte_t len = READ_BYTE();
+      STORE_STATE();
+      build_list(vm, len);
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($BUILD_MAP): {
+      byte_t len = READ_BYTE();
+      STORE_STATE();
+      build_map(vm, len);
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($BUILD_CLOSURE): {
+      ObjFn* fn = AS_FUNC(READ_CONST());
+      STORE_STATE();
+      ip = build_closure(vm, fn, ip, slots, false);
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($BUILD_STRUCT): {
+      arg = READ_BYTE();
+      count = READ_BYTE();
+    build_struct:;
+      ObjString* name = AS_STRING(consts[arg]);
+      STORE_STATE();
+      if (!build_struct(vm, name, count)) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($BUILD_INSTANCE): {
+      byte_t field_count = READ_BYTE();
+      STORE_STATE();
+      if (!build_instance(vm, field_count)) {
+        TRY_RECOVER()
+      }
+      sp = vm->sp;
+      DISPATCH();
+    }
+    CASE($CLOSE_UPVALUE): {
+      close_upvalues(vm, sp - 1);
+      POP();
+      DISPATCH();
+    }
+    CASE($BW_XOR): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(^, a, b, IS_NUMBER);
+      PUSH(NUMBER_VAL(((int64_t)AS_NUMBER(a) ^ (int64_t)AS_NUMBER(b))));
+      DISPATCH();
+    }
+    CASE($BW_OR): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(|, a, b, IS_NUMBER);
+      PUSH(NUMBER_VAL(((int64_t)AS_NUMBER(a) | (int64_t)AS_NUMBER(b))));
+      DISPATCH();
+    }
+    CASE($BW_AND): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(&, a, b, IS_NUMBER);
+      PUSH(NUMBER_VAL(((int64_t)AS_NUMBER(a) & (int64_t)AS_NUMBER(b))));
+      DISPATCH();
+    }
+    CASE($BW_LSHIFT): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(<<, a, b, IS_NUMBER);
+      PUSH(
+          NUMBER_VAL((double)((int64_t)AS_NUMBER(a) << (int64_t)AS_NUMBER(b))));
+      DISPATCH();
+    }
+    CASE($BW_RSHIFT): {
+      Value b = POP();
+      Value a = POP();
+      BINARY_CHECK(>>, a, b, IS_NUMBER);
+      PUSH(
           NUMBER_VAL((double)((int64_t)AS_NUMBER(a) >> (int64_t)AS_NUMBER(b))));
       DISPATCH();
     }
-    default:
+    CASE($WIDE): {
+      // operands are 2 bytes (jump offsets 4); instructions that do more
+      // than read them share the rest of their narrow handler
+      switch (READ_BYTE()) {
+        case $LOAD_CONST:
+          PUSH(consts[READ_SHORT()]);
+          DISPATCH();
+        case $GET_LOCAL:
+          PUSH(slots[READ_SHORT()]);
+          DISPATCH();
+        case $SET_LOCAL:
+          slots[READ_SHORT()] = PEEK();
+          DISPATCH();
+        case $GET_UPVALUE:
+          PUSH(*frame->closure->env[READ_SHORT()]->location);
+          DISPATCH();
+        case $SET_UPVALUE:
+          *frame->closure->env[READ_SHORT()]->location = PEEK();
+          DISPATCH();
+        case $JMP: {
+          uint32_t offset = READ_LONG();
+          ip += offset;
+          DISPATCH();
+        }
+        case $JMP_FALSE:
+          count = (int)READ_LONG();
+          goto jmp_false;
+        case $JMP_FALSE_OR_POP:
+          count = (int)READ_LONG();
+          goto jmp_false_or_pop;
+        case $FOR_ITER:
+          count = (int)READ_LONG();
+          goto for_iter;
+        case $LOOP:
+          count = (int)READ_LONG();
+          PROFILE_LOOP(frame->closure->func, ip - 6);
+          goto loop;
+        case $BUILD_CLOSURE: {
+          ObjFn* fn = AS_FUNC(consts[READ_SHORT()]);
+          STORE_STATE();
+          ip = build_closure(vm, fn, ip, slots, true);
+          sp = vm->sp;
+          DISPATCH();
+        }
+        case $DEFINE_GLOBAL:
+          arg = READ_SHORT();
+          goto define_global;
+        case $SET_GLOBAL:
+          arg = READ_SHORT();
+          goto set_global;
+        case $SET_PROPERTY:
+          arg = READ_SHORT();
+          goto set_property;
+        case $BUILD_STRUCT:
+          arg = READ_SHORT();
+          count = READ_SHORT();
+          goto build_struct;
+        case $GET_GLOBAL:
+          arg = READ_SHORT();
+          goto get_global;
+        case $GET_FIELD:
+          arg = READ_SHORT();
+          ip += 2;  // the cache index' high bytes
+          ic = READ_CACHE();
+          goto get_field;
+        case $GET_PROPERTY:
+          arg = READ_SHORT();
+          ip += 2;
+          ic = READ_CACHE();
+          goto get_property;
+        default:
+          UNREACHABLE("unknown wide opcode");
+      }
+    }
+    CASE($ADD_LOCALS): {
+      Value a = slots[READ_BYTE()];
+      Value b = slots[READ_BYTE()];
+      BINARY_CHECK(+, a, b, IS_NUMBER);
+      PUSH(NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b)));
+      DISPATCH();
+    }
+    CASE($ADD_CONST): {
+      Value b = READ_CONST();
+      Value a = POP();
+      BINARY_CHECK(+, a, b, IS_NUMBER);
+      PUSH(NUMBER_VAL(AS_NUMBER(a) + AS_NUMBER(b)));
+      DISPATCH();
+    }
+    CASE($SUBTRACT_CONST): {
+      Value b = READ_CONST();
+      Value a = POP();
+      BINARY_CHECK(-, a, b, IS_NUMBER);
+      PUSH(NUMBER_VAL(AS_NUMBER(a) - AS_NUMBER(b)));
+      DISPATCH();
+    }
+    CASE($LESS_JMP): {
+      COMPARE_JMP(<)
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($GREATER_JMP): {
+      COMPARE_JMP(>)
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($LESS_OR_EQ_JMP): {
+      COMPARE_JMP(<=)
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($GREATER_OR_EQ_JMP): {
+      COMPARE_JMP(>=)
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($EQ_JMP): {
+      uint16_t offset = READ_SHORT();
+      Value b = POP();
+      Value a = POP();
+      if (!value_equal(a, b)) {
+        PUSH(FALSE_VAL);
+        ip += offset;
+      }
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($NOT_EQ_JMP): {
+      uint16_t offset = READ_SHORT();
+      Value b = POP();
+      Value a = POP();
+      if (value_equal(a, b)) {
+        PUSH(FALSE_VAL);
+        ip += offset;
+      }
+      TRACE_BRANCH();
+      DISPATCH();
+    }
+    CASE($SET_LOCAL_POP): {
+      slots[READ_BYTE()] = POP();
+      DISPATCH();
+    }
+    CASE($ADD_NUM): {
+      QUICK_BINARY_OP(+, NUMBER_VAL, $ADD)
+      DISPATCH();
+    }
+    CASE($SUBTRACT_NUM): {
+      QUICK_BINARY_OP(-, NUMBER_VAL, $SUBTRACT)
+      DISPATCH();
+    }
+    CASE($MULTIPLY_NUM): {
+      QUICK_BINARY_OP(*, NUMBER_VAL, $MULTIPLY)
+      DISPATCH();
+    }
+    CASE($DIVIDE_NUM): {
+      QUICK_BINARY_OP(/, NUMBER_VAL, $DIVIDE)
+      DISPATCH();
+    }
+    CASE($LESS_NUM): {
+      QUICK_BINARY_OP(<, BOOL_VAL, $LESS)
+      DISPATCH();
+    }
+    CASE($GREATER_NUM): {
+      QUICK_BINARY_OP(>, BOOL_VAL, $GREATER)
+      DISPATCH();
+    }
+    CASE($LESS_OR_EQ_NUM): {
+      QUICK_BINARY_OP(<=, BOOL_VAL, $LESS_OR_EQ)
+      DISPATCH();
+    }
+    CASE($GREATER_OR_EQ_NUM): {
+      QUICK_BINARY_OP(>=, BOOL_VAL, $GREATER_OR_EQ)
+      DISPATCH();
+    }
+    jit_enter: {
+      STORE_STATE();
+      switch (run_native(vm)) {
+        case JIT_ERROR:
+          TRY_RECOVER()
+        case JIT_DONE:
+          return RESULT_SUCCESS;
+        case JIT_RETURN:
+          // to a frame that may be compiled as well
+          LOAD_STATE();
+          JIT_HOOK(false);
+          DISPATCH();
+        default:
+          LOAD_STATE();
+          DISPATCH();
+      }
+    }
+#ifdef EVE_JIT
+    trace_loop: {
+      STORE_STATE();
+      Trace* trace = hot_loop(vm, (int)(sp - slots));
+      if (trace) {
+        if (trace_run(vm, trace) == JIT_ERROR) {
+          TRY_RECOVER()
+        }
+        LOAD_STATE();
+        DISPATCH();
+      }
+      JIT_HOOK(true);
+      DISPATCH();
+    }
+#endif
+    DEFAULT:
+      UNREACHABLE("unknown opcode");
+  }
+  END_BRACE
+}
+
+// run_reg() keeps no stack pointer: registers are addressed through `slots`,
+// and instructions that work on the stack carry the depth they run at.
+#undef STORE_STATE
+#undef LOAD_STATE
+#define STORE_STATE() (frame->ip = ip)
+#define LOAD_STATE() LOAD_FRAME()
+// instead of entering machine code, it hands run() the frames of the
+// functions the register engine declined
+#undef JIT_HOOK
+#define JIT_HOOK(_loop) \
+  if (!frame->closure->func->reg.bytes) { \
+    STORE_STATE(); \
+    return RESULT_SWITCH; \
+  }
+#undef TRACE_LOOP
+#define TRACE_LOOP()
+#undef TRACE_BRANCH
+#define TRACE_BRANCH()
+#define SYNC_STATE(depth) (frame->ip = ip, vm->sp = slots + (depth))
+#define REG_EQ_JMP(_eq, _read_r) \
+  { \
+    byte_t _a = READ_BYTE(); \
+    Value _l = slots[READ_BYTE()]; \
+    Value _r = _read_r; \
+    uint16_t _offset = READ_SHORT(); \
+    if (value_equal(_l, _r) != (_eq)) { \
+      slots[_a] = FALSE_VAL; \
+      ip += _offset; \
+    } \
+  }
+#define REG_BINARY_OP(_op, _val_func, _read_r) \
+  { \
+    byte_t _a = READ_BYTE(); \
+    Value _l = slots[READ_BYTE()]; \
+    Value _r = _read_r; \
+    BINARY_CHECK(_op, _l, _r, IS_NUMBER); \
+    slots[_a] = _val_func(AS_NUMBER(_l) _op AS_NUMBER(_r)); \
+  }
+#define REG_BITWISE_OP(_op) \
+  { \
+    byte_t _a = READ_BYTE(); \
+    Value _l = slots[READ_BYTE()]; \
+    Value _r = slots[READ_BYTE()]; \
+    BINARY_CHECK(_op, _l, _r, IS_NUMBER); \
+    slots[_a] = \
+        NUMBER_VAL((double)((int64_t)AS_NUMBER(_l) _op(int64_t) AS_NUMBER(_r))); \
+  }
+#define REG_COMPARE_JMP(_op, _read_r) \
+  { \
+    byte_t _a = READ_BYTE(); \
+    Value _l = slots[READ_BYTE()]; \
+    Value _r = _read_r; \
+    uint16_t _offset = READ_SHORT(); \
+    BINARY_CHECK(_op, _l, _r, IS_NUMBER); \
+    if (!(AS_NUMBER(_l) _op AS_NUMBER(_r))) { \
+      slots[_a] = FALSE_VAL; \
+      ip += _offset; \
+    } \
+  }
+
+// register code isn't counted by --opcode-stats
+#undef NEXT_INST
+#define NEXT_INST() READ_BYTE()
+
+IResult run_reg(VM* vm) {
+  register byte_t inst;
+  register byte_t* ip;
+  register Value* slots;
+  Value* consts;
+  InlineCache* caches;
+  CallFrame* frame;
+#ifdef EVE_COMPUTED_GOTO
+  #define LABEL(op) [op] = &&op##_handler
+  static void* dispatch_table[] = {
+      [0 ... UINT8_MAX] = &&unknown_opcode,
+      LABEL($R_MOVE),
+      LABEL($R_LOADK),
+      LABEL($R_GET_UPVALUE),
+      LABEL($R_SET_UPVALUE),
+      LABEL($R_GET_GLOBAL),
+      LABEL($R_SET_GLOBAL),
+      LABEL($R_DEFINE_GLOBAL),
+      LABEL($R_ADD),
+      LABEL($R_SUBTRACT),
+      LABEL($R_MULTIPLY),
+      LABEL($R_DIVIDE),
+      LABEL($R_MOD),
+      LABEL($R_POW),
+      LABEL($R_BW_LSHIFT),
+      LABEL($R_BW_RSHIFT),
+      LABEL($R_BW_AND),
+      LABEL($R_BW_XOR),
+      LABEL($R_BW_OR),
+      LABEL($R_ADDK),
+      LABEL($R_SUBTRACTK),
+      LABEL($R_NEGATE),
+      LABEL($R_NOT),
+      LABEL($R_BW_INVERT),
+      LABEL($R_EQ),
+      LABEL($R_NOT_EQ),
+      LABEL($R_LESS),
+      LABEL($R_GREATER),
+      LABEL($R_LESS_OR_EQ),
+      LABEL($R_GREATER_OR_EQ),
+      LABEL($R_JMP),
+      LABEL($R_LOOP),
+      LABEL($R_JMP_FALSE),
+      LABEL($R_EQ_JMP),
+      LABEL($R_NOT_EQ_JMP),
+      LABEL($R_LESS_JMP),
+      LABEL($R_GREATER_JMP),
+      LABEL($R_LESS_OR_EQ_JMP),
+      LABEL($R_GREATER_OR_EQ_JMP),
+      LABEL($R_EQ_JMPK),
+      LABEL($R_NOT_EQ_JMPK),
+      LABEL($R_LESS_JMPK),
+      LABEL($R_GREATER_JMPK),
+      LABEL($R_LESS_OR_EQ_JMPK),
+      LABEL($R_GREATER_OR_EQ_JMPK),
+      LABEL($R_CALL),
+      LABEL($R_TAIL_CALL),
+      LABEL($R_RET),
+      LABEL($R_ITER_PREP),
+      LABEL($R_FOR_ITER),
+      LABEL($R_SUBSCRIPT),
+      LABEL($R_SET_SUBSCRIPT),
+      LABEL($R_GET_FIELD),
+      LABEL($R_GET_PROPERTY),
+      LABEL($R_SET_PROPERTY),
+      LABEL($R_LEN),
+      LABEL($R_TYPEOF),
+      LABEL($R_BUILD_LIST),
+      LABEL($R_BUILD_MAP),
+      LABEL($R_BUILD_CLOSURE),
+      LABEL($R_BUILD_STRUCT),
+      LABEL($R_BUILD_INSTANCE),
+      LABEL($R_DISPLAY),
+      LABEL($R_ASSERT),
+      LABEL($R_THROW),
+      LABEL($R_CLOSE_UPVALUE),
+  };
+  #undef LABEL
+#endif
+  LOAD_FRAME();
+  VM_LOOP {
+    CASE($R_MOVE): {
+      byte_t a = READ_BYTE();
+      slots[a] = slots[READ_BYTE()];
+      DISPATCH();
+    }
+    CASE($R_LOADK): {
+      byte_t a = READ_BYTE();
+      slots[a] = READ_CONST();
+      DISPATCH();
+    }
+    CASE($R_GET_UPVALUE): {
+      byte_t a = READ_BYTE();
+      slots[a] = *frame->closure->env[READ_BYTE()]->location;
+      DISPATCH();
+    }
+    CASE($R_SET_UPVALUE): {
+      byte_t u = READ_BYTE();
+      *frame->closure->env[u]->location = slots[READ_BYTE()];
+      DISPATCH();
+    }
+    CASE($R_GET_GLOBAL): {
+      byte_t a = READ_BYTE();
+      byte_t g = READ_BYTE();
+      Value val = *global_at(vm, g);
+      if (val == NOTHING_VAL) {
+        STORE_STATE();
+        undefined_global(vm, "Name '%s' is not defined", g);
+        TRY_RECOVER()
+      }
+      slots[a] = val;
+      DISPATCH();
+    }
+    CASE($R_SET_GLOBAL): {
+      byte_t depth = READ_BYTE();
+      byte_t g = READ_BYTE();
+      Value* global = global_at(vm, g);
+      if (*global == NOTHING_VAL) {
+        SYNC_STATE(depth);
+        undefined_global(vm, "use of undefined variable '%s'", g);
+        TRY_RECOVER()
+      }
+      *global = slots[depth - 1];
+      DISPATCH();
+    }
+    CASE($R_DEFINE_GLOBAL): {
+      byte_t depth = READ_BYTE();
+      *global_at(vm, READ_BYTE()) = slots[depth - 1];
+      DISPATCH();
+    }
+    CASE($R_ADD): {
+      REG_BINARY_OP(+, NUMBER_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_SUBTRACT): {
+      REG_BINARY_OP(-, NUMBER_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_MULTIPLY): {
+      REG_BINARY_OP(*, NUMBER_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_DIVIDE): {
+      REG_BINARY_OP(/, NUMBER_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_ADDK): {
+      REG_BINARY_OP(+, NUMBER_VAL, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_SUBTRACTK): {
+      REG_BINARY_OP(-, NUMBER_VAL, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_MOD): {
+      byte_t a = READ_BYTE();
+      Value l = slots[READ_BYTE()];
+      Value r = slots[READ_BYTE()];
+      BINARY_CHECK(%, l, r, IS_NUMBER);
+      slots[a] = NUMBER_VAL(fmod(AS_NUMBER(l), AS_NUMBER(r)));
+      DISPATCH();
+    }
+    CASE($R_POW): {
+      byte_t a = READ_BYTE();
+      Value l = slots[READ_BYTE()];
+      Value r = slots[READ_BYTE()];
+      BINARY_CHECK(**, l, r, IS_NUMBER);
+      slots[a] = NUMBER_VAL(pow(AS_NUMBER(l), AS_NUMBER(r)));
+      DISPATCH();
+    }
+    CASE($R_BW_LSHIFT): {
+      REG_BITWISE_OP(<<)
+      DISPATCH();
+    }
+    CASE($R_BW_RSHIFT): {
+      REG_BITWISE_OP(>>)
+      DISPATCH();
+    }
+    CASE($R_BW_AND): {
+      REG_BITWISE_OP(&)
+      DISPATCH();
+    }
+    CASE($R_BW_XOR): {
+      REG_BITWISE_OP(^)
+      DISPATCH();
+    }
+    CASE($R_BW_OR): {
+      REG_BITWISE_OP(|)
+      DISPATCH();
+    }
+    CASE($R_NEGATE): {
+      byte_t a = READ_BYTE();
+      Value v = slots[READ_BYTE()];
+      UNARY_CHECK(-, v, IS_NUMBER);
+      slots[a] = NUMBER_VAL(-AS_NUMBER(v));
+      DISPATCH();
+    }
+    CASE($R_NOT): {
+      byte_t a = READ_BYTE();
+      Value v = slots[READ_BYTE()];
+      slots[a] = BOOL_VAL(value_falsy(v));
+      DISPATCH();
+    }
+    CASE($R_BW_INVERT): {
+      byte_t a = READ_BYTE();
+      Value v = slots[READ_BYTE()];
+      UNARY_CHECK(~, v, IS_NUMBER);
+      slots[a] = NUMBER_VAL((~(int64_t)AS_NUMBER(v)));
+      DISPATCH();
+    }
+    CASE($R_EQ): {
+      byte_t a = READ_BYTE();
+      Value l = slots[READ_BYTE()];
+      Value r = slots[READ_BYTE()];
+      slots[a] = BOOL_VAL(value_equal(l, r));
+      DISPATCH();
+    }
+    CASE($R_NOT_EQ): {
+      byte_t a = READ_BYTE();
+      Value l = slots[READ_BYTE()];
+      Value r = slots[READ_BYTE()];
+      slots[a] = BOOL_VAL(!value_equal(l, r));
+      DISPATCH();
+    }
+    CASE($R_LESS): {
+      REG_BINARY_OP(<, BOOL_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_GREATER): {
+      REG_BINARY_OP(>, BOOL_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_LESS_OR_EQ): {
+      REG_BINARY_OP(<=, BOOL_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_GREATER_OR_EQ): {
+      REG_BINARY_OP(>=, BOOL_VAL, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_JMP): {
+      uint16_t offset = READ_SHORT();
+      ip += offset;
+      DISPATCH();
+    }
+    CASE($R_LOOP): {
+      // the $LOOP's offset in the stack code, where it's counted
+      uint16_t site = READ_SHORT();
+      uint16_t offset = READ_SHORT();
+      PROFILE_LOOP(
+          frame->closure->func,
+          frame->closure->func->code.bytes + site);
+      (void)site;
+      SAMPLE();
+      ip -= offset;
+      DISPATCH();
+    }
+    CASE($R_JMP_FALSE): {
+      Value v = slots[READ_BYTE()];
+      uint16_t offset = READ_SHORT();
+      if (value_falsy(v)) {
+        ip += offset;
+      }
+      DISPATCH();
+    }
+    CASE($R_EQ_JMP): {
+      REG_EQ_JMP(true, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_NOT_EQ_JMP): {
+      REG_EQ_JMP(false, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_LESS_JMP): {
+      REG_COMPARE_JMP(<, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_GREATER_JMP): {
+      REG_COMPARE_JMP(>, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_LESS_OR_EQ_JMP): {
+      REG_COMPARE_JMP(<=, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_GREATER_OR_EQ_JMP): {
+      REG_COMPARE_JMP(>=, slots[READ_BYTE()])
+      DISPATCH();
+    }
+    CASE($R_EQ_JMPK): {
+      REG_EQ_JMP(true, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_NOT_EQ_JMPK): {
+      REG_EQ_JMP(false, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_LESS_JMPK): {
+      REG_COMPARE_JMP(<, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_GREATER_JMPK): {
+      REG_COMPARE_JMP(>, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_LESS_OR_EQ_JMPK): {
+      REG_COMPARE_JMP(<=, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_GREATER_OR_EQ_JMPK): {
+      REG_COMPARE_JMP(>=, READ_CONST())
+      DISPATCH();
+    }
+    CASE($R_TAIL_CALL):
+    CASE($R_CALL): {
+      byte_t depth = READ_BYTE();
+      byte_t argc = READ_BYTE();
+      SYNC_STATE(depth);
+      SAMPLE();
+      if (!call_value(
+              vm,
+              slots[depth - argc - 1],
+              argc,
+              inst == $R_TAIL_CALL)) {
+        TRY_RECOVER()
+      }
+      LOAD_FRAME();
+      JIT_HOOK(false);
+      DISPATCH();
+    }
+    CASE($R_RET): {
+      Value ret_val = slots[READ_BYTE()];
+      pop_frame(vm);
+      // as with $RET, the result replaces the callee on the caller's stack
+      vm->sp = slots + 1;
+      if (vm->frame_count == 0) {
+        return RESULT_SUCCESS;
+      }
+      // close all upvalues currently still unclosed
+      close_upvalues(vm, slots);
+      *slots = ret_val;
+      LOAD_FRAME();
+      JIT_HOOK(false);
+      DISPATCH();
+    }
+    CASE($R_ITER_PREP): {
+      byte_t depth = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!prep_iter(vm)) {
+        TRY_RECOVER()
+      }
+      LOAD_FRAME();
+      JIT_HOOK(false);
+      DISPATCH();
+    }
+    CASE($R_FOR_ITER): {
+      byte_t depth = READ_BYTE();
+      uint16_t offset = READ_SHORT();
+      SYNC_STATE(depth);
+      int next = next_native(vm);
+      if (next == -1) {
+        if (!call_builtin(vm, fn_next, slots[depth - 1])) {
+          TRY_RECOVER()
+        }
+        LOAD_FRAME();
+        JIT_HOOK(false);
+        DISPATCH();
+      }
+      if (!next) {
+        ip += offset;
+      }
+      DISPATCH();
+    }
+    CASE($R_SUBSCRIPT): {
+      byte_t depth = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!perform_subscript(vm, slots[depth - 2], slots[depth - 1])) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_SET_SUBSCRIPT): {
+      byte_t depth = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!perform_subscript_assign(
+              vm,
+              slots[depth - 2],
+              slots[depth - 1],
+              slots[depth - 3])) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_GET_FIELD): {
+      byte_t depth = READ_BYTE();
+      Value property = READ_CONST();
+      InlineCache* ic = READ_CACHE();
+      Value value = slots[depth - 1], res;
+      if ((res = cached_field(vm, ic, value, AS_STRING(property)))
+          != NOTHING_VAL) {
+        slots[depth - 1] = res;
+        DISPATCH();
+      }
+      SYNC_STATE(depth - 1);
+      if (!struct_prop_access(vm, value, property)) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_GET_PROPERTY): {
+      byte_t depth = READ_BYTE();
+      Value property = READ_CONST();
+      InlineCache* ic = READ_CACHE();
+      Value value = slots[depth - 1], res;
+      if (IS_INSTANCE(value)
+          && (res = cached_get(
+                  vm,
+                  ic,
+                  &AS_INSTANCE(value)->fields,
+                  AS_STRING(property)))
+              != NOTHING_VAL) {
+        slots[depth - 1] = res;
+        DISPATCH();
+      }
+      SYNC_STATE(depth - 1);
+      if (!instance_prop_access(vm, value, AS_STRING(property))) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_SET_PROPERTY): {
+      byte_t depth = READ_BYTE();
+      Value property = READ_CONST();
+      SYNC_STATE(depth);
+      if (!instance_prop_assign(vm, AS_STRING(property), slots[depth - 1])) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_LEN):
+    CASE($R_TYPEOF): {
+      byte_t depth = READ_BYTE();
+      byte_t core = READ_BYTE();
+      byte_t index = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!is_core(vm, core)) {
+        if (!intrinsic_callee(vm, core, index)
+            || !call_value(vm, slots[depth - 1], 1, false)) {
+          TRY_RECOVER()
+        }
+        LOAD_FRAME();
+        JIT_HOOK(false);
+        DISPATCH();
+      }
+      if (!call_intrinsic(vm, index)) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_BUILD_LIST): {
+      byte_t depth = READ_BYTE();
+      byte_t len = READ_BYTE();
+      SYNC_STATE(depth);
+      build_list(vm, len);
+      DISPATCH();
+    }
+    CASE($R_BUILD_MAP): {
+      byte_t depth = READ_BYTE();
+      byte_t len = READ_BYTE();
+      SYNC_STATE(depth);
+      build_map(vm, len);
+      DISPATCH();
+    }
+    CASE($R_BUILD_CLOSURE): {
+      byte_t depth = READ_BYTE();
+      ObjFn* fn = AS_FUNC(READ_CONST());
+      SYNC_STATE(depth);
+      ip = build_closure(vm, fn, ip, slots, false);
+      DISPATCH();
+    }
+    CASE($R_BUILD_STRUCT): {
+      byte_t depth = READ_BYTE();
+      ObjString* name = READ_STRING();
+      byte_t field_count = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!build_struct(vm, name, field_count)) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_BUILD_INSTANCE): {
+      byte_t depth = READ_BYTE();
+      byte_t field_count = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!build_instance(vm, field_count)) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_DISPLAY): {
+      byte_t depth = READ_BYTE();
+      byte_t len = READ_BYTE();
+      SYNC_STATE(depth);
+      display(vm, len);
+      DISPATCH();
+    }
+    CASE($R_ASSERT): {
+      byte_t depth = READ_BYTE();
+      SYNC_STATE(depth);
+      if (!check_assert(vm)) {
+        TRY_RECOVER()
+      }
+      DISPATCH();
+    }
+    CASE($R_THROW): {
+      byte_t depth = READ_BYTE();
+      SYNC_STATE(depth);
+      throw_value(vm);
+      TRY_RECOVER()
+    }
+    CASE($R_CLOSE_UPVALUE): {
+      close_upvalues(vm, slots + READ_BYTE());
+      DISPATCH();
+    }
+    DEFAULT:
       UNREACHABLE("unknown opcode");
   }
   END_BRACE
 }
 
+IResult vm_run(VM* vm) {
+  // under --reg, the two engines pass frames back and forth
+  IResult res;
+  do {
+    res = vm->fp->closure->func->reg.bytes ? run_reg(vm) : run(vm);
+  } while (res == RESULT_SWITCH);
+  return res;
+}
+
+#undef SYNC_STATE
+#undef REG_BINARY_OP
+#undef REG_BITWISE_OP
+#undef REG_COMPARE_JMP
+#undef REG_EQ_JMP
 #undef READ_BYTE
 #undef READ_SHORT
 #undef READ_CONST
 #undef READ_STRING
+#undef READ_CACHE
 #undef PEEK_STACK
 #undef PEEK_STACK_AT
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef PEEK_AT
+#undef STORE_STATE
+#undef LOAD_FRAME
+#undef LOAD_STATE
 #undef BINARY_OP
+#undef QUICK_BINARY_OP
 #undef BINARY_CHECK
 #undef UNARY_CHECK
+#undef COMPARE_JMP
 #undef VM_LOOP
+#undef CASE
+#undef DEFAULT
 #undef DISPATCH
 #undef END_BRACE
 #undef KB_SIZE
 #undef TRY_RECOVER
+#undef JIT_HOOK
+#undef TRACE_LOOP
+#undef TRACE_BRANCH
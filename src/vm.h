@@ -11,22 +11,35 @@
   #include "debug.h"
 #endif
 
-#define CALL_FRAME_MAX (0x50)
-#define STACK_MAX ((CALL_FRAME_MAX) * (CONST_MAX + 1))
+// both stacks start small and grow on demand, see push_frame()
+#define CALL_FRAME_INIT (0x40)
+#define CALL_FRAME_MAX (0x10000)
+#define STACK_INIT (0x400)
+// room above a frame's max_stack for what natives push
+#define STACK_RESERVE (0x10)
+// calls and loop iterations a function takes before --jit compiles it
+#define JIT_THRESHOLD (0x40)
+// calls into machine code nested on the C stack before run() takes over
+#define JIT_DEPTH_MAX (0x200)
+// the threshold of programs built from --emit-c: only their own functions,
+// compiled ahead of time, leave run()
+#define JIT_AOT (INT32_MAX)
+// iterations a loop takes before --trace records it
+#define TRACE_THRESHOLD (0x40)
 
 typedef enum {
   RESULT_SUCCESS = 0,  // successful run
   RESULT_COMPILE_ERROR,  // parse/compile error
   RESULT_RUNTIME_ERROR,  // runtime error
+  RESULT_SWITCH,  // the current frame runs in the other engine, see vm_run()
 } IResult;
 
-typedef struct {
-  byte_t* handler_ip;
-  Value* sp;
-} TryCtx;
+typedef enum {
+  ENGINE_STACK,  // run(): the stack bytecode
+  ENGINE_REG,  // run_reg(): register bytecode translated from it (regen.c)
+} Engine;
 
 typedef struct {
-  TryCtx try_ctx;
   byte_t* ip;
   ObjClosure* closure;
   Value* stack;
@@ -35,19 +48,38 @@ typedef struct {
 typedef struct VM {
   bool is_compiling;
   bool has_error;
+  bool optimize;  // bytecode optimizations (fusion, intrinsics) at compile time
+  Engine engine;
+  int jit_threshold;  // see JIT_THRESHOLD, -1 without --jit
+  int jit_depth;  // see JIT_DEPTH_MAX
+  int trace_threshold;  // see TRACE_THRESHOLD, -1 without --trace
+  Trace* recording;  // the loop --trace is recording an iteration of
+  ObjFn* recording_fn;  // its function, kept alive while it is
   int frame_count;
   Map strings;
   Map modules;
   GC gc;
-  Value stack[STACK_MAX];
-  CallFrame frames[CALL_FRAME_MAX];
+  int stack_capacity;
+  int frame_capacity;
+  Value* stack;
+  CallFrame* frames;
   CallFrame* fp;
   Value* sp;
-  ObjUpvalue* upvalues;
+  // the open upvalues, sorted by the stack slot they point at, and the open
+  // upvalue of each stack slot (if any), see capture_upvalue()
+  ObjUpvalue** upvalues;
+  int upvalue_count;
+  int upvalue_capacity;
+  ObjUpvalue** slot_upvalues;
   Obj* objects;
   struct Compiler* compiler;
   ObjStruct* builtins;
   ObjStruct* current_module;
+  struct Sampler* sampler;  // --sample-profile, see profile.h
+#ifdef EVE_DEBUG_CACHES
+  uint64_t ic_hits;
+  uint64_t ic_misses;
+#endif
 } VM;
 
 Value vm_pop_stack(VM* vm);
@@ -60,6 +92,9 @@ void free_vm(VM* vm);
 bool boot_vm(VM* vm, ObjFn* func);
 IResult runtime_error(VM* vm, Value err, char* fmt, ...);
 IResult run(VM* vm);
+IResult run_reg(VM* vm);
+IResult vm_run(VM* vm);
 void serde_error_cb(VM* vm, char* fmt, ...);
+int frame_line(VM* vm, CallFrame* fp);
 
 #endif  //EVE_VM_H
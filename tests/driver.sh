@@ -30,4 +30,149 @@ check --version
 ${eve} | grep -q Usage
 check options
 
+# fused and unfused (-O0) code behave the same
+diff <(${eve} tests/fuse.eve 2>&1) <(${eve} -O0 tests/fuse.eve 2>&1) > /dev/null
+check -O0
+
+# fusion only happens when optimizing
+${eve} -d tests/fuse.eve | grep -q '\$ADD_LOCALS' \
+  && ! ${eve} -O0 -d tests/fuse.eve | grep -q '\$ADD_LOCALS'
+check fusion
+
+# folded and cleaned up code behave the same as code compiled as written
+same=0
+for test in tests/fold.eve tests/peephole.eve; do
+  diff <(${eve} ${test} 2>&1) <(${eve} -O0 ${test} 2>&1) > /dev/null \
+    || same=1
+done
+[ ${same} -eq 0 ]
+check "-O0 folding"
+
+# and is shorter
+[ $(${eve} -d tests/peephole.eve | wc -l) \
+  -lt $(${eve} -O0 -d tests/peephole.eve | wc -l) ]
+check peephole
+
+# a function's constants are shared by their uses (-O0 keeps one per use);
+# counted over the test programs
+constants() {
+  for test in tests/*.eve; do
+    ${eve} "$@" -d ${test} 2> /dev/null
+  done | awk '/^\t\t[0-9]+ constants$/ { n += $1 } END { print n }'
+}
+before=$(constants -O0)
+after=$(constants)
+echo "constants in tests/: ${before} with -O0, ${after} shared"
+[ ${after} -lt ${before} ]
+check "constant sharing"
+
+# so do intrinsics, with the same results
+${eve} -d tests/intrinsic.eve | grep -q '\$LEN' \
+  && ! ${eve} -O0 -d tests/intrinsic.eve | grep -q '\$LEN' \
+  && ${eve} -O0 tests/intrinsic.eve > /dev/null
+check intrinsics
+
+# the register engine matches the stack engine
+same=0
+for test in tests/*.eve; do
+  diff <(${eve} ${test} 2>&1) <(${eve} --reg ${test} 2>&1) > /dev/null \
+    || same=1
+done
+[ ${same} -eq 0 ]
+check --reg
+
+# machine code matches the stack engine, with every function compiled
+same=0
+for test in tests/*.eve; do
+  diff <(${eve} ${test} 2>&1) <(${eve} --jit-all ${test} 2>&1) > /dev/null \
+    || same=1
+done
+[ ${same} -eq 0 ]
+check --jit-all
+
+# so do traces of every loop
+same=0
+for test in tests/*.eve; do
+  diff <(${eve} ${test} 2>&1) <(${eve} --trace-all ${test} 2>&1) > /dev/null \
+    || same=1
+done
+[ ${same} -eq 0 ]
+check --trace-all
+
+# programs built from --emit-c match it too
+runtime=$(dirname ${eve})/libeve-runtime.a
+aot=$(mktemp -d)
+same=0
+for test in tests/*.eve; do
+  ${eve} --emit-c ${test} > ${aot}/prog.c \
+    && cc -I src ${aot}/prog.c ${runtime} -lm -o ${aot}/prog \
+    && diff <(${eve} ${test} 2>&1) <(${aot}/prog 2>&1) > /dev/null \
+    || same=1
+done
+[ ${same} -eq 0 ]
+check --emit-c
+
+# --profile prints the execution counters on exit, or says that the build
+# has none
+${eve} --profile tests/profile.eve 2>&1 > /dev/null \
+  | grep -qE '1  fib \(tests/profile.eve:5\)$|without EVE_PROFILE'
+check --profile
+
+# --sample-profile writes the sampled stacks as folded lines
+folded=$(mktemp)
+${eve} --sample-profile=${folded} bench/fib.eve > /dev/null \
+  && grep -qE '^<anonymous> \(bench/fib.eve:[0-9]+\);fib .* [0-9]+$' ${folded}
+check --sample-profile
+rm -f ${folded}
+
+# --opcode-stats prints the opcode counts, or says that the build has none
+${eve} --opcode-stats tests/fuse.eve 2>&1 > /dev/null \
+  | grep -qE '\$RET$|without EVE_OPCODE_STATS'
+check --opcode-stats
+
+# -d with --reg shows register code
+${eve} -d --reg tests/fuse.eve | grep -q '\$R_'
+check "-d --reg"
+
+# past 255 constants, locals and upvalues, and 64 KB of jumps, code goes $WIDE
+wide_script() {
+  for i in $(seq 0 299); do echo "let g$i = $i;"; done
+  echo 'struct Point { @compose x, y; @declare k => 7; }'
+  echo 'let p = Point { x = 1, y = 2 };'
+  echo 'p.y = g299 + p.x;'
+  echo 'assert p.y == 300 && Point::k == 7;'
+  echo 'fn wide() {'
+  for i in $(seq 0 299); do echo "let v$i = $((i + 1000));"; done
+  echo 'let set = fn (n) { v299 = n; };'
+  echo "let all = fn () { return $(printf 'v%d + ' $(seq 0 299)) 0; };"
+  echo 'set(5);'
+  echo "assert all() == $(((1000 + 1298) * 299 / 2 + 5));"
+  echo 'let n = 0;'
+  echo 'let t = 0;'
+  echo 'while n < 3 {'
+  echo 'n = n + 1;'
+  echo 'if n == 2 { continue; }'
+  echo 'if n == 4 { break; }'
+  for i in $(seq 0 7000); do echo "t = t + v1;"; done
+  echo '}'
+  echo 'return t;'
+  echo '}'
+  echo 'assert wide() == 7001 * 1001 * 2;'
+}
+wide=$(mktemp)
+wide_script > ${wide}
+# (--reg runs the functions too large for it in run())
+${eve} ${wide} && ${eve} -O0 ${wide} && ${eve} --reg ${wide} \
+  && ${eve} --jit-all ${wide} && ${eve} --trace-all ${wide} \
+  && ${eve} -d ${wide} | grep -q '\$WIDE \$LOOP'
+check '$WIDE'
+
+# --emit-c leaves functions with $WIDE code to the interpreter
+${eve} --emit-c ${wide} > ${aot}/prog.c \
+  && cc -I src ${aot}/prog.c ${runtime} -lm -o ${aot}/prog \
+  && ${aot}/prog
+check '--emit-c $WIDE'
+rm -f ${wide}
+rm -rf ${aot}
+
 echo OK